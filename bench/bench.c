@@ -0,0 +1,1202 @@
+/*
+
+BSD 2-Clause License
+
+Copyright (c) 2025, Raphael Beck
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+/**
+ *  @file bench.c
+ *  @author Raphael Beck
+ *  @brief Throughput benchmark: sweeps compression levels and buffer sizes across ccrush's public functions and deterministic, locally generated corpora.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ccrush.h>
+#include <zlib.h>
+
+#ifdef _WIN32
+#define WIN32_NO_STATUS
+#include <windows.h>
+#undef WIN32_NO_STATUS
+#endif
+
+/*
+ * What ccrush was built against (see the ccrush_BACKEND and ccrush_LIBDEFLATE CMake options).
+ * It's the first column of every result line, so that the tables of differently configured builds can simply be concatenated and compared.
+ */
+#ifdef ZLIBNG_VERSION
+#define BENCH_ZLIB_BACKEND "zlib-ng v" ZLIBNG_VERSION
+#else
+#define BENCH_ZLIB_BACKEND "zlib v" ZLIB_VERSION
+#endif
+
+#ifdef CCRUSH_LIBDEFLATE
+#define BENCH_BACKEND BENCH_ZLIB_BACKEND " + libdeflate"
+#else
+#define BENCH_BACKEND BENCH_ZLIB_BACKEND
+#endif
+
+static const char HELP_TEXT[] = "\n"
+                                "ccrush_bench v%s (%s)\n"
+                                "------------- \n"
+                                "Measures compression ratio, throughput, allocations and memory usage of ccrush's public functions.\n"
+                                "All corpora are generated locally from a fixed seed, so runs are comparable across versions and machines.\n\n"
+                                "The results are printed to stdout as a tab-separated table (one header line, then one line per run):\n\n"
+                                "  backend (what ccrush was built against, e.g. \"zlib v1.3.1\" or \"zlib-ng v2.2.2\"),\n"
+                                "  function, corpus, level, buffer_kib (0 = the function has no buffer size parameter), scrub (whether buffer scrubbing was on),\n"
+                                "  input_bytes, output_bytes, ratio,\n"
+                                "  compress_mb_s, decompress_mb_s (1 MB = 10^6 bytes; best out of all iterations),\n"
+                                "  compress_allocs, decompress_allocs (heap allocations per call, including zlib's internal ones),\n"
+                                "  compress_peak_heap_kib, decompress_peak_heap_kib (peak live heap memory allocated by ccrush during the call),\n"
+                                "  peak_rss_kib (the process' peak resident set size during the line's runs; Linux only, \"n/a\" elsewhere)\n\n"
+                                "Note that ccrush's allocations are routed through a counting allocator, which (like every custom allocator) doesn't shrink outputs.\n\n"
+                                "Optional parameters are:\n\n"
+                                "  --size <KiB>\n  Size of every corpus.\n  Default value: 1024\n\n"
+                                "  --iterations <n>\n  How many times every run is repeated (the fastest one is reported).\n  Default value: 3\n\n"
+                                "  --levels <list>\n  Comma-separated list of compression levels.\n  Default value: 0,1,2,3,4,5,6,7,8,9\n\n"
+                                "  --buffer-sizes <list>\n  Comma-separated list of buffer sizes (in KiB) for the functions that have one.\n  Default value: 16,64,256,1024\n\n"
+                                "  --corpora <list>\n  Comma-separated list of corpora to run.\n  Available: text, json, binary, random, zeros (default: all of them)\n\n"
+                                "  --functions <list>\n  Comma-separated list of functions to run.\n  Available: compress, compress_with_size_header, compress_into, ctx, compress_mt, batch, stream, file, file_raw, file_mt, container (default: all of them)\n\n"
+                                "  --threads <n>\n  Thread count for the multi-threaded functions (compress_mt, batch, file_mt, container). Pass 0 to use one thread per CPU core.\n  Default value: 0\n\n"
+                                "  --pipelined-io\n  Enables pipelined I/O for the FILE* based functions (see ccrush_set_pipelined_io()).\n\n"
+                                "  --scrub <list>\n  Comma-separated list of buffer scrubbing settings to run (1 = on, 0 = off; see ccrush_set_scrub_buffers()).\n  Default value: 1,0\n\n"
+                                "  --no-scrub\n  Same as \"--scrub 0\".\n\n"
+                                "Example:\n\n"
+                                "  ccrush_bench --size 4096 --levels 1,6,9 --corpora text,json > results.tsv\n"
+                                "\n";
+
+#define BENCH_MAX_LIST_LENGTH 32
+
+/*
+ * Temporary files for the file based functions (created in the working directory and removed again at the end).
+ */
+#define BENCH_INPUT_FILE "ccrush_bench.in"
+#define BENCH_COMPRESSED_FILE "ccrush_bench.z"
+#define BENCH_DECOMPRESSED_FILE "ccrush_bench.out"
+
+// ------------------------------------------------------------------------------------------------------------------------------------------
+// Counting allocator
+
+/*
+ * Every allocation is prefixed with its size, so that the amount of live heap memory (and its peak) can be tracked.
+ * All counters are updated atomically: the multi-threaded functions allocate from their worker threads.
+ */
+#define BENCH_ALLOC_HEADER_SIZE 16
+
+static volatile long long bench_alloc_count = 0;
+static volatile long long bench_live_bytes = 0;
+static volatile long long bench_peak_bytes = 0;
+
+static inline long long bench_atomic_add(volatile long long* value, const long long delta)
+{
+#ifdef _MSC_VER
+    return InterlockedExchangeAdd64(value, delta) + delta;
+#else
+    return __atomic_add_fetch(value, delta, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void bench_atomic_max(volatile long long* value, const long long candidate)
+{
+#ifdef _MSC_VER
+    long long current = *value;
+    while (candidate > current)
+    {
+        const long long previous = InterlockedCompareExchange64(value, candidate, current);
+        if (previous == current)
+        {
+            break;
+        }
+        current = previous;
+    }
+#else
+    long long current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    while (candidate > current && !__atomic_compare_exchange_n(value, &current, candidate, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+#endif
+}
+
+static void* bench_alloc(void* user, const size_t size)
+{
+    (void)user;
+
+    uint8_t* mem = malloc(size + BENCH_ALLOC_HEADER_SIZE);
+    if (mem == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(mem, &size, sizeof(size_t));
+
+    bench_atomic_add(&bench_alloc_count, 1);
+    bench_atomic_max(&bench_peak_bytes, bench_atomic_add(&bench_live_bytes, (long long)size));
+
+    return mem + BENCH_ALLOC_HEADER_SIZE;
+}
+
+static void bench_free(void* user, void* mem)
+{
+    (void)user;
+
+    uint8_t* header = (uint8_t*)mem - BENCH_ALLOC_HEADER_SIZE;
+
+    size_t size;
+    memcpy(&size, header, sizeof(size_t));
+
+    bench_atomic_add(&bench_live_bytes, -(long long)size);
+    free(header);
+}
+
+// ------------------------------------------------------------------------------------------------------------------------------------------
+// Measurements
+
+static uint64_t bench_now_ns()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ * Resets the process' peak resident set size (VmHWM), so that the next bench_peak_rss_kib() call only covers what happened since.
+ * Only Linux can do that (by writing "5" to /proc/self/clear_refs); everywhere else, the OS only knows the peak of the whole process lifetime,
+ * which would say nothing about an individual run: there, this fails and no RSS is reported at all.
+ */
+static int bench_reset_peak_rss()
+{
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    const int r = fputs("5", file) >= 0 ? 0 : -1;
+    return fclose(file) == 0 ? r : -1;
+#else
+    return -1;
+#endif
+}
+
+static long long bench_peak_rss_kib()
+{
+    long long peak_rss_kib = -1;
+
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        if (strncmp(line, "VmHWM:", 6) == 0)
+        {
+            peak_rss_kib = strtoll(line + 6, NULL, 10);
+            break;
+        }
+    }
+
+    fclose(file);
+#endif
+
+    return peak_rss_kib;
+}
+
+/*
+ * One (de)compression call's cost: wall-clock time, heap allocations and the peak amount of heap memory that was live during the call.
+ */
+struct bench_cost
+{
+    uint64_t ns;
+    uint64_t allocs;
+    uint64_t peak_heap_bytes;
+};
+
+struct bench_probe
+{
+    uint64_t start_ns;
+    long long start_allocs;
+    long long start_live_bytes;
+};
+
+static inline void bench_probe_start(struct bench_probe* probe)
+{
+    probe->start_allocs = bench_alloc_count;
+    probe->start_live_bytes = bench_live_bytes;
+    bench_peak_bytes = bench_live_bytes;
+    probe->start_ns = bench_now_ns();
+}
+
+static inline void bench_probe_stop(const struct bench_probe* probe, struct bench_cost* cost)
+{
+    cost->ns = bench_now_ns() - probe->start_ns;
+    cost->allocs = (uint64_t)(bench_alloc_count - probe->start_allocs);
+    cost->peak_heap_bytes = (uint64_t)(bench_peak_bytes - probe->start_live_bytes);
+}
+
+/*
+ * A single benchmark run: one function, one corpus, one level and one buffer size.
+ */
+struct bench_run
+{
+    const uint8_t* data;
+    size_t data_length;
+    int level;
+    uint32_t buffer_size_kib;
+    uint32_t thread_count;
+    size_t compressed_length;
+    struct bench_cost compress;
+    struct bench_cost decompress;
+};
+
+#define BENCH_MEASURE(run, phase, call)           \
+    do                                            \
+    {                                             \
+        struct bench_probe probe_;                \
+        bench_probe_start(&probe_);               \
+        r = (call);                               \
+        bench_probe_stop(&probe_, &(run)->phase); \
+    } while (0)
+
+static int bench_verify(const struct bench_run* run, const uint8_t* decompressed, const size_t decompressed_length)
+{
+    return decompressed_length == run->data_length && memcmp(decompressed, run->data, decompressed_length) == 0 ? 0 : -1;
+}
+
+static int bench_verify_file(const struct bench_run* run, const char* file_path)
+{
+    FILE* file = fopen(file_path, "rb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    uint8_t* data = malloc(run->data_length + 1);
+    const size_t data_length = data != NULL ? fread(data, 1, run->data_length + 1, file) : 0;
+
+    fclose(file);
+
+    const int r = data != NULL ? bench_verify(run, data, data_length) : -1;
+
+    free(data);
+    return r;
+}
+
+static long long bench_file_size(const char* file_path)
+{
+    FILE* file = fopen(file_path, "rb");
+    if (file == NULL || fseek(file, 0, SEEK_END) != 0)
+    {
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        return -1;
+    }
+
+    const long long size = (long long)ftell(file);
+
+    fclose(file);
+    return size;
+}
+
+// ------------------------------------------------------------------------------------------------------------------------------------------
+// Benchmarked functions (each one compresses the run's data, decompresses it again and checks the result)
+
+static int bench_compress(struct bench_run* run)
+{
+    int r;
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    BENCH_MEASURE(run, compress, ccrush_compress(run->data, run->data_length, run->buffer_size_kib, run->level, &compressed, &run->compressed_length));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress(compressed, run->compressed_length, run->buffer_size_kib, &decompressed, &decompressed_length));
+    }
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed, decompressed_length);
+    }
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    return r;
+}
+
+static int bench_compress_with_size_header(struct bench_run* run)
+{
+    int r;
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    BENCH_MEASURE(run, compress, ccrush_compress_with_size_header(run->data, run->data_length, run->buffer_size_kib, run->level, &compressed, &run->compressed_length));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress(compressed, run->compressed_length, run->buffer_size_kib, &decompressed, &decompressed_length));
+    }
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed, decompressed_length);
+    }
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    return r;
+}
+
+static int bench_compress_into(struct bench_run* run)
+{
+    int r = -1;
+    size_t decompressed_length = 0;
+
+    // The caller owned buffers are allocated outside of the measurement (that's the whole point of these functions).
+    const size_t compressed_capacity = ccrush_compress_bound(run->data_length);
+    uint8_t* compressed = malloc(compressed_capacity);
+    uint8_t* decompressed = malloc(run->data_length);
+
+    if (compressed == NULL || decompressed == NULL)
+    {
+        goto exit;
+    }
+
+    BENCH_MEASURE(run, compress, ccrush_compress_into(run->data, run->data_length, run->level, compressed, compressed_capacity, &run->compressed_length));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress_into(compressed, run->compressed_length, decompressed, run->data_length, &decompressed_length));
+    }
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed, decompressed_length);
+    }
+
+exit:
+    free(compressed);
+    free(decompressed);
+    return r;
+}
+
+static int bench_ctx(struct bench_run* run)
+{
+    ccrush_ctx* ctx = NULL;
+
+    int r = ccrush_ctx_new(run->buffer_size_kib, &ctx);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    // Warm the context up first: what's measured is the steady state of a reused context.
+    r = ccrush_ctx_compress(ctx, run->data, run->data_length, run->level, &compressed, &run->compressed_length);
+
+    if (r == 0)
+    {
+        r = ccrush_ctx_decompress(ctx, compressed, run->compressed_length, &decompressed, &decompressed_length);
+    }
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    compressed = decompressed = NULL;
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, compress, ccrush_ctx_compress(ctx, run->data, run->data_length, run->level, &compressed, &run->compressed_length));
+    }
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_ctx_decompress(ctx, compressed, run->compressed_length, &decompressed, &decompressed_length));
+    }
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed, decompressed_length);
+    }
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    ccrush_ctx_free(ctx);
+    return r;
+}
+
+static int bench_compress_mt(struct bench_run* run)
+{
+    int r;
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    BENCH_MEASURE(run, compress, ccrush_compress_mt(run->data, run->data_length, run->buffer_size_kib, run->level, run->thread_count, &compressed, &run->compressed_length));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress(compressed, run->compressed_length, run->buffer_size_kib, &decompressed, &decompressed_length));
+    }
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed, decompressed_length);
+    }
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    return r;
+}
+
+/*
+ * Size of the records that the batch benchmark cuts the corpus into.
+ */
+#define BENCH_BATCH_RECORD_SIZE 1024
+
+static int bench_batch(struct bench_run* run)
+{
+    int r = -1;
+
+    const size_t count = (run->data_length + BENCH_BATCH_RECORD_SIZE - 1) / BENCH_BATCH_RECORD_SIZE;
+
+    const uint8_t** records = malloc(count * sizeof(uint8_t*));
+    size_t* record_lengths = malloc(count * sizeof(size_t));
+    size_t* offsets = malloc((count + 1) * sizeof(size_t));
+
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    if (records == NULL || record_lengths == NULL || offsets == NULL)
+    {
+        goto exit;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i] = run->data + (i * BENCH_BATCH_RECORD_SIZE);
+        record_lengths[i] = i == count - 1 ? run->data_length - (i * BENCH_BATCH_RECORD_SIZE) : BENCH_BATCH_RECORD_SIZE;
+    }
+
+    BENCH_MEASURE(run, compress, ccrush_compress_batch(records, record_lengths, count, run->level, run->thread_count, &compressed, &run->compressed_length, offsets));
+
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i] = compressed + offsets[i];
+        record_lengths[i] = offsets[i + 1] - offsets[i];
+    }
+
+    BENCH_MEASURE(run, decompress, ccrush_decompress_batch(records, record_lengths, count, run->buffer_size_kib, run->thread_count, &decompressed, &decompressed_length, offsets));
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed, decompressed_length);
+    }
+
+exit:
+    free(records);
+    free(record_lengths);
+    free(offsets);
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    return r;
+}
+
+/*
+ * Output sink for the stream benchmark (a plain, caller owned growable buffer).
+ */
+struct bench_sink
+{
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+};
+
+static int bench_sink_write(void* user, const uint8_t* data, const size_t data_length)
+{
+    struct bench_sink* sink = (struct bench_sink*)user;
+
+    if (data_length > sink->capacity - sink->length)
+    {
+        size_t new_capacity = sink->capacity ? sink->capacity : 1024 * 64;
+
+        while (data_length > new_capacity - sink->length)
+        {
+            new_capacity *= 2;
+        }
+
+        uint8_t* new_data = realloc(sink->data, new_capacity);
+        if (new_data == NULL)
+        {
+            return -1;
+        }
+
+        sink->data = new_data;
+        sink->capacity = new_capacity;
+    }
+
+    memcpy(sink->data + sink->length, data, data_length);
+    sink->length += data_length;
+
+    return 0;
+}
+
+/*
+ * How much data the stream benchmark feeds into the stream per ccrush_stream_update() call.
+ */
+#define BENCH_STREAM_UPDATE_SIZE (1024 * 64)
+
+static int bench_stream_run(const int mode, const int level, const uint32_t buffer_size_kib, const uint8_t* data, const size_t data_length, struct bench_sink* sink)
+{
+    ccrush_stream* stream = NULL;
+
+    int r = ccrush_stream_init(&stream, mode, level, buffer_size_kib, &bench_sink_write, sink);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    for (size_t offset = 0; offset < data_length && r == 0; offset += BENCH_STREAM_UPDATE_SIZE)
+    {
+        r = ccrush_stream_update(stream, data + offset, data_length - offset < BENCH_STREAM_UPDATE_SIZE ? data_length - offset : BENCH_STREAM_UPDATE_SIZE);
+    }
+
+    if (r == 0)
+    {
+        r = ccrush_stream_finish(stream);
+    }
+
+    ccrush_stream_free(stream);
+    return r;
+}
+
+static int bench_stream(struct bench_run* run)
+{
+    int r;
+
+    struct bench_sink compressed = { NULL, 0, 0 };
+    struct bench_sink decompressed = { NULL, 0, 0 };
+
+    BENCH_MEASURE(run, compress, bench_stream_run(CCRUSH_STREAM_MODE_COMPRESS, run->level, run->buffer_size_kib, run->data, run->data_length, &compressed));
+
+    run->compressed_length = compressed.length;
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, bench_stream_run(CCRUSH_STREAM_MODE_DECOMPRESS, run->level, run->buffer_size_kib, compressed.data, compressed.length, &decompressed));
+    }
+
+    if (r == 0)
+    {
+        r = bench_verify(run, decompressed.data, decompressed.length);
+    }
+
+    free(compressed.data);
+    free(decompressed.data);
+    return r;
+}
+
+static int bench_finish_file_run(struct bench_run* run, int r)
+{
+    const long long compressed_length = bench_file_size(BENCH_COMPRESSED_FILE);
+
+    if (r == 0 && compressed_length < 0)
+    {
+        r = -1;
+    }
+
+    if (r == 0)
+    {
+        run->compressed_length = (size_t)compressed_length;
+        r = bench_verify_file(run, BENCH_DECOMPRESSED_FILE);
+    }
+
+    remove(BENCH_COMPRESSED_FILE);
+    remove(BENCH_DECOMPRESSED_FILE);
+    return r;
+}
+
+static int bench_file(struct bench_run* run)
+{
+    int r;
+
+    BENCH_MEASURE(run, compress, ccrush_compress_file(BENCH_INPUT_FILE, BENCH_COMPRESSED_FILE, run->buffer_size_kib, run->level));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress_file(BENCH_COMPRESSED_FILE, BENCH_DECOMPRESSED_FILE, run->buffer_size_kib));
+    }
+
+    return bench_finish_file_run(run, r);
+}
+
+static int bench_file_raw(struct bench_run* run)
+{
+    int r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+
+    FILE* input_file = fopen(BENCH_INPUT_FILE, "rb");
+    FILE* output_file = fopen(BENCH_COMPRESSED_FILE, "wb");
+
+    if (input_file != NULL && output_file != NULL)
+    {
+        BENCH_MEASURE(run, compress, ccrush_compress_file_raw(input_file, output_file, run->buffer_size_kib, run->level, 1, 1));
+        input_file = output_file = NULL;
+    }
+
+    if (input_file != NULL)
+    {
+        fclose(input_file);
+    }
+
+    if (output_file != NULL)
+    {
+        fclose(output_file);
+    }
+
+    if (r == 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+
+        input_file = fopen(BENCH_COMPRESSED_FILE, "rb");
+        output_file = fopen(BENCH_DECOMPRESSED_FILE, "wb");
+
+        if (input_file != NULL && output_file != NULL)
+        {
+            BENCH_MEASURE(run, decompress, ccrush_decompress_file_raw(input_file, output_file, run->buffer_size_kib, 1, 1));
+            input_file = output_file = NULL;
+        }
+
+        if (input_file != NULL)
+        {
+            fclose(input_file);
+        }
+
+        if (output_file != NULL)
+        {
+            fclose(output_file);
+        }
+    }
+
+    return bench_finish_file_run(run, r);
+}
+
+static int bench_file_mt(struct bench_run* run)
+{
+    int r;
+
+    BENCH_MEASURE(run, compress, ccrush_compress_file_mt(BENCH_INPUT_FILE, BENCH_COMPRESSED_FILE, run->buffer_size_kib, run->level, run->thread_count));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress_file(BENCH_COMPRESSED_FILE, BENCH_DECOMPRESSED_FILE, run->buffer_size_kib));
+    }
+
+    return bench_finish_file_run(run, r);
+}
+
+static int bench_container(struct bench_run* run)
+{
+    int r;
+
+    BENCH_MEASURE(run, compress, ccrush_compress_container_file(BENCH_INPUT_FILE, BENCH_COMPRESSED_FILE, run->buffer_size_kib, run->level, run->thread_count));
+
+    if (r == 0)
+    {
+        BENCH_MEASURE(run, decompress, ccrush_decompress_container_file(BENCH_COMPRESSED_FILE, BENCH_DECOMPRESSED_FILE, run->thread_count));
+    }
+
+    return bench_finish_file_run(run, r);
+}
+
+struct bench_function
+{
+    const char* name;
+    int uses_buffer_size;
+    int (*run)(struct bench_run* run);
+};
+
+static const struct bench_function bench_functions[] = {
+    { "compress", 1, &bench_compress },
+    { "compress_with_size_header", 1, &bench_compress_with_size_header },
+    { "compress_into", 0, &bench_compress_into },
+    { "ctx", 1, &bench_ctx },
+    { "compress_mt", 1, &bench_compress_mt },
+    { "batch", 1, &bench_batch },
+    { "stream", 1, &bench_stream },
+    { "file", 1, &bench_file },
+    { "file_raw", 1, &bench_file_raw },
+    { "file_mt", 1, &bench_file_mt },
+    { "container", 1, &bench_container },
+};
+
+// ------------------------------------------------------------------------------------------------------------------------------------------
+// Corpora (all generated from a fixed seed)
+
+static uint64_t bench_rng_state = 0;
+
+static inline uint32_t bench_rng()
+{
+    // 64-bit LCG (Knuth's MMIX constants), returning the well mixed upper half.
+    bench_rng_state = bench_rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (uint32_t)(bench_rng_state >> 32);
+}
+
+/* Picks one of n items, skewed towards the first ones (roughly like word frequencies in natural language). */
+static inline uint32_t bench_rng_skewed(const uint32_t n)
+{
+    const uint32_t a = bench_rng() % n;
+    const uint32_t b = bench_rng() % n;
+    return (uint32_t)(((uint64_t)a * b) / n);
+}
+
+static const char* bench_words[] = {
+    "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by", "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had", "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if", "more", "when", "will", "would", "who", "so", "no", "compression", "buffer", "stream", "window", "dictionary", "level", "throughput", "memory", "thread", "file", "output", "input", "block", "deflate", "inflate", "checksum", "algorithm", "performance", "latency", "storage", "network", "message", "record", "payload", "server", "client", "request", "response",
+};
+
+static void bench_generate_text(uint8_t* out, const size_t length)
+{
+    const uint32_t word_count = (uint32_t)(sizeof(bench_words) / sizeof(bench_words[0]));
+
+    size_t offset = 0;
+    uint32_t sentence_length = 0;
+
+    while (offset < length)
+    {
+        char word[64];
+        int n = snprintf(word, sizeof(word), "%s", bench_words[bench_rng_skewed(word_count)]);
+
+        if (sentence_length == 0)
+        {
+            word[0] = (char)(word[0] - 'a' + 'A');
+        }
+
+        if (++sentence_length > 6 + bench_rng() % 14)
+        {
+            n += snprintf(word + n, sizeof(word) - (size_t)n, bench_rng() % 5 ? ". " : ".\n");
+            sentence_length = 0;
+        }
+        else
+        {
+            word[n++] = ' ';
+        }
+
+        const size_t copy = (size_t)n < length - offset ? (size_t)n : length - offset;
+        memcpy(out + offset, word, copy);
+        offset += copy;
+    }
+}
+
+static void bench_generate_json(uint8_t* out, const size_t length)
+{
+    static const char* names[] = { "alice", "bob", "carol", "dave", "erin", "frank", "grace", "heidi" };
+    static const char* statuses[] = { "ok", "error", "pending", "retry" };
+    static const char* regions[] = { "eu-west-1", "eu-central-1", "us-east-1", "us-west-2", "ap-southeast-1" };
+
+    size_t offset = 0;
+
+    while (offset < length)
+    {
+        char record[512];
+
+        const int n = snprintf(record, sizeof(record), "{\"id\":%u,\"timestamp\":\"2025-%02u-%02uT%02u:%02u:%02u.%03uZ\",\"user\":{\"name\":\"%s\",\"email\":\"%s@example.com\"},\"region\":\"%s\",\"status\":\"%s\",\"latency_ms\":%u,\"bytes\":%u,\"cached\":%s}\n", //
+                               bench_rng() % 1000000, 1 + bench_rng() % 12, 1 + bench_rng() % 28, bench_rng() % 24, bench_rng() % 60, bench_rng() % 60, bench_rng() % 1000, //
+                               names[bench_rng_skewed(8)], names[bench_rng_skewed(8)], regions[bench_rng_skewed(5)], statuses[bench_rng_skewed(4)], //
+                               bench_rng() % 5000, bench_rng() % 100000, bench_rng() % 2 ? "true" : "false");
+
+        const size_t copy = (size_t)n < length - offset ? (size_t)n : length - offset;
+        memcpy(out + offset, record, copy);
+        offset += copy;
+    }
+}
+
+static void bench_generate_binary(uint8_t* out, const size_t length)
+{
+    // Sensor-style frames: a constant header, a slowly increasing counter, a few slowly drifting little-endian samples and a noisy byte.
+    uint32_t counter = 0;
+    int32_t samples[6] = { 0 };
+
+    size_t offset = 0;
+
+    while (offset < length)
+    {
+        uint8_t frame[32];
+
+        frame[0] = 0xCC;
+        frame[1] = 0x42;
+        frame[2] = (uint8_t)bench_rng_skewed(4);
+        frame[3] = 0x00;
+
+        counter += 1 + bench_rng_skewed(3);
+        memcpy(frame + 4, &counter, 4);
+
+        for (int i = 0; i < 6; ++i)
+        {
+            samples[i] += (int32_t)(bench_rng() % 7) - 3;
+
+            const int16_t sample = (int16_t)samples[i];
+            memcpy(frame + 8 + (i * 2), &sample, 2);
+        }
+
+        for (int i = 20; i < 31; ++i)
+        {
+            frame[i] = (uint8_t)(i * 3);
+        }
+
+        frame[31] = (uint8_t)bench_rng();
+
+        const size_t copy = sizeof(frame) < length - offset ? sizeof(frame) : length - offset;
+        memcpy(out + offset, frame, copy);
+        offset += copy;
+    }
+}
+
+static void bench_generate_random(uint8_t* out, const size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        out[i] = (uint8_t)bench_rng();
+    }
+}
+
+static void bench_generate_zeros(uint8_t* out, const size_t length)
+{
+    memset(out, 0x00, length);
+}
+
+struct bench_corpus
+{
+    const char* name;
+    void (*generate)(uint8_t* out, size_t length);
+};
+
+static const struct bench_corpus bench_corpora[] = {
+    { "text", &bench_generate_text },
+    { "json", &bench_generate_json },
+    { "binary", &bench_generate_binary },
+    { "random", &bench_generate_random },
+    { "zeros", &bench_generate_zeros },
+};
+
+// ------------------------------------------------------------------------------------------------------------------------------------------
+
+static int bench_parse_list(const char* arg, unsigned long* out, const size_t max_length, size_t* out_length)
+{
+    size_t length = 0;
+    const char* p = arg;
+
+    while (*p != '\0' && length < max_length)
+    {
+        char* end = NULL;
+        out[length++] = strtoul(p, &end, 10);
+
+        if (end == p || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    *out_length = length;
+    return length != 0 ? 0 : -1;
+}
+
+/* Checks whether the passed comma-separated list contains the passed name (a NULL list contains everything). */
+static int bench_list_contains(const char* list, const char* name)
+{
+    if (list == NULL)
+    {
+        return 1;
+    }
+
+    const size_t name_length = strlen(name);
+
+    for (const char* p = list; *p != '\0';)
+    {
+        const char* end = strchr(p, ',');
+        const size_t length = end != NULL ? (size_t)(end - p) : strlen(p);
+
+        if (length == name_length && strncmp(p, name, length) == 0)
+        {
+            return 1;
+        }
+
+        p += length + (end != NULL ? 1 : 0);
+    }
+
+    return 0;
+}
+
+static int bench_write_input_file(const uint8_t* data, const size_t data_length)
+{
+    FILE* file = fopen(BENCH_INPUT_FILE, "wb");
+    if (file == NULL)
+    {
+        return -1;
+    }
+
+    const int r = fwrite(data, 1, data_length, file) == data_length ? 0 : -1;
+    return fclose(file) == 0 ? r : -1;
+}
+
+int main(const int argc, char* argv[])
+{
+    unsigned long size_kib = 1024;
+    unsigned long iterations = 3;
+    uint32_t thread_count = 0;
+
+    unsigned long levels[BENCH_MAX_LIST_LENGTH] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+    size_t level_count = 10;
+
+    unsigned long buffer_sizes[BENCH_MAX_LIST_LENGTH] = { 16, 64, 256, 1024 };
+    size_t buffer_size_count = 4;
+
+    unsigned long scrub_settings[BENCH_MAX_LIST_LENGTH] = { 1, 0 };
+    size_t scrub_setting_count = 2;
+
+    const char* corpora = NULL;
+    const char* functions = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* arg = argv[i];
+        const char* value = i < argc - 1 ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
+        {
+            fprintf(stdout, HELP_TEXT, CCRUSH_VERSION_STR, BENCH_BACKEND);
+            return EXIT_SUCCESS;
+        }
+
+        if (strcmp(arg, "--pipelined-io") == 0)
+        {
+            ccrush_set_pipelined_io(1);
+            continue;
+        }
+
+        if (strcmp(arg, "--no-scrub") == 0)
+        {
+            scrub_settings[0] = 0;
+            scrub_setting_count = 1;
+            continue;
+        }
+
+        int invalid = value == NULL;
+
+        if (!invalid && strcmp(arg, "--size") == 0)
+        {
+            size_kib = strtoul(value, NULL, 10);
+            invalid = size_kib == 0;
+        }
+        else if (!invalid && strcmp(arg, "--iterations") == 0)
+        {
+            iterations = strtoul(value, NULL, 10);
+            invalid = iterations == 0;
+        }
+        else if (!invalid && strcmp(arg, "--threads") == 0)
+        {
+            thread_count = (uint32_t)strtoul(value, NULL, 10);
+        }
+        else if (!invalid && strcmp(arg, "--levels") == 0)
+        {
+            invalid = bench_parse_list(value, levels, BENCH_MAX_LIST_LENGTH, &level_count) != 0;
+        }
+        else if (!invalid && strcmp(arg, "--buffer-sizes") == 0)
+        {
+            invalid = bench_parse_list(value, buffer_sizes, BENCH_MAX_LIST_LENGTH, &buffer_size_count) != 0;
+        }
+        else if (!invalid && strcmp(arg, "--scrub") == 0)
+        {
+            invalid = bench_parse_list(value, scrub_settings, BENCH_MAX_LIST_LENGTH, &scrub_setting_count) != 0;
+        }
+        else if (!invalid && strcmp(arg, "--corpora") == 0)
+        {
+            corpora = value;
+        }
+        else if (!invalid && strcmp(arg, "--functions") == 0)
+        {
+            functions = value;
+        }
+        else
+        {
+            invalid = 1;
+        }
+
+        if (invalid)
+        {
+            fprintf(stderr, "Invalid or incomplete argument \"%s\" (see \"--help\").\n", arg);
+            return CCRUSH_ERROR_INVALID_ARGS;
+        }
+
+        ++i;
+    }
+
+    const size_t data_length = (size_t)size_kib * 1024;
+
+    uint8_t* data = malloc(data_length);
+    if (data == NULL)
+    {
+        fprintf(stderr, "Out of memory.\n");
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    ccrush_set_allocator(&bench_alloc, &bench_free, NULL);
+
+    fprintf(stderr, "ccrush_bench: ccrush v%s, %s, %lu KiB per corpus, %lu iteration(s) per run\n", CCRUSH_VERSION_STR, BENCH_BACKEND, size_kib, iterations);
+    fprintf(stdout, "backend\tfunction\tcorpus\tlevel\tbuffer_kib\tscrub\tinput_bytes\toutput_bytes\tratio\tcompress_mb_s\tdecompress_mb_s\tcompress_allocs\tdecompress_allocs\tcompress_peak_heap_kib\tdecompress_peak_heap_kib\tpeak_rss_kib\n");
+
+    int r = 0;
+
+    for (size_t c = 0; c < sizeof(bench_corpora) / sizeof(bench_corpora[0]); ++c)
+    {
+        const struct bench_corpus* corpus = &bench_corpora[c];
+
+        if (!bench_list_contains(corpora, corpus->name))
+        {
+            continue;
+        }
+
+        // Every corpus starts from the same seed, no matter which other corpora were selected.
+        bench_rng_state = 0x9E3779B97F4A7C15ULL ^ (uint64_t)c;
+        corpus->generate(data, data_length);
+
+        if (bench_write_input_file(data, data_length) != 0)
+        {
+            fprintf(stderr, "Failed to write the temporary input file \"%s\".\n", BENCH_INPUT_FILE);
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+
+        for (size_t f = 0; f < sizeof(bench_functions) / sizeof(bench_functions[0]); ++f)
+        {
+            const struct bench_function* function = &bench_functions[f];
+
+            if (!bench_list_contains(functions, function->name))
+            {
+                continue;
+            }
+
+            for (size_t l = 0; l < level_count; ++l)
+            {
+                for (size_t b = 0; b < (function->uses_buffer_size ? buffer_size_count : 1); ++b)
+                {
+                    for (size_t sc = 0; sc < scrub_setting_count; ++sc)
+                    {
+                        const int scrub = scrub_settings[sc] != 0;
+                        ccrush_set_scrub_buffers(scrub);
+
+                        struct bench_run best = { 0 };
+
+                        const int rss_reset = bench_reset_peak_rss() == 0;
+
+                        for (unsigned long i = 0; i < iterations; ++i)
+                        {
+                            struct bench_run run = { 0 };
+                            run.data = data;
+                            run.data_length = data_length;
+                            run.level = (int)levels[l];
+                            run.buffer_size_kib = function->uses_buffer_size ? (uint32_t)buffer_sizes[b] : 0;
+                            run.thread_count = thread_count;
+
+                            const int run_r = function->run(&run);
+                            if (run_r != 0)
+                            {
+                                fprintf(stderr, "%s failed on the %s corpus (level %d, buffer size %u KiB): %d\n", function->name, corpus->name, run.level, run.buffer_size_kib, run_r);
+                                r = run_r;
+                                goto exit;
+                            }
+
+                            if (i == 0)
+                            {
+                                best = run;
+                                continue;
+                            }
+
+                            best.compress.ns = run.compress.ns < best.compress.ns ? run.compress.ns : best.compress.ns;
+                            best.decompress.ns = run.decompress.ns < best.decompress.ns ? run.decompress.ns : best.decompress.ns;
+                        }
+
+                        char peak_rss_kib[32] = "n/a";
+                        const long long peak_rss = rss_reset ? bench_peak_rss_kib() : -1;
+
+                        if (peak_rss >= 0)
+                        {
+                            snprintf(peak_rss_kib, sizeof(peak_rss_kib), "%lld", peak_rss);
+                        }
+
+                        const double compress_mb_s = (double)data_length / 1e6 / ((double)(best.compress.ns ? best.compress.ns : 1) / 1e9);
+                        const double decompress_mb_s = (double)data_length / 1e6 / ((double)(best.decompress.ns ? best.decompress.ns : 1) / 1e9);
+
+                        fprintf(stdout, "%s\t%s\t%s\t%d\t%u\t%d\t%zu\t%zu\t%.4f\t%.2f\t%.2f\t%llu\t%llu\t%llu\t%llu\t%s\n", //
+                                BENCH_BACKEND, function->name, corpus->name, best.level, best.buffer_size_kib, scrub, data_length, best.compressed_length, //
+                                (double)data_length / (double)(best.compressed_length ? best.compressed_length : 1), compress_mb_s, decompress_mb_s, //
+                                (unsigned long long)best.compress.allocs, (unsigned long long)best.decompress.allocs, //
+                                (unsigned long long)(best.compress.peak_heap_bytes / 1024), (unsigned long long)(best.decompress.peak_heap_bytes / 1024), //
+                                peak_rss_kib);
+
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+
+exit:
+    remove(BENCH_INPUT_FILE);
+    remove(BENCH_COMPRESSED_FILE);
+    remove(BENCH_DECOMPRESSED_FILE);
+
+    free(data);
+    return r;
+}
@@ -79,6 +79,13 @@ extern "C" {
 #define CCRUSH_DEFAULT_CHUNKSIZE (1024 * 256)
 #endif
 
+#ifndef CCRUSH_MAX_THREAD_COUNT
+/**
+ * Maximum amount of worker threads that the multithreaded ccrush functions will spawn.
+ */
+#define CCRUSH_MAX_THREAD_COUNT 256
+#endif
+
 /**
  * Error code for <c>NULL</c>, invalid, out-of-range or simply just wrong arguments.
  */
@@ -94,11 +101,126 @@ extern "C" {
  */
 #define CCRUSH_ERROR_FILE_ACCESS_FAILED 1002
 
+/**
+ * Error code for when the output buffer that was passed into ccrush_compress_into() or ccrush_decompress_into() is too small to hold the result.
+ */
+#define CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL 1003
+
+/**
+ * Error code returned by ccrush_get_decompressed_size() when the passed data doesn't start with a ccrush size header (see ccrush_compress_with_size_header()).
+ */
+#define CCRUSH_ERROR_NO_SIZE_HEADER 1004
+
+/**
+ * Error code for when a random-access index (see ccrush_index_build()) is corrupt, or doesn't belong to the compressed file it's used with.
+ */
+#define CCRUSH_ERROR_INVALID_INDEX 1005
+
+/**
+ * Error code for when the data to decompress was compressed using a preset dictionary, but none was passed (see ccrush_decompress_with_dictionary()).
+ */
+#define CCRUSH_ERROR_DICTIONARY_REQUIRED 1006
+
+/**
+ * Error code for when the data to decompress was compressed using a different preset dictionary than the one that was passed (the dictionary IDs don't match).
+ */
+#define CCRUSH_ERROR_DICTIONARY_MISMATCH 1007
+
 /**
  * Error code for OOM scenarios. Uh oh...
  */
 #define CCRUSH_ERROR_OUT_OF_MEMORY 2000
 
+/**
+ * Magic bytes that mark the start of a size header (as written by ccrush_compress_with_size_header()). <p>
+ * A zlib stream can never start with these: its first byte always has a low nibble of 8 (the deflate compression method), whereas <c>'C'</c> is <c>0x43</c>.
+ */
+#define CCRUSH_SIZE_HEADER_MAGIC "CCRS"
+
+/**
+ * Total length of a size header in bytes: the 4 magic bytes #CCRUSH_SIZE_HEADER_MAGIC followed by the uncompressed data length as a 64-bit little-endian unsigned integer.
+ */
+#define CCRUSH_SIZE_HEADER_LENGTH 12
+
+#ifndef CCRUSH_DEFAULT_INDEX_SPAN_KiB
+/**
+ * Default distance (in KiB of uncompressed data) between two checkpoints of a random-access index (see ccrush_index_build()).
+ */
+#define CCRUSH_DEFAULT_INDEX_SPAN_KiB 1024
+#endif
+
+/**
+ * Magic bytes at the start of a saved random-access index file (see ccrush_index_save()).
+ */
+#define CCRUSH_INDEX_MAGIC "CCRI"
+
+#ifndef CCRUSH_DEFAULT_CONTAINER_BLOCK_SIZE_KiB
+/**
+ * Default (uncompressed) size in KiB of the independently compressed blocks of a block container (see ccrush_compress_container_file_raw()).
+ */
+#define CCRUSH_DEFAULT_CONTAINER_BLOCK_SIZE_KiB 1024
+#endif
+
+/**
+ * Magic bytes at the start (and the very end) of a block container file (see ccrush_compress_container_file_raw()).
+ */
+#define CCRUSH_CONTAINER_MAGIC "CCRB"
+
+/**
+ * Maximum size of a preset dictionary that deflate can make use of (its window size). Dictionaries are trained up to this size (see ccrush_train_dictionary()).
+ */
+#define CCRUSH_MAX_DICTIONARY_SIZE (1024 * 32)
+
+/**
+ * Stream mode for ccrush_stream_init(): compress (deflate) whatever is fed into the stream.
+ */
+#define CCRUSH_STREAM_MODE_COMPRESS 0
+
+/**
+ * Stream mode for ccrush_stream_init(): decompress (inflate) whatever is fed into the stream.
+ */
+#define CCRUSH_STREAM_MODE_DECOMPRESS 1
+
+/**
+ * Compression strategy for ccrush_params: zlib's default (<c>Z_DEFAULT_STRATEGY</c>). The right choice for most data.
+ */
+#define CCRUSH_STRATEGY_DEFAULT 0
+
+/**
+ * Compression strategy for ccrush_params: <c>Z_FILTERED</c>. Favors Huffman coding over string matching, for data produced by a filter (or predictor) that consists of small, somewhat random values.
+ */
+#define CCRUSH_STRATEGY_FILTERED 1
+
+/**
+ * Compression strategy for ccrush_params: <c>Z_HUFFMAN_ONLY</c>. No string matching at all, only Huffman coding: very fast, and all that's worth doing on near-random data (e.g. noisy sensor samples).
+ */
+#define CCRUSH_STRATEGY_HUFFMAN_ONLY 2
+
+/**
+ * Compression strategy for ccrush_params: <c>Z_RLE</c>. Only matches runs of the same byte (distance 1): almost as fast as #CCRUSH_STRATEGY_HUFFMAN_ONLY, and nearly as good as the default strategy on bitmaps and other run-heavy data.
+ */
+#define CCRUSH_STRATEGY_RLE 3
+
+/**
+ * Compression strategy for ccrush_params: <c>Z_FIXED</c>. Never emits dynamic Huffman trees, which saves their overhead on very small payloads.
+ */
+#define CCRUSH_STRATEGY_FIXED 4
+
+/**
+ * Header type for ccrush_params: a zlib stream (RFC 1950). This is what all of the functions without a ccrush_params argument produce and expect.
+ */
+#define CCRUSH_HEADER_ZLIB 0
+
+/**
+ * Header type for ccrush_params: a gzip stream (RFC 1952), as produced and understood by the <c>gzip</c> tool. Can't be combined with a preset dictionary.
+ */
+#define CCRUSH_HEADER_GZIP 1
+
+/**
+ * Header type for ccrush_params: raw deflate data (RFC 1951) without any header or checksum (e.g. for ZIP entries or your own framing).
+ */
+#define CCRUSH_HEADER_RAW 2
+
 /**
  * Pick the lower of two numbers.
  */
@@ -116,11 +238,38 @@ extern "C" {
 #define CCRUSH_MAX_WIN_FILEPATH_LENGTH (1024 * 32)
 #endif
 
+/**
+ * Allocation function signature for ccrush_set_allocator() and ccrush_ctx_new_ex().
+ * @param user The \p user pointer that was passed into ccrush_set_allocator() or ccrush_ctx_new_ex().
+ * @param size How many bytes to allocate.
+ * @return The allocated memory, or <c>NULL</c> if the allocation failed.
+ */
+typedef void* (*ccrush_alloc_function)(void* user, size_t size);
+
+/**
+ * Deallocation function signature for ccrush_set_allocator() and ccrush_ctx_new_ex().
+ * @param user The \p user pointer that was passed into ccrush_set_allocator() or ccrush_ctx_new_ex().
+ * @param mem The memory to free (never <c>NULL</c>).
+ */
+typedef void (*ccrush_free_function)(void* user, void* mem);
+
+/**
+ * Routes all of ccrush's heap allocations through the passed functions: I/O buffers, output buffers (including the ones returned to you), growable buffers, worker thread bookkeeping and zlib's internal state (via <c>z_stream.zalloc</c>/<c>zfree</c>). <p>
+ * This is a process-wide setting: call it once at startup, before anything is allocated (no ccrush_ctx, thread cache or output buffer may outlive the allocator that allocated it).
+ * It's also just the default: contexts created using ccrush_ctx_new_ex() can bring their own allocator instead. <p>
+ * Outputs allocated by ccrush need to be freed using ccrush_free() when a custom allocator is in use. Note also that custom allocators can't shrink memory: outputs are then left at their worst-case capacity (see ccrush_compress_bound()).
+ * @param alloc_function The allocation function. Pass <c>NULL</c> (for both functions) to restore the default <c>malloc()</c>/<c>free()</c>.
+ * @param free_function The deallocation function.
+ * @param user Opaque pointer that is passed through to \p alloc_function and \p free_function (e.g. your arena).
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if only one of the two functions was passed.
+ */
+CCRUSH_API int ccrush_set_allocator(ccrush_alloc_function alloc_function, ccrush_free_function free_function, void* user);
+
 /**
  * Compresses an array of bytes using deflate.
  * @param data The data to compress.
  * @param data_length Length of the \p data array (how many bytes to compress).
- * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE. Especially <c>inflate()</c> profits from a relatively large buffer a.k.a. "chunk" size. A 256KiB buffer works great :)
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE. Since the data is deflated straight into a buffer of size ccrush_compress_bound() (which is shrunk to fit afterwards), this is only validated here and otherwise kept for API compatibility.
  * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
  * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller.
  * @param out_length Where to write the output array's length into.
@@ -128,6 +277,82 @@ extern "C" {
  */
 CCRUSH_API int ccrush_compress(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, int level, uint8_t** out, size_t* out_length);
 
+/**
+ * Compresses an array of bytes using deflate, and prepends a small header (#CCRUSH_SIZE_HEADER_LENGTH bytes) that records the uncompressed length. <p>
+ * ccrush_decompress() recognizes that header automatically and uses it to allocate its output exactly once (with the exact right size) and inflate straight into it,
+ * instead of having to guess the output size and grow its buffer as it goes. Data without the header keeps decompressing like before. <p>
+ * Note that the output is no longer a plain zlib stream: only ccrush can decompress it (or whoever strips the first #CCRUSH_SIZE_HEADER_LENGTH bytes first).
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param buffer_size_kib Same as in ccrush_compress(): only validated and otherwise kept for API symmetry.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_with_size_header(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, int level, uint8_t** out, size_t* out_length);
+
+/**
+ * Reads the uncompressed length out of the size header of data that was compressed using ccrush_compress_with_size_header(). <p>
+ * Useful for sizing the output buffer passed into ccrush_decompress_into().
+ * @param data The compressed data.
+ * @param data_length Length of the \p data array.
+ * @param out_decompressed_size Where to write the uncompressed length into.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_NO_SIZE_HEADER if \p data doesn't start with a size header.
+ */
+CCRUSH_API int ccrush_get_decompressed_size(const uint8_t* data, size_t data_length, uint64_t* out_decompressed_size);
+
+/**
+ * Compresses an array of bytes using deflate on multiple threads. <p>
+ * The input is sliced into (up to) one slice per thread, the slices are deflated concurrently straight out of \p data
+ * (each one primed with the preceding 32 KiB as a preset dictionary), and the results are joined into one single, standard zlib stream
+ * with a combined Adler-32 checksum: ccrush_decompress() (or any other inflater) can decompress it as usual. <p>
+ * Inputs that are too small to be worth splitting up (less than 256 KiB or so) are simply passed on to ccrush_compress().
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param buffer_size_kib The buffer size to use (in KiB) in case the input is too small to be split up and ccrush_compress() is used instead. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
+ * @param thread_count How many threads to use. Pass <c>0</c> to use as many threads as there are CPU cores available. Capped at #CCRUSH_MAX_THREAD_COUNT.
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_mt(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, int level, uint32_t thread_count, uint8_t** out, size_t* out_length);
+
+/**
+ * Gets the maximum amount of bytes that compressing \p data_length bytes with ccrush_compress_into() can possibly produce (the worst case for incompressible data). <p>
+ * An output buffer of this size is always big enough.
+ * @param data_length How many bytes you want to compress.
+ * @return The upper bound for the compressed size of \p data_length bytes.
+ */
+CCRUSH_API size_t ccrush_compress_bound(size_t data_length);
+
+/**
+ * Compresses an array of bytes using deflate, writing the result directly into an output buffer that you own (no heap allocations for the output at all).
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
+ * @param out The output buffer to write the compressed data into. Use ccrush_compress_bound() to find out how big it needs to be in the worst case.
+ * @param out_capacity Size of the \p out buffer (in bytes).
+ * @param out_written Where to write the amount of bytes that were written into \p out.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL if \p out was too small to hold the compressed data; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_compress_into(const uint8_t* data, size_t data_length, int level, uint8_t* out, size_t out_capacity, size_t* out_written);
+
+/**
+ * Estimates how big the output of ccrush_compress() for a given array of bytes would be, without compressing all of it. <p>
+ * Only about 2% of the input is compressed: samples spread evenly across the data (each one primed with the data in front of it), which makes this cost a small fraction of the full compression
+ * and lets you decide per input whether compressing it is worth it at all (the estimated ratio is <c>out_estimated_length / data_length</c>). <p>
+ * Inputs smaller than 96 KiB are too small to sample meaningfully: those get a (much rougher, but even cheaper) estimate from their byte entropy instead, with a margin of about a third of the input.
+ * @param data The data whose compressed size you want to estimate.
+ * @param data_length Length of the \p data array.
+ * @param level The level of compression <c>[0-9]</c> that you'd compress the data with (out of range values mean <c>6</c>, just like in ccrush_compress()).
+ * @param out_estimated_length Where to write the estimated compressed size into.
+ * @param out_margin [OPTIONAL] Where to write the confidence margin into: the actual compressed size lies within <c>out_estimated_length ± out_margin</c> with a probability of roughly 95%. Pass <c>NULL</c> if you don't need it.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_estimate_ratio(const uint8_t* data, size_t data_length, int level, size_t* out_estimated_length, size_t* out_margin);
+
 /**
  * Compresses a given file and writes it into the passed output file path.
  * @param input_file_path The file to compress. Must be UTF-8 encoded! Must be NUL-terminated!
@@ -151,7 +376,69 @@ CCRUSH_API int ccrush_compress_file(const char* input_file_path, const char* out
 CCRUSH_API int ccrush_compress_file_raw(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, int close_input_file, int close_output_file);
 
 /**
- * Decompresses a given set of deflated data using inflate.
+ * Compresses a given file and writes it into the passed output file path, using multiple threads (pigz-style). <p>
+ * The output is one single, standard zlib stream that can be decompressed using ccrush_decompress_file() or any other inflater.
+ * @param input_file_path The file to compress. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @param output_file_path The output file path where the compressed file should be written to. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @param buffer_size_kib The size of the blocks (in KiB) that are distributed across the worker threads. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE. Values below 32 KiB are rounded up to 32 KiB (the size of deflate's sliding window).
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
+ * @param thread_count How many threads to use. Pass <c>0</c> to use as many threads as there are CPU cores available. Capped at #CCRUSH_MAX_THREAD_COUNT.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_file_mt(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, int level, uint32_t thread_count);
+
+/**
+ * Compresses many independent records in one call, spreading them across multiple threads. <p>
+ * Every record becomes its own standard zlib stream (exactly what ccrush_compress() would produce for it), but they all end up in one single output arena:
+ * record \p i is located at <c>(*out + out_offsets[i])</c> and is <c>(out_offsets[i + 1] - out_offsets[i])</c> bytes long. <p>
+ * Each thread reuses one z_stream for all of its records, and the whole batch makes one output allocation instead of one per record.
+ * Small batches (less than 64 KiB of input or so) are compressed on the calling thread alone.
+ * @param inputs Array of \p count records to compress.
+ * @param input_lengths Array of \p count record lengths (none of them may be <c>0</c>).
+ * @param count How many records there are.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
+ * @param thread_count How many threads to use. Pass <c>0</c> to use as many threads as there are CPU cores available. Capped at #CCRUSH_MAX_THREAD_COUNT.
+ * @param out Pointer to the output arena. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller.
+ * @param out_length Where to write the output arena's total length into.
+ * @param out_offsets Array of (at least) <c>count + 1</c> entries into which to write the records' offsets within the output arena. The last entry is the arena's total length.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_batch(const uint8_t* const* inputs, const size_t* input_lengths, size_t count, int level, uint32_t thread_count, uint8_t** out, size_t* out_length, size_t* out_offsets);
+
+/**
+ * Decompresses many independent records (zlib streams, such as those produced by ccrush_compress_batch()) in one call, spreading them across multiple threads. <p>
+ * The decompressed records all end up in one single output arena: record \p i is located at <c>(*out + out_offsets[i])</c> and is <c>(out_offsets[i + 1] - out_offsets[i])</c> bytes long.
+ * @param inputs Array of \p count compressed records. To decompress the output of ccrush_compress_batch(), pass pointers into its arena (at the offsets it returned).
+ * @param input_lengths Array of \p count compressed record lengths (none of them may be <c>0</c>).
+ * @param count How many records there are.
+ * @param buffer_size_kib The underlying buffer size that each thread uses (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param thread_count How many threads to use. Pass <c>0</c> to use as many threads as there are CPU cores available. Capped at #CCRUSH_MAX_THREAD_COUNT.
+ * @param out Pointer to the output arena. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller. NUL-terminated.
+ * @param out_length Where to write the output arena's total length into.
+ * @param out_offsets Array of (at least) <c>count + 1</c> entries into which to write the decompressed records' offsets within the output arena. The last entry is the arena's total length.
+ * @return <c>0</c> on success; non-zero error codes if something fails (if any one record fails to decompress, the whole batch fails).
+ */
+CCRUSH_API int ccrush_decompress_batch(const uint8_t* const* inputs, const size_t* input_lengths, size_t count, uint32_t buffer_size_kib, uint32_t thread_count, uint8_t** out, size_t* out_length, size_t* out_offsets);
+
+/**
+ * Compresses a given file and writes it into the passed output file, using multiple threads (pigz-style). <p>
+ * The input is split into fixed-size blocks that are deflated concurrently (each one primed with the previous block's last 32 KiB as a preset dictionary),
+ * and then stitched back together into one single, standard zlib stream that can be decompressed using ccrush_decompress_file_raw() or any other inflater.
+ * @param input_file The file to compress. Standard IO file handle (FILE*)
+ * @param output_file The output file handle into which to write the compressed file. Standard IO file handle (FILE*)
+ * @param buffer_size_kib The size of the blocks (in KiB) that are distributed across the worker threads. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE. Values below 32 KiB are rounded up to 32 KiB (the size of deflate's sliding window).
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used! <c>0</c> does not compress at all...
+ * @param thread_count How many threads to use. Pass <c>0</c> to use as many threads as there are CPU cores available. Capped at #CCRUSH_MAX_THREAD_COUNT. Passing <c>1</c> is equivalent to calling ccrush_compress_file_raw().
+ * @param close_input_file Should the input file handle be <c>fclose</c>'d after usage? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be <c>fclose</c>'d after usage? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_file_raw_mt(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, uint32_t thread_count, int close_input_file, int close_output_file);
+
+/**
+ * Decompresses a given set of deflated data using inflate. <p>
+ * If the data was compressed using ccrush_compress_with_size_header(), the output is allocated exactly once using the recorded size.
+ * Otherwise, its size is guessed and the output buffer grows as needed.
  * @param data The compressed bytes to decompress.
  * @param data_length Length of the \p data array.
  * @param buffer_size_kib The underlying buffer size to use (in KiB). If available, a buffer size of 256KiB or more is recommended. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
@@ -161,6 +448,18 @@ CCRUSH_API int ccrush_compress_file_raw(FILE* input_file, FILE* output_file, uin
  */
 CCRUSH_API int ccrush_decompress(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, uint8_t** out, size_t* out_length);
 
+/**
+ * Decompresses a given set of deflated data using inflate, writing the result directly into an output buffer that you own (no heap allocations for the output at all). <p>
+ * Data compressed using ccrush_compress_with_size_header() is recognized automatically (see ccrush_get_decompressed_size() for sizing \p out).
+ * @param data The compressed bytes to decompress.
+ * @param data_length Length of the \p data array.
+ * @param out The output buffer to write the decompressed data into.
+ * @param out_capacity Size of the \p out buffer (in bytes).
+ * @param out_written Where to write the amount of bytes that were written into \p out.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL if \p out was too small to hold the decompressed data; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_into(const uint8_t* data, size_t data_length, uint8_t* out, size_t out_capacity, size_t* out_written);
+
 /**
  * Decompresses a given file and writes it into the passed output file path.
  * @param input_file_path The file to decompress. Must be UTF-8 encoded! Must be NUL-terminated!
@@ -182,7 +481,737 @@ CCRUSH_API int ccrush_decompress_file(const char* input_file_path, const char* o
 CCRUSH_API int ccrush_decompress_file_raw(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int close_input_file, int close_output_file);
 
 /**
- * Wrapper around <c>free()</c> (mostly useful for C# interop).
+ * Same as ccrush_compress(), but priming deflate with a preset dictionary: data that the dictionary contains can be back-referenced right from the first byte on. <p>
+ * This makes a huge difference for small payloads (a few hundred bytes of JSON, for instance), that otherwise barely compress at all because deflate starts out with an empty window.
+ * A good dictionary is a concatenation of strings that are common in such payloads, with the most frequent ones at the end (only the last 32 KiB are used). <p>
+ * The dictionary's ID (its Adler-32 checksum) is stored in the output's zlib header: the exact same dictionary must be passed to ccrush_decompress_with_dictionary() for decompression.
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+ * @param dictionary The preset dictionary. Pass <c>NULL</c> (and a \p dictionary_length of <c>0</c>) to compress without one.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_with_dictionary(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, int level, const uint8_t* dictionary, size_t dictionary_length, uint8_t** out, size_t* out_length);
+
+/**
+ * Decompresses data that was compressed with a preset dictionary (see ccrush_compress_with_dictionary()). Data that was compressed without one decompresses just fine, too.
+ * @param data The compressed data.
+ * @param data_length Length of the \p data array.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param dictionary The preset dictionary that the data was compressed with.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller. NUL-terminated.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_DICTIONARY_REQUIRED if the data needs a dictionary but none was passed; #CCRUSH_ERROR_DICTIONARY_MISMATCH if it was compressed with a different dictionary; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_with_dictionary(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, const uint8_t* dictionary, size_t dictionary_length, uint8_t** out, size_t* out_length);
+
+/**
+ * Same as ccrush_compress_file(), but using a preset dictionary (see ccrush_compress_with_dictionary()).
+ * @param input_file_path The input file to compress.
+ * @param output_file_path The output file into which to write the compressed result.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+ * @param dictionary The preset dictionary. Pass <c>NULL</c> (and a \p dictionary_length of <c>0</c>) to compress without one.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_file_with_dictionary(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, int level, const uint8_t* dictionary, size_t dictionary_length);
+
+/**
+ * Same as ccrush_compress_file_raw(), but using a preset dictionary (see ccrush_compress_with_dictionary()).
+ * @param input_file The input file to compress. Standard IO file handle (FILE*)
+ * @param output_file The output file into which to write the compressed result. Standard IO file handle (FILE*)
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+ * @param dictionary The preset dictionary. Pass <c>NULL</c> (and a \p dictionary_length of <c>0</c>) to compress without one.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @param close_input_file Should the input file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_file_raw_with_dictionary(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, const uint8_t* dictionary, size_t dictionary_length, int close_input_file, int close_output_file);
+
+/**
+ * Same as ccrush_decompress_file(), but for files that were compressed with a preset dictionary (see ccrush_compress_with_dictionary()).
+ * @param input_file_path The file to decompress.
+ * @param output_file_path The output file into which to write the decompressed result.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param dictionary The preset dictionary that the file was compressed with.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @return <c>0</c> on success; #CCRUSH_ERROR_DICTIONARY_REQUIRED or #CCRUSH_ERROR_DICTIONARY_MISMATCH if the dictionary is missing or wrong; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_file_with_dictionary(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, const uint8_t* dictionary, size_t dictionary_length);
+
+/**
+ * Same as ccrush_decompress_file_raw(), but for files that were compressed with a preset dictionary (see ccrush_compress_with_dictionary()).
+ * @param input_file The file to decompress. Standard IO file handle (FILE*)
+ * @param output_file The output file handle into which to write the decompressed file. Standard IO file handle (FILE*)
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param dictionary The preset dictionary that the file was compressed with.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @param close_input_file Should the input file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; #CCRUSH_ERROR_DICTIONARY_REQUIRED or #CCRUSH_ERROR_DICTIONARY_MISMATCH if the dictionary is missing or wrong; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_file_raw_with_dictionary(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const uint8_t* dictionary, size_t dictionary_length, int close_input_file, int close_output_file);
+
+/**
+ * Compression profile for the <c>_ex</c> functions: everything that zlib's <c>deflateInit2()</c> lets you tune. <p>
+ * Start out from #CCRUSH_PARAMS_DEFAULT and only change what you need. Decompression only looks at \p window_bits and \p header, which must match what the data was compressed with
+ * (a larger window works too: passing <c>0</c> always does).
+ */
+typedef struct ccrush_params
+{
+    /**
+     * The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). If this is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+     */
+    int level;
+
+    /**
+     * One of the <c>CCRUSH_STRATEGY_*</c> constants, e.g. #CCRUSH_STRATEGY_RLE.
+     */
+    int strategy;
+
+    /**
+     * Base two logarithm of the window size <c>[9-15]</c>: smaller windows need less memory (on both ends) but find fewer matches. Pass <c>0</c> for the default (<c>15</c>, i.e. 32 KiB).
+     */
+    int window_bits;
+
+    /**
+     * How much memory deflate may use for its internal state <c>[1-9]</c>: less memory is slower and compresses worse. Pass <c>0</c> for the default (<c>8</c>, i.e. about 256 KiB with the default window).
+     */
+    int mem_level;
+
+    /**
+     * One of #CCRUSH_HEADER_ZLIB, #CCRUSH_HEADER_GZIP or #CCRUSH_HEADER_RAW. Size headers (see ccrush_compress_with_size_header()) are only recognized in zlib streams.
+     */
+    int header;
+} ccrush_params;
+
+/**
+ * Initializer for a ccrush_params struct that matches what all of the functions without one use (at level <c>6</c>).
+ */
+#define CCRUSH_PARAMS_DEFAULT { 6, CCRUSH_STRATEGY_DEFAULT, 15, 8, CCRUSH_HEADER_ZLIB }
+
+/**
+ * Same as ccrush_compress_bound(), but for data that's compressed using the passed \p params (non-default window sizes and memory levels have a larger worst case).
+ * @param data_length How many bytes you want to compress.
+ * @param params The compression profile. Pass <c>NULL</c> for the defaults.
+ * @return The upper bound for the compressed size of \p data_length bytes.
+ */
+CCRUSH_API size_t ccrush_compress_bound_ex(size_t data_length, const ccrush_params* params);
+
+/**
+ * Same as ccrush_compress(), but using a custom compression profile.
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param params The compression profile (level, strategy, window size, memory level and header type).
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if \p params is <c>NULL</c> or holds out-of-range values; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_compress_ex(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, const ccrush_params* params, uint8_t** out, size_t* out_length);
+
+/**
+ * Same as ccrush_compress_into(), but using a custom compression profile.
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param params The compression profile (level, strategy, window size, memory level and header type).
+ * @param out The output buffer to write the compressed data into. Use ccrush_compress_bound_ex() to find out how big it needs to be in the worst case.
+ * @param out_capacity Size of the \p out buffer (in bytes).
+ * @param out_written Where to write the amount of bytes that were written into \p out.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL if \p out was too small to hold the compressed data; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_compress_into_ex(const uint8_t* data, size_t data_length, const ccrush_params* params, uint8_t* out, size_t out_capacity, size_t* out_written);
+
+/**
+ * Same as ccrush_compress_file(), but using a custom compression profile.
+ * @param input_file_path The input file to compress.
+ * @param output_file_path The output file into which to write the compressed result.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param params The compression profile (level, strategy, window size, memory level and header type).
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_file_ex(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, const ccrush_params* params);
+
+/**
+ * Same as ccrush_compress_file_raw(), but using a custom compression profile.
+ * @param input_file The input file to compress. Standard IO file handle (FILE*)
+ * @param output_file The output file into which to write the compressed result. Standard IO file handle (FILE*)
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param params The compression profile (level, strategy, window size, memory level and header type).
+ * @param close_input_file Should the input file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_file_raw_ex(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const ccrush_params* params, int close_input_file, int close_output_file);
+
+/**
+ * Same as ccrush_decompress(), but for data that was compressed with ccrush_compress_ex() (or anything else that produces gzip or raw deflate data).
+ * @param data The compressed data.
+ * @param data_length Length of the \p data array.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param params The profile that the data was compressed with (only its \p window_bits and \p header are used).
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success: if something failed, this is left untouched! Needs to be freed manually by the caller. NUL-terminated.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_decompress_ex(const uint8_t* data, size_t data_length, uint32_t buffer_size_kib, const ccrush_params* params, uint8_t** out, size_t* out_length);
+
+/**
+ * Same as ccrush_decompress_into(), but for data that was compressed with a custom compression profile.
+ * @param data The compressed data.
+ * @param data_length Length of the \p data array.
+ * @param params The profile that the data was compressed with (only its \p window_bits and \p header are used).
+ * @param out The output buffer to write the decompressed data into.
+ * @param out_capacity Size of the \p out buffer (in bytes).
+ * @param out_written Where to write the amount of bytes that were written into \p out.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL if \p out was too small to hold the decompressed data; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_into_ex(const uint8_t* data, size_t data_length, const ccrush_params* params, uint8_t* out, size_t out_capacity, size_t* out_written);
+
+/**
+ * Same as ccrush_decompress_file(), but for files that were compressed with a custom compression profile (e.g. <c>.gz</c> files).
+ * @param input_file_path The file to decompress.
+ * @param output_file_path The output file into which to write the decompressed result.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param params The profile that the file was compressed with (only its \p window_bits and \p header are used).
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_decompress_file_ex(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, const ccrush_params* params);
+
+/**
+ * Same as ccrush_decompress_file_raw(), but for files that were compressed with a custom compression profile.
+ * @param input_file The file to decompress. Standard IO file handle (FILE*)
+ * @param output_file The output file handle into which to write the decompressed file. Standard IO file handle (FILE*)
+ * @param buffer_size_kib The underlying buffer size to use (in KiB). Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param params The profile that the file was compressed with (only its \p window_bits and \p header are used).
+ * @param close_input_file Should the input file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_decompress_file_raw_ex(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const ccrush_params* params, int close_input_file, int close_output_file);
+
+/**
+ * Opaque, reusable (de)compression context. <p>
+ * Keeps its deflate/inflate streams (reset with <c>deflateReset()</c>/<c>inflateReset()</c> between calls) and its I/O buffers alive across calls,
+ * so that compressing or decompressing lots of small payloads doesn't pay for the stream setup and buffer allocations every single time. <p>
+ * A context is NOT thread-safe: use one per thread.
+ */
+typedef struct ccrush_ctx ccrush_ctx;
+
+/**
+ * Allocates a new reusable (de)compression context.
+ * @param buffer_size_kib The underlying buffer size to use (in KiB) for all calls made with this context. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param out_ctx Where to write the new context's pointer into. Free it again using ccrush_ctx_free() once you're done!
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_new(uint32_t buffer_size_kib, ccrush_ctx** out_ctx);
+
+/**
+ * Allocates a new reusable (de)compression context that routes its heap allocations through its own allocator instead of the global one (see ccrush_set_allocator()): the context itself,
+ * its I/O buffers, its growable output buffer, its dictionary copy, zlib's internal state (via <c>z_stream.zalloc</c>/<c>zfree</c>) and the outputs that the <c>ccrush_ctx_*</c> functions return to you. <p>
+ * This way, two threads can each give their context a different arena, without any locking. The returned outputs need to be freed using \p free_function (NOT ccrush_free(), which uses the global allocator).
+ * With <c>CCRUSH_LIBDEFLATE</c>, libdeflate's (de)compressor state still comes from the global allocator (libdeflate's allocation hooks have no user pointer).
+ * @param buffer_size_kib The underlying buffer size to use (in KiB) for all calls made with this context. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param alloc_function The allocation function. Pass <c>NULL</c> (for both functions) to use the global allocator, just like ccrush_ctx_new().
+ * @param free_function The deallocation function.
+ * @param user Opaque pointer that is passed through to \p alloc_function and \p free_function (e.g. your arena). Must stay valid until the context and all of its outputs are freed.
+ * @param out_ctx Where to write the new context's pointer into. Free it again using ccrush_ctx_free() once you're done!
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if only one of the two functions was passed; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_ctx_new_ex(uint32_t buffer_size_kib, ccrush_alloc_function alloc_function, ccrush_free_function free_function, void* user, ccrush_ctx** out_ctx);
+
+/**
+ * Frees a context that was allocated using ccrush_ctx_new() or ccrush_ctx_new_ex() (including its z_streams and buffers, which are zeroed out before being released).
+ * @param ctx The context to free. Passing <c>NULL</c> is a no-op.
+ */
+CCRUSH_API void ccrush_ctx_free(ccrush_ctx* ctx);
+
+/**
+ * Same as ccrush_compress(), but reusing the passed context's deflate stream.
+ * @param ctx The context to use.
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param level The level of compression <c>[0-9]</c>. If you pass a value that is out of the allowed range, <c>6</c> will be used! Switching levels between calls is allowed, but the deflate stream then needs to be re-initialized.
+ * @param out Pointer to an output buffer. This will be allocated on the heap ONLY on success. Needs to be freed manually by the caller.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_compress(ccrush_ctx* ctx, const uint8_t* data, size_t data_length, int level, uint8_t** out, size_t* out_length);
+
+/**
+ * Same as ccrush_compress_into(), but reusing the passed context's deflate stream.
+ * @param ctx The context to use.
+ * @param data The data to compress.
+ * @param data_length Length of the \p data array (how many bytes to compress).
+ * @param level The level of compression <c>[0-9]</c>. If you pass a value that is out of the allowed range, <c>6</c> will be used!
+ * @param out The output buffer to write the compressed data into.
+ * @param out_capacity Size of the \p out buffer (in bytes).
+ * @param out_written Where to write the amount of bytes that were written into \p out.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL if \p out was too small; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_ctx_compress_into(ccrush_ctx* ctx, const uint8_t* data, size_t data_length, int level, uint8_t* out, size_t out_capacity, size_t* out_written);
+
+/**
+ * Same as ccrush_compress_file(), but reusing the passed context's deflate stream and I/O buffers.
+ * @param ctx The context to use.
+ * @param input_file_path The file to compress. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @param output_file_path The output file path where the compressed file should be written to. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @param level The level of compression <c>[0-9]</c>.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_compress_file(ccrush_ctx* ctx, const char* input_file_path, const char* output_file_path, int level);
+
+/**
+ * Same as ccrush_compress_file_raw(), but reusing the passed context's deflate stream and I/O buffers.
+ * @param ctx The context to use.
+ * @param input_file The file to compress. Standard IO file handle (FILE*)
+ * @param output_file The output file handle into which to write the compressed file. Standard IO file handle (FILE*)
+ * @param level The level of compression <c>[0-9]</c>.
+ * @param close_input_file Should the input file handle be <c>fclose</c>'d after usage? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be <c>fclose</c>'d after usage? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_compress_file_raw(ccrush_ctx* ctx, FILE* input_file, FILE* output_file, int level, int close_input_file, int close_output_file);
+
+/**
+ * Same as ccrush_decompress(), but reusing the passed context's inflate stream and buffers.
+ * @param ctx The context to use.
+ * @param data The compressed bytes to decompress.
+ * @param data_length Length of the \p data array.
+ * @param out Output buffer pointer: this will be allocated and filled with the decompressed data ONLY on success. Needs to be freed manually by the caller.
+ * @param out_length Where to write the output array's length into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_decompress(ccrush_ctx* ctx, const uint8_t* data, size_t data_length, uint8_t** out, size_t* out_length);
+
+/**
+ * Same as ccrush_decompress_into(), but reusing the passed context's inflate stream.
+ * @param ctx The context to use.
+ * @param data The compressed bytes to decompress.
+ * @param data_length Length of the \p data array.
+ * @param out The output buffer to write the decompressed data into.
+ * @param out_capacity Size of the \p out buffer (in bytes).
+ * @param out_written Where to write the amount of bytes that were written into \p out.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL if \p out was too small; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_ctx_decompress_into(ccrush_ctx* ctx, const uint8_t* data, size_t data_length, uint8_t* out, size_t out_capacity, size_t* out_written);
+
+/**
+ * Same as ccrush_decompress_file(), but reusing the passed context's inflate stream and I/O buffers.
+ * @param ctx The context to use.
+ * @param input_file_path The file to decompress. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @param output_file_path The output file path where the decompressed file should be written to. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_decompress_file(ccrush_ctx* ctx, const char* input_file_path, const char* output_file_path);
+
+/**
+ * Same as ccrush_decompress_file_raw(), but reusing the passed context's inflate stream and I/O buffers.
+ * @param ctx The context to use.
+ * @param input_file The file to decompress. Standard IO file handle (FILE*)
+ * @param output_file The output file handle into which to write the decompressed file. Standard IO file handle (FILE*)
+ * @param close_input_file Should the input file handle be <c>fclose</c>'d after usage? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be <c>fclose</c>'d after usage? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_decompress_file_raw(ccrush_ctx* ctx, FILE* input_file, FILE* output_file, int close_input_file, int close_output_file);
+
+/**
+ * Sets the preset dictionary (see ccrush_compress_with_dictionary()) that all of the passed context's (de)compression functions use from now on.
+ * @param ctx The context.
+ * @param dictionary The preset dictionary. It's copied into the context, so you don't need to keep it around. Pass <c>NULL</c> (and a \p dictionary_length of <c>0</c>) to stop using one.
+ * @param dictionary_length Length of the \p dictionary (in bytes).
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_ctx_set_dictionary(ccrush_ctx* ctx, const uint8_t* dictionary, size_t dictionary_length);
+
+/**
+ * Sets the compression profile (see ccrush_params) that all of the passed context's (de)compression functions use from now on. <p>
+ * The profile's \p level is ignored: the compression functions all take their own.
+ * @param ctx The context.
+ * @param params The compression profile. It's copied into the context. Pass <c>NULL</c> to go back to the defaults.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if \p ctx is <c>NULL</c> or \p params holds out-of-range values.
+ */
+CCRUSH_API int ccrush_ctx_set_params(ccrush_ctx* ctx, const ccrush_params* params);
+
+/**
+ * Trains a preset dictionary (see ccrush_compress_with_dictionary()) from a corpus of sample payloads. <p>
+ * The substrings that repeat the most across the samples are picked and packed into the dictionary, with the most valuable ones at its end (where deflate reaches them with the shortest distances). <p>
+ * Use a few hundred (or thousand) samples that are representative of what you're going to compress: the more, the better the dictionary. Training is linear in the corpus size (a 100 MB corpus takes a few seconds).
+ * @param samples Array of \p sample_count sample payloads.
+ * @param sample_lengths Array of \p sample_count sample lengths (in bytes).
+ * @param sample_count How many samples there are.
+ * @param out Output buffer into which to write the dictionary.
+ * @param out_capacity Size of the \p out buffer: the dictionary is at most this long (but never longer than #CCRUSH_MAX_DICTIONARY_SIZE).
+ * @param out_written Where to write the length of the trained dictionary into. This can be shorter than \p out_capacity if the corpus doesn't have that much repeated content.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_train_dictionary(const uint8_t* const* samples, const size_t* sample_lengths, size_t sample_count, uint8_t* out, size_t out_capacity, size_t* out_written);
+
+/**
+ * Opaque, incremental (push-style) compression or decompression stream. <p>
+ * Feed it input in arbitrarily sized pieces as they arrive using ccrush_stream_update(): output is handed to your write callback as soon as a buffer's worth of it is ready. <p>
+ * A stream is NOT thread-safe: use it from one thread at a time.
+ */
+typedef struct ccrush_stream ccrush_stream;
+
+/**
+ * Output sink for a ccrush_stream: called every time the stream has produced output.
+ * @param user The \p user pointer that was passed into ccrush_stream_init().
+ * @param data The produced output. Only valid for the duration of the call (copy or send it away before returning)!
+ * @param data_length Length of the \p data array (never <c>0</c>).
+ * @return Return <c>0</c> to continue; anything else aborts the stream call in progress, which then returns that same value.
+ */
+typedef int (*ccrush_stream_write_function)(void* user, const uint8_t* data, size_t data_length);
+
+/**
+ * Initializes a new incremental stream.
+ * @param out_stream Where to write the new stream's pointer into. Free it again using ccrush_stream_free() once you're done!
+ * @param mode Either #CCRUSH_STREAM_MODE_COMPRESS or #CCRUSH_STREAM_MODE_DECOMPRESS.
+ * @param level The level of compression <c>[0-9]</c> (ignored when decompressing). If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+ * @param buffer_size_kib The size of the output buffer (in KiB), i.e. the maximum amount of bytes per write callback call. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param write_function The callback that receives the produced output.
+ * @param user Opaque pointer that is passed through to \p write_function (e.g. your socket).
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_stream_init(ccrush_stream** out_stream, int mode, int level, uint32_t buffer_size_kib, ccrush_stream_write_function write_function, void* user);
+
+/**
+ * Same as ccrush_stream_init(), but using a custom compression profile (e.g. to produce or consume a gzip stream).
+ * @param out_stream Where to write the new stream's pointer into. Free it again using ccrush_stream_free() once you're done!
+ * @param mode Either #CCRUSH_STREAM_MODE_COMPRESS or #CCRUSH_STREAM_MODE_DECOMPRESS.
+ * @param params The compression profile (when decompressing, only its \p window_bits and \p header are used).
+ * @param buffer_size_kib The size of the output buffer (in KiB), i.e. the maximum amount of bytes per write callback call. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_CHUNKSIZE.
+ * @param write_function The callback that receives the produced output.
+ * @param user Opaque pointer that is passed through to \p write_function (e.g. your socket).
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_stream_init_ex(ccrush_stream** out_stream, int mode, const ccrush_params* params, uint32_t buffer_size_kib, ccrush_stream_write_function write_function, void* user);
+
+/**
+ * Feeds the next piece of input into a stream. All of it is consumed before this returns. <p>
+ * Decompression streams recognize (and skip) a leading size header as written by ccrush_compress_with_size_header(). Once a decompression stream has reached the end of its zlib stream, any further input is an error.
+ * @param stream The stream.
+ * @param data The next piece of input.
+ * @param data_length Length of the \p data array (passing <c>0</c> is a no-op).
+ * @return <c>0</c> on success; non-zero error codes if something fails (e.g. corrupt data or a failed write callback). After a failure, the stream is unusable and every further call returns the same error.
+ */
+CCRUSH_API int ccrush_stream_update(ccrush_stream* stream, const uint8_t* data, size_t data_length);
+
+/**
+ * Makes a compression stream emit everything it has buffered so far (without ending the stream), e.g. at the end of a message that needs to be sent away right now. <p>
+ * This uses <c>Z_SYNC_FLUSH</c>, so every flush costs a few bytes of output and flushing very often hurts the compression ratio. No-op for decompression streams.
+ * @param stream The compression stream.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_stream_flush(ccrush_stream* stream);
+
+/**
+ * Finishes a stream. <p>
+ * For compression streams, this emits the remaining output (including the zlib trailer). For decompression streams, this checks that the complete zlib stream was received (truncated input is an error).
+ * @param stream The stream.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_stream_finish(ccrush_stream* stream);
+
+/**
+ * Frees a stream that was initialized using ccrush_stream_init() (finished or not).
+ * @param stream The stream to free. Passing <c>NULL</c> is a no-op.
+ */
+CCRUSH_API void ccrush_stream_free(ccrush_stream* stream);
+
+/**
+ * Opaque random-access index for an existing zlib (or gzip) stream: a list of inflate checkpoints (compressed offset, bit offset and the preceding 32 KiB of uncompressed data),
+ * one roughly every "span" bytes of uncompressed data. With it, any range of the uncompressed data can be extracted by inflating from the nearest checkpoint on,
+ * rather than from the very beginning of the stream (see zlib's <c>examples/zran.c</c>).
+ */
+typedef struct ccrush_index ccrush_index;
+
+/**
+ * Builds a random-access index by inflating a compressed file (e.g. one written by ccrush_compress_file()) once from start to finish. <p>
+ * Every checkpoint costs a bit over 32 KiB of memory (and of sidecar file size): pick the span accordingly.
+ * @param input_file The compressed file to index, positioned at the start of the zlib (or gzip) stream. Standard IO file handle (FILE*)
+ * @param span_kib Minimum distance between two checkpoints (in KiB of uncompressed data): this bounds how much needs to be inflated and thrown away per ccrush_decompress_range() call. Pass <c>0</c> to use the default value #CCRUSH_DEFAULT_INDEX_SPAN_KiB.
+ * @param out_index Where to write the new index's pointer into. Free it again using ccrush_index_free() once you're done!
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_index_build(FILE* input_file, uint32_t span_kib, ccrush_index** out_index);
+
+/**
+ * Saves a random-access index into a (sidecar) file.
+ * @param index The index to save.
+ * @param output_file_path Where to write the index file to. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_index_save(const ccrush_index* index, const char* output_file_path);
+
+/**
+ * Loads a random-access index that was saved using ccrush_index_save().
+ * @param input_file_path The index file to load. Must be UTF-8 encoded! Must be NUL-terminated!
+ * @param out_index Where to write the loaded index's pointer into. Free it again using ccrush_index_free() once you're done!
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_INDEX if the file isn't a valid index; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_index_load(const char* input_file_path, ccrush_index** out_index);
+
+/**
+ * Gets the total uncompressed size of the data that an index was built for.
+ * @param index The index.
+ * @param out_uncompressed_size Where to write the uncompressed size into.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if one of the arguments is <c>NULL</c>.
+ */
+CCRUSH_API int ccrush_index_get_uncompressed_size(const ccrush_index* index, uint64_t* out_uncompressed_size);
+
+/**
+ * Frees an index that was built using ccrush_index_build() or loaded using ccrush_index_load().
+ * @param index The index to free. Passing <c>NULL</c> is a no-op.
+ */
+CCRUSH_API void ccrush_index_free(ccrush_index* index);
+
+/**
+ * Decompresses only a given range of a compressed file, starting to inflate at the nearest checkpoint before it (rather than at the start of the file). <p>
+ * Only the compressed data between that checkpoint and the end of the range is read, so the cost is bounded by the index's span instead of the file size.
+ * @param input_file The compressed file that \p index was built for. Must be seekable! Standard IO file handle (FILE*)
+ * @param index The file's random-access index.
+ * @param offset Offset (in the uncompressed data) of the first byte to extract.
+ * @param out The output buffer to write the extracted bytes into.
+ * @param length How many bytes to extract (at most \p out 's size). Ranges that reach past the end of the data are cut short.
+ * @param out_written Where to write the amount of bytes that were written into \p out (<c>0</c> if \p offset is past the end of the data).
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_INDEX if the index doesn't match the file; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_range(FILE* input_file, const ccrush_index* index, uint64_t offset, uint8_t* out, size_t length, size_t* out_written);
+
+/**
+ * Compresses a file into a block container: a sequence of independently deflated blocks, each prefixed with its compressed and uncompressed length (and an Adler-32 checksum), followed by a block table. <p>
+ * Unlike the zlib stream written by ccrush_compress_file_raw_mt(), such a container can also be <strong>decompressed</strong> in parallel (see ccrush_decompress_container_file_raw()), and every block can be decoded on its own (see ccrush_container_decompress_block()).
+ * The price is a slightly worse ratio, because no block can back-reference data from the one before it. <p>
+ * The output is <strong>NOT</strong> a zlib stream: ccrush_decompress_file_raw() can't read it.
+ * @param input_file The input file to compress. Standard IO file handle (FILE*)
+ * @param output_file The output file into which to write the block container. Standard IO file handle (FILE*)
+ * @param block_size_kib Uncompressed size of each block in KiB. Pass <c>0</c> to use the default of #CCRUSH_DEFAULT_CONTAINER_BLOCK_SIZE_KiB. Must not exceed #CCRUSH_MAX_BUFFER_SIZE_KiB.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+ * @param thread_count How many blocks to compress concurrently. Pass <c>0</c> to use one thread per CPU core. Values above #CCRUSH_MAX_THREAD_COUNT are clamped.
+ * @param close_input_file Should the input file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_container_file_raw(FILE* input_file, FILE* output_file, uint32_t block_size_kib, int level, uint32_t thread_count, int close_input_file, int close_output_file);
+
+/**
+ * Compresses a file into a block container (see ccrush_compress_container_file_raw()).
+ * @param input_file_path The input file to compress.
+ * @param output_file_path The output file into which to write the block container.
+ * @param block_size_kib Uncompressed size of each block in KiB. Pass <c>0</c> to use the default of #CCRUSH_DEFAULT_CONTAINER_BLOCK_SIZE_KiB.
+ * @param level The level of compression <c>[0-9]</c>. Lower means faster, higher level means better compression (but slower). Default is <c>6</c>. If you pass a value that is out of the allowed range of <c>[0-9]</c>, <c>6</c> will be used!
+ * @param thread_count How many blocks to compress concurrently. Pass <c>0</c> to use one thread per CPU core.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_compress_container_file(const char* input_file_path, const char* output_file_path, uint32_t block_size_kib, int level, uint32_t thread_count);
+
+/**
+ * Decompresses a block container written by ccrush_compress_container_file_raw(), inflating up to \p thread_count blocks concurrently. <p>
+ * The container is read strictly front to back, so the input file handle doesn't need to be seekable (pipes like <c>stdin</c> are fine).
+ * Every block's length and checksum are verified, and so is the footer.
+ * @param input_file The block container to decompress. Standard IO file handle (FILE*)
+ * @param output_file The output file into which to write the decompressed data. Standard IO file handle (FILE*)
+ * @param thread_count How many blocks to decompress concurrently. Pass <c>0</c> to use one thread per CPU core. Values above #CCRUSH_MAX_THREAD_COUNT are clamped.
+ * @param close_input_file Should the input file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @param close_output_file Should the output file handle be closed when done? Pass <c>0</c> for "false" and anything else for "true".
+ * @return <c>0</c> on success; <c>Z_DATA_ERROR</c> if the container is truncated or corrupt; other non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_decompress_container_file_raw(FILE* input_file, FILE* output_file, uint32_t thread_count, int close_input_file, int close_output_file);
+
+/**
+ * Decompresses a block container file (see ccrush_decompress_container_file_raw()).
+ * @param input_file_path The block container to decompress.
+ * @param output_file_path The output file into which to write the decompressed data.
+ * @param thread_count How many blocks to decompress concurrently. Pass <c>0</c> to use one thread per CPU core.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_decompress_container_file(const char* input_file_path, const char* output_file_path, uint32_t thread_count);
+
+/**
+ * Gets the amount of blocks inside a block container (read from its footer).
+ * @param input_file The block container. Must be seekable! Standard IO file handle (FILE*)
+ * @param out_block_count Where to write the block count into.
+ * @return <c>0</c> on success; non-zero error codes if something fails.
+ */
+CCRUSH_API int ccrush_container_get_block_count(FILE* input_file, uint64_t* out_block_count);
+
+/**
+ * Decompresses a single block of a block container, without touching any of the others (the block is located through the container's block table).
+ * @param input_file The block container. Must be seekable! Standard IO file handle (FILE*)
+ * @param block_index Index of the block to decompress <c>[0; block count - 1]</c>.
+ * @param out Output buffer pointer: this will be allocated and filled with the decompressed block. Needs to be freed using ccrush_free() when you're done using it! NUL-terminated.
+ * @param out_length Where to write the output buffer length into.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if \p block_index is out of range; non-zero error codes if something else fails.
+ */
+CCRUSH_API int ccrush_container_decompress_block(FILE* input_file, uint64_t block_index, uint8_t** out, size_t* out_length);
+
+/**
+ * Sets whether ccrush zeroes out its internal buffers (I/O chunk buffers, growable output buffers, discarded outputs, etc...) before releasing them. <p>
+ * This is on by default, so that no leftovers of potentially sensitive data linger around in freed memory.
+ * For non-sensitive bulk data it's pure memory bandwidth though (up to twice the buffer size per call), so you can turn it off. <p>
+ * This is the process-wide default that the plain functions use and that new contexts start out with; use ccrush_ctx_set_scrub_buffers() to override it per context.
+ * @param scrub Pass <c>0</c> to skip the scrubbing, anything else to scrub.
+ */
+CCRUSH_API void ccrush_set_scrub_buffers(int scrub);
+
+/**
+ * Checks whether ccrush currently scrubs its buffers by default (see ccrush_set_scrub_buffers()).
+ * @return <c>1</c> if buffers are scrubbed; <c>0</c> if not.
+ */
+CCRUSH_API int ccrush_get_scrub_buffers();
+
+/**
+ * Sets whether the passed context zeroes out its buffers before releasing them (overriding the process-wide default from ccrush_set_scrub_buffers() for this context).
+ * @param ctx The context.
+ * @param scrub Pass <c>0</c> to skip the scrubbing (e.g. a context dedicated to bulk telemetry), anything else to scrub (e.g. a context dedicated to secrets).
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if \p ctx is <c>NULL</c>.
+ */
+CCRUSH_API int ccrush_ctx_set_scrub_buffers(ccrush_ctx* ctx, int scrub);
+
+/**
+ * Enables or disables pipelined I/O for the FILE* based (de)compression functions (ccrush_compress_file_raw(), ccrush_decompress_file_raw(), their <c>ccrush_ctx</c> counterparts, etc...). <p>
+ * By default, these read a chunk, (de)compress it, write the result and only then read the next chunk: the CPU idles during I/O and the I/O idles during (de)compression.
+ * With pipelined I/O, a reader thread and a writer thread exchange (triple-buffered) chunks with the (de)compressing thread through bounded queues, so that all three overlap.
+ * This pays off on slow or high-latency storage (network volumes, spinning disks, pipes fed by other processes) and at low compression levels. <p>
+ * The output is exactly the same either way. Mind that when decompressing, the reader may read a few chunks past the end of the compressed stream (the sequential path reads up to one chunk past it).
+ * This is off by default. If the threads can't be started, the sequential path is used.
+ * @param enabled Pass <c>0</c> to disable pipelined I/O, anything else to enable it.
+ */
+CCRUSH_API void ccrush_set_pipelined_io(int enabled);
+
+/**
+ * Checks whether pipelined I/O is currently enabled (see ccrush_set_pipelined_io()).
+ * @return <c>1</c> if enabled; <c>0</c> if not.
+ */
+CCRUSH_API int ccrush_get_pipelined_io();
+
+/**
+ * Enables or disables adaptive compression for all subsequently created contexts and plain (non-<c>ccrush_ctx</c>) single-threaded compression calls. <p>
+ * With adaptive compression, each block of input (one buffer's worth, see the \p buffer_size_kib arguments) gets its byte entropy estimated from a small sample before it's compressed.
+ * Blocks that look incompressible (JPEGs, video, zstd or zip archives, encrypted data, ...) are stored as they are (level <c>0</c>, switched to via <c>deflateParams()</c>) instead of burning CPU on them:
+ * compressing them would only have made them a little bigger anyway. Everything else is still compressed using the requested level. <p>
+ * Blocks smaller than 4 KiB are too small for a reliable estimate and just stick with the previous block's decision, so don't combine this with tiny buffer sizes. <p>
+ * The output is a regular zlib (or gzip/raw) stream that any inflater can decompress. See ccrush_stats::bypassed_bytes for how much input was stored.
+ * This is off by default.
+ * @param enabled Pass <c>0</c> to disable adaptive compression, anything else to enable it.
+ */
+CCRUSH_API void ccrush_set_adaptive_compression(int enabled);
+
+/**
+ * Checks whether adaptive compression is currently enabled (see ccrush_set_adaptive_compression()).
+ * @return <c>1</c> if enabled; <c>0</c> if not.
+ */
+CCRUSH_API int ccrush_get_adaptive_compression();
+
+/**
+ * Enables or disables adaptive compression (see ccrush_set_adaptive_compression()) for the passed context only.
+ * @param ctx The context.
+ * @param enabled Pass <c>0</c> to disable adaptive compression, anything else to enable it.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if \p ctx is <c>NULL</c>.
+ */
+CCRUSH_API int ccrush_ctx_set_adaptive_compression(ccrush_ctx* ctx, int enabled);
+
+/**
+ * Enables or disables the per-thread cache for the plain (non-<c>ccrush_ctx</c>) functions. <p>
+ * When enabled, functions like ccrush_compress() or ccrush_decompress() stop setting up (and tearing down) their z_streams and I/O buffers on every call:
+ * instead, each thread keeps them in a cache of its own and reuses them on the next call. <p>
+ * The default is off, unless the library was built with <c>CCRUSH_THREAD_CACHE=1</c> (CMake option <c>ccrush_THREAD_CACHE</c>). <p>
+ * This is a process-wide setting: flip it once at startup, before any threads start calling into ccrush. Disabling it does NOT free the threads' caches: see ccrush_thread_cache_release() for that.
+ * @param enabled Pass <c>0</c> to disable the thread cache, anything else to enable it.
+ */
+CCRUSH_API void ccrush_thread_cache_enable(int enabled);
+
+/**
+ * Checks whether the per-thread cache is currently enabled (see ccrush_thread_cache_enable()).
+ * @return <c>1</c> if the thread cache is enabled; <c>0</c> if not.
+ */
+CCRUSH_API int ccrush_thread_cache_is_enabled();
+
+/**
+ * Frees the calling thread's cached z_streams and buffers (zeroing them out first). <p>
+ * Call this from long-lived threads once they're done with ccrush, and in any case before a thread that used the cache exits (otherwise its cache is leaked).
+ * Calling it on a thread that has nothing cached is a no-op; the cache is simply set up again on the next call.
+ */
+CCRUSH_API void ccrush_thread_cache_release();
+
+/**
+ * Per-call statistics (see ccrush_ctx_set_stats() and ccrush_set_thread_stats()). <p>
+ * Each instrumented call zeroes the struct first and then fills it in, so it always describes the most recent call.
+ */
+typedef struct ccrush_stats
+{
+    /**
+     * How many bytes were fed into deflate/inflate.
+     */
+    uint64_t bytes_in;
+
+    /**
+     * How many bytes came out of deflate/inflate.
+     */
+    uint64_t bytes_out;
+
+    /**
+     * How many times <c>deflate()</c> or <c>inflate()</c> was called.
+     */
+    uint64_t codec_calls;
+
+    /**
+     * Nanoseconds spent inside <c>deflate()</c> and <c>inflate()</c>.
+     */
+    uint64_t codec_ns;
+
+    /**
+     * Nanoseconds spent reading and writing files. With pipelined I/O or io_uring (where I/O overlaps with the codec), this is the time spent waiting for the I/O to catch up.
+     */
+    uint64_t io_ns;
+
+    /**
+     * How many times the growable output buffer had to be reallocated (because the output didn't fit into it anymore).
+     */
+    uint64_t buffer_growths;
+
+    /**
+     * Peak capacity (in bytes) of the buffer that the call (de)compressed into: the growable output buffer, the one-shot output allocation or the I/O chunk buffer.
+     */
+    uint64_t peak_buffer_bytes;
+
+    /**
+     * How many bytes of input adaptive compression (see ccrush_set_adaptive_compression()) stored as they are instead of compressing them.
+     */
+    uint64_t bypassed_bytes;
+} ccrush_stats;
+
+/**
+ * Makes all subsequent calls on the passed context record their statistics into \p stats. <p>
+ * The instrumented functions are the <c>ccrush_ctx_*</c> (de)compression functions.
+ * With stats disabled (the default), the only overhead is a <c>NULL</c> check per <c>deflate()</c>/<c>inflate()</c> call.
+ * @param ctx The context.
+ * @param stats Where to record the statistics into. Must stay valid for as long as it's set! Pass <c>NULL</c> to stop recording.
+ * @return <c>0</c> on success; #CCRUSH_ERROR_INVALID_ARGS if \p ctx is <c>NULL</c>.
+ */
+CCRUSH_API int ccrush_ctx_set_stats(ccrush_ctx* ctx, ccrush_stats* stats);
+
+/**
+ * Makes all subsequent plain (non-<c>ccrush_ctx</c>) calls on the calling thread record their statistics into \p stats. <p>
+ * The instrumented functions are the single-threaded ones: ccrush_compress(), ccrush_compress_into(), ccrush_compress_with_size_header(), ccrush_compress_file(), ccrush_compress_file_raw(),
+ * their decompression counterparts and their <c>_with_dictionary</c> and <c>_ex</c> variants, as well as ccrush_estimate_ratio() (which records what it actually compressed). The multi-threaded, batch, container, streaming and index functions don't record anything.
+ * @param stats Where to record the statistics into. Must stay valid for as long as it's set! Pass <c>NULL</c> to stop recording.
+ */
+CCRUSH_API void ccrush_set_thread_stats(ccrush_stats* stats);
+
+/**
+ * Frees memory that was allocated by ccrush (e.g. a compression output) using the current global allocator (<c>free()</c> unless changed via ccrush_set_allocator()). Also useful for C# interop. <p>
+ * Outputs of a context that has its own allocator (see ccrush_ctx_new_ex()) need to be freed using that allocator's free function instead.
  * @param mem The pointer to the memory to free.
  */
 CCRUSH_API void ccrush_free(void* mem);
@@ -33,6 +33,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef _WIN32
 #include <sys/types.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(CCRUSH_IO_URING) && defined(__linux__)
+#define CCRUSH_HAS_IO_URING 1
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
 #else
 #define WIN32_NO_STATUS
 #include <windows.h>
@@ -40,569 +50,6805 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <ctype.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 #include <zlib.h>
-#include <chillbuff.h>
 
-static inline FILE* ccrush_fopen(const char* filename, const char* mode)
+#ifdef CCRUSH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+static void* ccrush_default_alloc(void* user, const size_t size)
+{
+    return malloc(size);
+}
+
+static void ccrush_default_free(void* user, void* mem)
+{
+    free(mem);
+}
+
+/*
+ * An allocation function pair along with the user pointer that gets passed into it.
+ */
+struct ccrush_allocator
+{
+    ccrush_alloc_function alloc;
+    ccrush_free_function free;
+    void* user;
+};
+
+/*
+ * The allocator that all of ccrush's heap allocations (including zlib's internal state) go through, except for those of contexts that brought their own (see ccrush_ctx_new_ex()).
+ * Replaced using ccrush_set_allocator(); meant to be set once, before anything else gets allocated.
+ */
+static struct ccrush_allocator ccrush_global_allocator = { &ccrush_default_alloc, &ccrush_default_free, NULL };
+
+static inline void* ccrush_allocator_alloc(const struct ccrush_allocator* allocator, const size_t size)
+{
+    return allocator->alloc(allocator->user, size);
+}
+
+static inline void* ccrush_allocator_calloc(const struct ccrush_allocator* allocator, const size_t count, const size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    void* mem = ccrush_allocator_alloc(allocator, count * size);
+
+    if (mem != NULL)
+    {
+        memset(mem, 0x00, count * size);
+    }
+
+    return mem;
+}
+
+static inline void ccrush_allocator_free(const struct ccrush_allocator* allocator, void* mem)
+{
+    if (mem != NULL)
+    {
+        allocator->free(allocator->user, mem);
+    }
+}
+
+/*
+ * Shrinks an allocation to the passed size, returning the (possibly moved) memory.
+ * Only the default allocator can do this in place; custom allocators (e.g. arenas) just keep the original allocation.
+ */
+static inline void* ccrush_allocator_shrink(const struct ccrush_allocator* allocator, void* mem, const size_t size)
+{
+    if (allocator->alloc != &ccrush_default_alloc)
+    {
+        return mem;
+    }
+
+    void* shrunk_mem = realloc(mem, size);
+    return shrunk_mem != NULL ? shrunk_mem : mem;
+}
+
+static inline void* ccrush_mem_alloc(const size_t size)
+{
+    return ccrush_allocator_alloc(&ccrush_global_allocator, size);
+}
+
+static inline void* ccrush_mem_calloc(const size_t count, const size_t size)
+{
+    return ccrush_allocator_calloc(&ccrush_global_allocator, count, size);
+}
+
+static inline void ccrush_mem_free(void* mem)
+{
+    ccrush_allocator_free(&ccrush_global_allocator, mem);
+}
+
+static inline void* ccrush_mem_shrink(void* mem, const size_t size)
+{
+    return ccrush_allocator_shrink(&ccrush_global_allocator, mem, size);
+}
+
+/*
+ * Whether buffers are zeroed out before being released (see ccrush_set_scrub_buffers()).
+ */
+static int ccrush_scrub_buffers = 1;
+
+static inline void ccrush_scrub(void* mem, const size_t length, const int scrub)
+{
+    if (scrub)
+    {
+        memset(mem, 0x00, length);
+    }
+}
+
+/*
+ * Like zlib's own zcalloc(), this doesn't zero anything out: zlib doesn't need it to, and memsetting its ~256 KiB of deflate state on every init is pure overhead for small inputs.
+ */
+static voidpf ccrush_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    if (size != 0 && items > SIZE_MAX / size)
+    {
+        return NULL;
+    }
+
+    return ccrush_allocator_alloc(opaque, (size_t)items * size);
+}
+
+static void ccrush_zfree(voidpf opaque, voidpf address)
+{
+    ccrush_allocator_free(opaque, address);
+}
+
+/*
+ * Zeroes out a z_stream and hooks zlib's internal allocations up to the passed allocator (which needs to outlive the stream): call this right before deflateInit*() or inflateInit*().
+ */
+static inline void ccrush_zstream_setup(z_stream* stream, const struct ccrush_allocator* allocator)
+{
+    memset(stream, 0x00, sizeof(z_stream));
+    stream->zalloc = &ccrush_zalloc;
+    stream->zfree = &ccrush_zfree;
+    stream->opaque = (voidpf)allocator;
+}
+
+#ifdef CCRUSH_LIBDEFLATE
+
+static void* ccrush_libdeflate_alloc(size_t size)
+{
+    return ccrush_mem_alloc(size);
+}
+
+static void ccrush_libdeflate_free(void* mem)
+{
+    ccrush_mem_free(mem);
+}
+
+/*
+ * Hooks libdeflate's (de)compressor allocations up to ccrush's allocator (like ccrush_zstream_setup() does for zlib).
+ * libdeflate's allocation hooks don't take a user pointer, so this is always the global allocator (even for contexts that have their own).
+ */
+static const struct libdeflate_options ccrush_libdeflate_options = {
+    sizeof(struct libdeflate_options),
+    &ccrush_libdeflate_alloc,
+    &ccrush_libdeflate_free,
+};
+
+#endif
+
+/*
+ * Minimal growable byte buffer (used where the output size isn't known in advance).
+ */
+struct ccrush_growbuf
+{
+    uint8_t* array;
+    size_t length;
+    size_t capacity;
+    const struct ccrush_allocator* allocator;
+};
+
+static int ccrush_growbuf_init(struct ccrush_growbuf* buffer, const struct ccrush_allocator* allocator, const size_t initial_capacity)
+{
+    buffer->length = 0;
+    buffer->capacity = initial_capacity ? initial_capacity : 16;
+    buffer->allocator = allocator;
+    buffer->array = ccrush_allocator_alloc(allocator, buffer->capacity);
+
+    return buffer->array != NULL ? 0 : CCRUSH_ERROR_OUT_OF_MEMORY;
+}
+
+static int ccrush_growbuf_push_back(struct ccrush_growbuf* buffer, const uint8_t* data, const size_t data_length, const int scrub)
+{
+    if (data_length > buffer->capacity - buffer->length)
+    {
+        size_t new_capacity = buffer->capacity;
+
+        while (data_length > new_capacity - buffer->length)
+        {
+            if (new_capacity > SIZE_MAX / 2)
+            {
+                return CCRUSH_ERROR_OUT_OF_MEMORY;
+            }
+
+            new_capacity *= 2;
+        }
+
+        uint8_t* new_array = ccrush_allocator_alloc(buffer->allocator, new_capacity);
+        if (new_array == NULL)
+        {
+            return CCRUSH_ERROR_OUT_OF_MEMORY;
+        }
+
+        memcpy(new_array, buffer->array, buffer->length);
+        ccrush_scrub(buffer->array, buffer->length, scrub);
+        ccrush_allocator_free(buffer->allocator, buffer->array);
+
+        buffer->array = new_array;
+        buffer->capacity = new_capacity;
+    }
+
+    memcpy(buffer->array + buffer->length, data, data_length);
+    buffer->length += data_length;
+
+    return 0;
+}
+
+static void ccrush_growbuf_free(struct ccrush_growbuf* buffer)
+{
+    if (buffer->array != NULL)
+    {
+        ccrush_allocator_free(buffer->allocator, buffer->array);
+    }
+
+    memset(buffer, 0x00, sizeof(struct ccrush_growbuf));
+}
+
+static inline FILE* ccrush_fopen(const char* filename, const char* mode)
+{
+#ifdef _WIN32
+    wchar_t* wpath = ccrush_mem_alloc(CCRUSH_MAX_WIN_FILEPATH_LENGTH * sizeof(wchar_t));
+    if (wpath == NULL)
+    {
+        return NULL;
+    }
+
+    wchar_t wmode[256];
+
+    wpath[0] = 0x00;
+    wmode[0] = 0x00;
+
+    MultiByteToWideChar(CP_UTF8, 0, filename, -1, wpath, CCRUSH_MAX_WIN_FILEPATH_LENGTH);
+    MultiByteToWideChar(CP_UTF8, 0, mode, -1, wmode, 256);
+
+    FILE* file = _wfopen(wpath, wmode);
+    ccrush_mem_free(wpath);
+    return file;
+#else // Hope that the fopen() implementation on whatever platform you're on accepts UTF-8 encoded strings. For most *nix environments, this holds true :)
+    return fopen(filename, mode);
+#endif
+}
+
+static inline int ccrush_fseek64(FILE* file, const uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+/*
+ * Read-only mapping of a whole input file, so that zlib can consume it in place instead of through an extra fread() copy.
+ * Only non-empty regular files can be mapped: for anything else (pipes, /proc files, etc...) ccrush_file_map_open() fails and the callers fall back to stdio.
+ * Not implemented on Windows, where the stdio path is always used.
+ */
+struct ccrush_file_map
+{
+    const uint8_t* data;
+    size_t length;
+};
+
+static int ccrush_file_map_open(FILE* file, struct ccrush_file_map* map)
+{
+    memset(map, 0x00, sizeof(struct ccrush_file_map));
+
+#ifdef _WIN32
+    (void)file;
+    return -1;
+#else
+    const int fd = fileno(file);
+
+    struct stat file_stat;
+
+    if (fd < 0 || fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size <= 0 || (uint64_t)file_stat.st_size > SIZE_MAX)
+    {
+        return -1;
+    }
+
+    void* data = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        return -1;
+    }
+
+#ifdef MADV_SEQUENTIAL
+    madvise(data, (size_t)file_stat.st_size, MADV_SEQUENTIAL);
+#endif
+
+    map->data = data;
+    map->length = (size_t)file_stat.st_size;
+    return 0;
+#endif
+}
+
+static void ccrush_file_map_close(struct ccrush_file_map* map)
+{
+#ifndef _WIN32
+    if (map->data != NULL)
+    {
+        munmap((void*)map->data, map->length);
+    }
+#endif
+    memset(map, 0x00, sizeof(struct ccrush_file_map));
+}
+
+/*
+ * Deflate's sliding window is 32 KiB: priming a block with the previous block's last 32 KiB
+ * as a preset dictionary lets it reference everything the inflater on the other end can see.
+ */
+#define CCRUSH_WINDOW_SIZE (1024 * 32)
+
+/*
+ * Inputs are never split into slices smaller than this: below that, thread start-up costs and the lost cross-slice matches aren't worth it.
+ */
+#define CCRUSH_MT_MIN_SLICE_SIZE (1024 * 128)
+
+/*
+ * Upper bound for a single slice, so that both its input and its worst-case output fit into zlib's 32-bit avail_in/avail_out counters.
+ */
+#define CCRUSH_MT_MAX_SLICE_SIZE (1024 * 1024 * 1024)
+
+typedef void (*ccrush_job_function)(void* job);
+
+struct ccrush_thread_args
+{
+    ccrush_job_function function;
+    void* job;
+};
+
+#ifdef _WIN32
+typedef HANDLE ccrush_thread;
+
+static DWORD WINAPI ccrush_thread_main(LPVOID arg)
+{
+    struct ccrush_thread_args* args = (struct ccrush_thread_args*)arg;
+    args->function(args->job);
+    return 0;
+}
+
+static inline int ccrush_thread_start(ccrush_thread* thread, struct ccrush_thread_args* args)
+{
+    *thread = CreateThread(NULL, 0, ccrush_thread_main, args, 0, NULL);
+    return *thread != NULL ? 0 : -1;
+}
+
+static inline void ccrush_thread_join(ccrush_thread thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+typedef SRWLOCK ccrush_mutex;
+typedef CONDITION_VARIABLE ccrush_cond;
+
+static inline int ccrush_mutex_init(ccrush_mutex* mutex)
+{
+    InitializeSRWLock(mutex);
+    return 0;
+}
+
+static inline void ccrush_mutex_destroy(ccrush_mutex* mutex)
+{
+    (void)mutex;
+}
+
+static inline void ccrush_mutex_lock(ccrush_mutex* mutex)
+{
+    AcquireSRWLockExclusive(mutex);
+}
+
+static inline void ccrush_mutex_unlock(ccrush_mutex* mutex)
+{
+    ReleaseSRWLockExclusive(mutex);
+}
+
+static inline int ccrush_cond_init(ccrush_cond* cond)
+{
+    InitializeConditionVariable(cond);
+    return 0;
+}
+
+static inline void ccrush_cond_destroy(ccrush_cond* cond)
+{
+    (void)cond;
+}
+
+static inline void ccrush_cond_wait(ccrush_cond* cond, ccrush_mutex* mutex)
+{
+    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static inline void ccrush_cond_broadcast(ccrush_cond* cond)
+{
+    WakeAllConditionVariable(cond);
+}
+#else
+typedef pthread_t ccrush_thread;
+
+static void* ccrush_thread_main(void* arg)
+{
+    struct ccrush_thread_args* args = (struct ccrush_thread_args*)arg;
+    args->function(args->job);
+    return NULL;
+}
+
+static inline int ccrush_thread_start(ccrush_thread* thread, struct ccrush_thread_args* args)
+{
+    return pthread_create(thread, NULL, ccrush_thread_main, args);
+}
+
+static inline void ccrush_thread_join(ccrush_thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+typedef pthread_mutex_t ccrush_mutex;
+typedef pthread_cond_t ccrush_cond;
+
+static inline int ccrush_mutex_init(ccrush_mutex* mutex)
+{
+    return pthread_mutex_init(mutex, NULL);
+}
+
+static inline void ccrush_mutex_destroy(ccrush_mutex* mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void ccrush_mutex_lock(ccrush_mutex* mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void ccrush_mutex_unlock(ccrush_mutex* mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+static inline int ccrush_cond_init(ccrush_cond* cond)
+{
+    return pthread_cond_init(cond, NULL);
+}
+
+static inline void ccrush_cond_destroy(ccrush_cond* cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+static inline void ccrush_cond_wait(ccrush_cond* cond, ccrush_mutex* mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline void ccrush_cond_broadcast(ccrush_cond* cond)
+{
+    pthread_cond_broadcast(cond);
+}
+#endif
+
+static inline uint32_t ccrush_get_cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    const long n = (long)system_info.dwNumberOfProcessors;
+#else
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? (uint32_t)n : 1;
+}
+
+static inline uint32_t ccrush_resolve_thread_count(const uint32_t thread_count)
+{
+    return CCRUSH_MIN(thread_count == 0 ? ccrush_get_cpu_count() : thread_count, CCRUSH_MAX_THREAD_COUNT);
+}
+
+/*
+ * Runs the passed array of jobs concurrently (one thread per job; the first job runs on the calling thread) and returns once they're all done.
+ * If a thread can't be spawned, its job is run on the calling thread instead (slower but still correct).
+ */
+static void ccrush_run_jobs(void* jobs, const size_t job_size, const uint32_t job_count, ccrush_job_function function)
+{
+    if (job_count == 0)
+    {
+        return;
+    }
+
+    ccrush_thread* threads = ccrush_mem_alloc(job_count * sizeof(ccrush_thread));
+    struct ccrush_thread_args* args = ccrush_mem_alloc(job_count * sizeof(struct ccrush_thread_args));
+    int* started = ccrush_mem_calloc(job_count, sizeof(int));
+
+    if (threads == NULL || args == NULL || started == NULL)
+    {
+        for (uint32_t i = 0; i < job_count; ++i)
+        {
+            function((uint8_t*)jobs + (i * job_size));
+        }
+
+        goto exit;
+    }
+
+    for (uint32_t i = 1; i < job_count; ++i)
+    {
+        args[i].function = function;
+        args[i].job = (uint8_t*)jobs + (i * job_size);
+        started[i] = ccrush_thread_start(&threads[i], &args[i]) == 0;
+    }
+
+    function(jobs);
+
+    for (uint32_t i = 1; i < job_count; ++i)
+    {
+        if (started[i])
+        {
+            ccrush_thread_join(threads[i]);
+        }
+        else
+        {
+            function(args[i].job);
+        }
+    }
+
+exit:
+    ccrush_mem_free(threads);
+    ccrush_mem_free(args);
+    ccrush_mem_free(started);
+}
+
+/*
+ * Pipelined FILE* I/O (see ccrush_set_pipelined_io()): a reader thread and a writer thread
+ * hand fixed-size chunks to and from the codec (which runs on the calling thread) through bounded queues,
+ * so that reading, (de)compressing and writing overlap instead of taking turns.
+ */
+#define CCRUSH_PIPELINE_DEPTH 3
+
+static int ccrush_pipelined_io = 0;
+
+struct ccrush_pipeline_chunk
+{
+    uint8_t* data;
+    size_t length;
+    int last;
+    int error;
+};
+
+struct ccrush_pipeline_queue
+{
+    struct ccrush_pipeline_chunk* chunks[CCRUSH_PIPELINE_DEPTH];
+    size_t head;
+    size_t count;
+};
+
+struct ccrush_pipeline
+{
+    FILE* input_file;
+    FILE* output_file;
+    size_t buffersize;
+    int scrub;
+    const struct ccrush_allocator* allocator;
+    ccrush_mutex mutex;
+    ccrush_cond cond;
+    int aborted;
+    int write_error;
+    struct ccrush_pipeline_chunk input_chunks[CCRUSH_PIPELINE_DEPTH];
+    struct ccrush_pipeline_chunk output_chunks[CCRUSH_PIPELINE_DEPTH];
+    struct ccrush_pipeline_queue free_input_chunks;
+    struct ccrush_pipeline_queue read_input_chunks;
+    struct ccrush_pipeline_queue free_output_chunks;
+    struct ccrush_pipeline_queue written_output_chunks;
+    ccrush_thread reader;
+    ccrush_thread writer;
+    struct ccrush_thread_args reader_args;
+    struct ccrush_thread_args writer_args;
+};
+
+/*
+ * Every queue can hold all of its chunks at once, so pushing never blocks. Returns non-zero if the pipeline was aborted.
+ */
+static int ccrush_pipeline_push(struct ccrush_pipeline* pipeline, struct ccrush_pipeline_queue* queue, struct ccrush_pipeline_chunk* chunk)
+{
+    ccrush_mutex_lock(&pipeline->mutex);
+
+    const int aborted = pipeline->aborted;
+
+    if (!aborted)
+    {
+        assert(queue->count < CCRUSH_PIPELINE_DEPTH);
+
+        queue->chunks[(queue->head + queue->count) % CCRUSH_PIPELINE_DEPTH] = chunk;
+        ++queue->count;
+
+        ccrush_cond_broadcast(&pipeline->cond);
+    }
+
+    ccrush_mutex_unlock(&pipeline->mutex);
+
+    return aborted;
+}
+
+/*
+ * Waits for the next chunk in the queue. Returns <c>NULL</c> if the pipeline was aborted.
+ */
+static struct ccrush_pipeline_chunk* ccrush_pipeline_pop(struct ccrush_pipeline* pipeline, struct ccrush_pipeline_queue* queue)
+{
+    struct ccrush_pipeline_chunk* chunk = NULL;
+
+    ccrush_mutex_lock(&pipeline->mutex);
+
+    while (queue->count == 0 && !pipeline->aborted)
+    {
+        ccrush_cond_wait(&pipeline->cond, &pipeline->mutex);
+    }
+
+    if (!pipeline->aborted)
+    {
+        chunk = queue->chunks[queue->head];
+        queue->head = (queue->head + 1) % CCRUSH_PIPELINE_DEPTH;
+        --queue->count;
+    }
+
+    ccrush_mutex_unlock(&pipeline->mutex);
+
+    return chunk;
+}
+
+static void ccrush_pipeline_abort(struct ccrush_pipeline* pipeline)
+{
+    ccrush_mutex_lock(&pipeline->mutex);
+    pipeline->aborted = 1;
+    ccrush_cond_broadcast(&pipeline->cond);
+    ccrush_mutex_unlock(&pipeline->mutex);
+}
+
+static void ccrush_pipeline_reader(void* arg)
+{
+    struct ccrush_pipeline* pipeline = (struct ccrush_pipeline*)arg;
+
+    for (;;)
+    {
+        struct ccrush_pipeline_chunk* chunk = ccrush_pipeline_pop(pipeline, &pipeline->free_input_chunks);
+        if (chunk == NULL)
+        {
+            return;
+        }
+
+        chunk->length = fread(chunk->data, sizeof(uint8_t), pipeline->buffersize, pipeline->input_file);
+        chunk->error = ferror(pipeline->input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : 0;
+        chunk->last = chunk->error || feof(pipeline->input_file);
+
+        if (ccrush_pipeline_push(pipeline, &pipeline->read_input_chunks, chunk) != 0 || chunk->last)
+        {
+            return;
+        }
+    }
+}
+
+static void ccrush_pipeline_writer(void* arg)
+{
+    struct ccrush_pipeline* pipeline = (struct ccrush_pipeline*)arg;
+
+    for (;;)
+    {
+        struct ccrush_pipeline_chunk* chunk = ccrush_pipeline_pop(pipeline, &pipeline->written_output_chunks);
+        if (chunk == NULL)
+        {
+            return;
+        }
+
+        if (fwrite(chunk->data, sizeof(uint8_t), chunk->length, pipeline->output_file) != chunk->length || ferror(pipeline->output_file))
+        {
+            pipeline->write_error = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            ccrush_pipeline_abort(pipeline);
+            return;
+        }
+
+        const int last = chunk->last;
+
+        if (ccrush_pipeline_push(pipeline, &pipeline->free_output_chunks, chunk) != 0 || last)
+        {
+            return;
+        }
+    }
+}
+
+/*
+ * Stops the pipeline (aborting it first if the codec failed) and releases its chunks.
+ * The writer is always joined before the reader is told to stop, so that a regular finish flushes all of the output.
+ */
+static void ccrush_pipeline_finish(struct ccrush_pipeline* pipeline, const int abort)
+{
+    if (abort)
+    {
+        ccrush_pipeline_abort(pipeline);
+    }
+
+    ccrush_thread_join(pipeline->writer);
+
+    // When decompressing, the reader might still be reading ahead past the end of the compressed stream.
+    ccrush_pipeline_abort(pipeline);
+    ccrush_thread_join(pipeline->reader);
+
+    for (int i = 0; i < CCRUSH_PIPELINE_DEPTH; ++i)
+    {
+        ccrush_scrub(pipeline->input_chunks[i].data, pipeline->buffersize, pipeline->scrub);
+        ccrush_scrub(pipeline->output_chunks[i].data, pipeline->buffersize, pipeline->scrub);
+
+        ccrush_allocator_free(pipeline->allocator, pipeline->input_chunks[i].data);
+        ccrush_allocator_free(pipeline->allocator, pipeline->output_chunks[i].data);
+    }
+
+    ccrush_cond_destroy(&pipeline->cond);
+    ccrush_mutex_destroy(&pipeline->mutex);
+}
+
+/*
+ * Allocates the chunks and starts the reader and writer threads.
+ * Returns non-zero (having cleaned up after itself) if that's not possible, in which case the caller should just fall back to the sequential code path.
+ */
+static int ccrush_pipeline_start(struct ccrush_pipeline* pipeline, const struct ccrush_allocator* allocator, const size_t buffersize, const int scrub, FILE* input_file, FILE* output_file)
+{
+    memset(pipeline, 0x00, sizeof(struct ccrush_pipeline));
+
+    pipeline->input_file = input_file;
+    pipeline->output_file = output_file;
+    pipeline->buffersize = buffersize;
+    pipeline->scrub = scrub;
+    pipeline->allocator = allocator;
+
+    for (int i = 0; i < CCRUSH_PIPELINE_DEPTH; ++i)
+    {
+        pipeline->input_chunks[i].data = ccrush_allocator_alloc(allocator, buffersize);
+        pipeline->output_chunks[i].data = ccrush_allocator_alloc(allocator, buffersize);
+
+        if (pipeline->input_chunks[i].data == NULL || pipeline->output_chunks[i].data == NULL)
+        {
+            goto error;
+        }
+
+        pipeline->free_input_chunks.chunks[i] = &pipeline->input_chunks[i];
+        pipeline->free_output_chunks.chunks[i] = &pipeline->output_chunks[i];
+    }
+
+    pipeline->free_input_chunks.count = CCRUSH_PIPELINE_DEPTH;
+    pipeline->free_output_chunks.count = CCRUSH_PIPELINE_DEPTH;
+
+    if (ccrush_mutex_init(&pipeline->mutex) != 0)
+    {
+        goto error;
+    }
+
+    if (ccrush_cond_init(&pipeline->cond) != 0)
+    {
+        ccrush_mutex_destroy(&pipeline->mutex);
+        goto error;
+    }
+
+    pipeline->reader_args.function = &ccrush_pipeline_reader;
+    pipeline->reader_args.job = pipeline;
+
+    pipeline->writer_args.function = &ccrush_pipeline_writer;
+    pipeline->writer_args.job = pipeline;
+
+    // The writer goes first: until the reader is started, no input has been consumed and the sequential path can still take over.
+    if (ccrush_thread_start(&pipeline->writer, &pipeline->writer_args) != 0)
+    {
+        ccrush_cond_destroy(&pipeline->cond);
+        ccrush_mutex_destroy(&pipeline->mutex);
+        goto error;
+    }
+
+    if (ccrush_thread_start(&pipeline->reader, &pipeline->reader_args) != 0)
+    {
+        ccrush_pipeline_abort(pipeline);
+        ccrush_thread_join(pipeline->writer);
+        ccrush_cond_destroy(&pipeline->cond);
+        ccrush_mutex_destroy(&pipeline->mutex);
+        goto error;
+    }
+
+    return 0;
+
+error:
+
+    for (int i = 0; i < CCRUSH_PIPELINE_DEPTH; ++i)
+    {
+        ccrush_allocator_free(pipeline->allocator, pipeline->input_chunks[i].data);
+        ccrush_allocator_free(pipeline->allocator, pipeline->output_chunks[i].data);
+    }
+
+    memset(pipeline, 0x00, sizeof(struct ccrush_pipeline));
+    return -1;
+}
+
+#ifdef CCRUSH_HAS_IO_URING
+
+/*
+ * io_uring engine for the FILE* based functions (compiled in with the CMake option ccrush_IO_URING).
+ * Keeps up to CCRUSH_URING_DEPTH reads and CCRUSH_URING_DEPTH writes in flight, so the kernel has a queue to work on while zlib crunches the previous chunks.
+ * Only used for regular files whose FILE* hasn't buffered anything ahead of the file descriptor's position; everything else (and any kernel that doesn't support it) goes through stdio.
+ * Talks to the kernel directly through the io_uring_setup/io_uring_enter syscalls, so there's no dependency on liburing.
+ */
+#define CCRUSH_URING_DEPTH 4
+
+struct ccrush_uring_buffer
+{
+    uint8_t* data;
+    size_t length;
+    uint64_t offset;
+    int write;
+    int in_flight;
+};
+
+struct ccrush_uring
+{
+    int ring_fd;
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+    int input_fd;
+    int output_fd;
+    size_t buffersize;
+    int scrub;
+    const struct ccrush_allocator* allocator;
+    uint64_t input_start;
+    uint64_t input_offset;
+    uint64_t input_end;
+    uint64_t output_offset;
+    uint64_t reads_issued;
+    uint64_t reads_consumed;
+    uint64_t writes_issued;
+    struct ccrush_uring_buffer reads[CCRUSH_URING_DEPTH];
+    struct ccrush_uring_buffer writes[CCRUSH_URING_DEPTH];
+    int error;
+};
+
+static int ccrush_uring_ring_init(struct ccrush_uring* uring)
+{
+    struct io_uring_params params;
+    memset(&params, 0x00, sizeof(params));
+
+    uring->ring_fd = (int)syscall(__NR_io_uring_setup, CCRUSH_URING_DEPTH * 2, &params);
+    if (uring->ring_fd < 0)
+    {
+        return -1;
+    }
+
+    // IORING_OP_READ/WRITE arrived in the same kernel release (5.6) as this feature flag.
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        goto error;
+    }
+
+    uring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        uring->sq_ring_size = uring->cq_ring_size = CCRUSH_MAX(uring->sq_ring_size, uring->cq_ring_size);
+    }
+
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED)
+    {
+        uring->sq_ring = NULL;
+        goto error;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        uring->cq_ring = uring->sq_ring;
+    }
+    else
+    {
+        uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_CQ_RING);
+        if (uring->cq_ring == MAP_FAILED)
+        {
+            uring->cq_ring = NULL;
+            goto error;
+        }
+    }
+
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+    if (uring->sqes == MAP_FAILED)
+    {
+        uring->sqes = NULL;
+        goto error;
+    }
+
+    uring->sq_tail = (unsigned*)((uint8_t*)uring->sq_ring + params.sq_off.tail);
+    uring->sq_mask = (unsigned*)((uint8_t*)uring->sq_ring + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned*)((uint8_t*)uring->sq_ring + params.sq_off.array);
+    uring->cq_head = (unsigned*)((uint8_t*)uring->cq_ring + params.cq_off.head);
+    uring->cq_tail = (unsigned*)((uint8_t*)uring->cq_ring + params.cq_off.tail);
+    uring->cq_mask = (unsigned*)((uint8_t*)uring->cq_ring + params.cq_off.ring_mask);
+    uring->cqes = (struct io_uring_cqe*)((uint8_t*)uring->cq_ring + params.cq_off.cqes);
+
+    return 0;
+
+error:
+
+    if (uring->sq_ring != NULL)
+    {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    }
+
+    if (uring->cq_ring != NULL && uring->cq_ring != uring->sq_ring)
+    {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+
+    close(uring->ring_fd);
+    return -1;
+}
+
+static void ccrush_uring_ring_free(struct ccrush_uring* uring)
+{
+    munmap(uring->sqes, uring->sqes_size);
+
+    if (uring->cq_ring != uring->sq_ring)
+    {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+
+    munmap(uring->sq_ring, uring->sq_ring_size);
+    close(uring->ring_fd);
+}
+
+/*
+ * Queues a read or write of the passed buffer and submits it right away.
+ * There are never more than CCRUSH_URING_DEPTH * 2 operations in flight, so the submission queue can't overflow.
+ */
+static int ccrush_uring_submit(struct ccrush_uring* uring, struct ccrush_uring_buffer* buffer)
+{
+    const unsigned tail = *uring->sq_tail;
+    const unsigned index = tail & *uring->sq_mask;
+
+    struct io_uring_sqe* sqe = &uring->sqes[index];
+    memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+
+    sqe->opcode = buffer->write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = buffer->write ? uring->output_fd : uring->input_fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer->data;
+    sqe->len = (uint32_t)buffer->length;
+    sqe->off = buffer->offset;
+    sqe->user_data = (uint64_t)(uintptr_t)buffer;
+
+    uring->sq_array[index] = index;
+    __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    buffer->in_flight = 1;
+
+    int r;
+
+    do
+    {
+        r = (int)syscall(__NR_io_uring_enter, uring->ring_fd, 1, 0, 0, NULL, 0);
+    } while (r < 0 && errno == EINTR);
+
+    if (r != 1)
+    {
+        // Nothing was submitted, so take the entry back.
+        __atomic_store_n(uring->sq_tail, tail, __ATOMIC_RELEASE);
+        buffer->in_flight = 0;
+        uring->error = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Waits for the next completion and finishes off the operation it belongs to.
+ * Short transfers (rare for regular files, but allowed) are completed synchronously.
+ */
+static int ccrush_uring_reap(struct ccrush_uring* uring)
+{
+    unsigned head = *uring->cq_head;
+
+    while (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        if (syscall(__NR_io_uring_enter, uring->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+        {
+            uring->error = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            return -1;
+        }
+    }
+
+    const struct io_uring_cqe* cqe = &uring->cqes[head & *uring->cq_mask];
+
+    struct ccrush_uring_buffer* buffer = (struct ccrush_uring_buffer*)(uintptr_t)cqe->user_data;
+    const int result = cqe->res;
+
+    __atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    buffer->in_flight = 0;
+
+    if (result < 0)
+    {
+        uring->error = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        return -1;
+    }
+
+    size_t done = (size_t)result;
+
+    while (done < buffer->length)
+    {
+        const ssize_t n = buffer->write ? pwrite(uring->output_fd, buffer->data + done, buffer->length - done, (off_t)(buffer->offset + done)) : pread(uring->input_fd, buffer->data + done, buffer->length - done, (off_t)(buffer->offset + done));
+
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (n < 0 || (n == 0 && buffer->write))
+        {
+            uring->error = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            return -1;
+        }
+
+        if (n == 0) // The input file shrank in the meantime.
+        {
+            buffer->length = done;
+            break;
+        }
+
+        done += (size_t)n;
+    }
+
+    return 0;
+}
+
+/*
+ * Keeps the read queue full (up to the input file's size as of ccrush_uring_start()).
+ */
+static int ccrush_uring_issue_reads(struct ccrush_uring* uring)
+{
+    while (uring->reads_issued - uring->reads_consumed < CCRUSH_URING_DEPTH && uring->input_offset < uring->input_end)
+    {
+        struct ccrush_uring_buffer* buffer = &uring->reads[uring->reads_issued % CCRUSH_URING_DEPTH];
+
+        buffer->offset = uring->input_offset;
+        buffer->length = (size_t)CCRUSH_MIN((uint64_t)uring->buffersize, uring->input_end - uring->input_offset);
+
+        if (ccrush_uring_submit(uring, buffer) != 0)
+        {
+            return -1;
+        }
+
+        uring->input_offset += buffer->length;
+        ++uring->reads_issued;
+    }
+
+    return 0;
+}
+
+/*
+ * Gets the next chunk of input (in order), waiting for its read to complete if necessary.
+ * Returns <c>NULL</c> at the end of the input, and on failure (with uring->error set).
+ */
+static struct ccrush_uring_buffer* ccrush_uring_next_read(struct ccrush_uring* uring)
+{
+    if (uring->reads_consumed == uring->reads_issued)
+    {
+        return NULL;
+    }
+
+    struct ccrush_uring_buffer* buffer = &uring->reads[uring->reads_consumed % CCRUSH_URING_DEPTH];
+
+    while (buffer->in_flight)
+    {
+        if (ccrush_uring_reap(uring) != 0)
+        {
+            return NULL;
+        }
+    }
+
+    return buffer;
+}
+
+/*
+ * Hands the chunk returned by ccrush_uring_next_read() back for the next read.
+ */
+static int ccrush_uring_release_read(struct ccrush_uring* uring)
+{
+    ++uring->reads_consumed;
+    return ccrush_uring_issue_reads(uring);
+}
+
+/*
+ * Whether the chunk returned by ccrush_uring_next_read() is the last one.
+ */
+static inline int ccrush_uring_at_last_read(const struct ccrush_uring* uring)
+{
+    return uring->reads_consumed + 1 == uring->reads_issued && uring->input_offset == uring->input_end;
+}
+
+/*
+ * Gets the next output buffer to fill, waiting for its previous write to complete if necessary.
+ */
+static struct ccrush_uring_buffer* ccrush_uring_next_write(struct ccrush_uring* uring)
+{
+    struct ccrush_uring_buffer* buffer = &uring->writes[uring->writes_issued % CCRUSH_URING_DEPTH];
+
+    while (buffer->in_flight)
+    {
+        if (ccrush_uring_reap(uring) != 0)
+        {
+            return NULL;
+        }
+    }
+
+    return buffer;
+}
+
+static int ccrush_uring_write(struct ccrush_uring* uring, struct ccrush_uring_buffer* buffer, const size_t length)
+{
+    if (length == 0)
+    {
+        return 0;
+    }
+
+    buffer->offset = uring->output_offset;
+    buffer->length = length;
+
+    if (ccrush_uring_submit(uring, buffer) != 0)
+    {
+        return -1;
+    }
+
+    uring->output_offset += length;
+    ++uring->writes_issued;
+
+    return 0;
+}
+
+/*
+ * Checks whether the engine can take over the passed files and sets it up if so.
+ * Returns non-zero (having cleaned up after itself) if it can't, in which case the caller falls back to stdio.
+ */
+static int ccrush_uring_start(struct ccrush_uring* uring, const struct ccrush_allocator* allocator, const size_t buffersize, const int scrub, FILE* input_file, FILE* output_file)
+{
+    memset(uring, 0x00, sizeof(struct ccrush_uring));
+
+    uring->input_fd = fileno(input_file);
+    uring->output_fd = fileno(output_file);
+    uring->buffersize = buffersize;
+    uring->scrub = scrub;
+    uring->allocator = allocator;
+
+    struct stat input_stat;
+    struct stat output_stat;
+
+    if (uring->input_fd < 0 || uring->output_fd < 0 || fstat(uring->input_fd, &input_stat) != 0 || fstat(uring->output_fd, &output_stat) != 0 || !S_ISREG(input_stat.st_mode) || !S_ISREG(output_stat.st_mode))
+    {
+        return -1;
+    }
+
+    // Writes are issued at explicit offsets, which O_APPEND would ignore.
+    const int output_flags = fcntl(uring->output_fd, F_GETFL);
+    if (output_flags < 0 || (output_flags & O_APPEND))
+    {
+        return -1;
+    }
+
+    // If stdio has already buffered input ahead of the descriptor's position, that data would be skipped.
+    const off_t input_position = ftello(input_file);
+    if (input_position < 0 || input_position != lseek(uring->input_fd, 0, SEEK_CUR))
+    {
+        return -1;
+    }
+
+    if (fflush(output_file) != 0)
+    {
+        return -1;
+    }
+
+    const off_t output_position = ftello(output_file);
+    if (output_position < 0)
+    {
+        return -1;
+    }
+
+    uring->input_start = uring->input_offset = (uint64_t)input_position;
+    uring->input_end = CCRUSH_MAX((uint64_t)input_position, (uint64_t)input_stat.st_size);
+    uring->output_offset = (uint64_t)output_position;
+
+    for (int i = 0; i < CCRUSH_URING_DEPTH; ++i)
+    {
+        uring->reads[i].data = ccrush_allocator_alloc(allocator, buffersize);
+        uring->writes[i].data = ccrush_allocator_alloc(allocator, buffersize);
+        uring->writes[i].write = 1;
+
+        if (uring->reads[i].data == NULL || uring->writes[i].data == NULL)
+        {
+            goto error;
+        }
+    }
+
+    if (ccrush_uring_ring_init(uring) != 0)
+    {
+        goto error;
+    }
+
+    if (ccrush_uring_issue_reads(uring) != 0)
+    {
+        // Submitting doesn't work after all (e.g. blocked by a seccomp filter): nothing was read yet, so stdio can still take over.
+        ccrush_uring_ring_free(uring);
+        goto error;
+    }
+
+    return 0;
+
+error:
+
+    for (int i = 0; i < CCRUSH_URING_DEPTH; ++i)
+    {
+        ccrush_allocator_free(uring->allocator, uring->reads[i].data);
+        ccrush_allocator_free(uring->allocator, uring->writes[i].data);
+    }
+
+    memset(uring, 0x00, sizeof(struct ccrush_uring));
+    return -1;
+}
+
+/*
+ * Waits for all operations that are still in flight, tears the engine down and leaves both FILE* positioned right after the data that was consumed/written.
+ * Returns the first I/O error that occurred (if any).
+ */
+static int ccrush_uring_finish(struct ccrush_uring* uring, FILE* input_file, FILE* output_file, const uint64_t input_consumed_end)
+{
+    for (int i = 0; i < CCRUSH_URING_DEPTH; ++i)
+    {
+        while (uring->reads[i].in_flight || uring->writes[i].in_flight)
+        {
+            if (ccrush_uring_reap(uring) != 0 && (uring->reads[i].in_flight || uring->writes[i].in_flight))
+            {
+                // The ring itself failed: there's no way to know when the kernel is done with the buffers, so they have to be leaked.
+                ccrush_uring_ring_free(uring);
+                return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            }
+        }
+    }
+
+    ccrush_uring_ring_free(uring);
+
+    for (int i = 0; i < CCRUSH_URING_DEPTH; ++i)
+    {
+        ccrush_scrub(uring->reads[i].data, uring->buffersize, uring->scrub);
+        ccrush_scrub(uring->writes[i].data, uring->buffersize, uring->scrub);
+
+        ccrush_allocator_free(uring->allocator, uring->reads[i].data);
+        ccrush_allocator_free(uring->allocator, uring->writes[i].data);
+    }
+
+    fseeko(input_file, (off_t)input_consumed_end, SEEK_SET);
+    fseeko(output_file, (off_t)uring->output_offset, SEEK_SET);
+
+    return uring->error;
+}
+
+#endif
+
+/*
+ * Writes the 2-byte zlib stream header (RFC 1950) that deflateInit() would emit for the given compression level.
+ */
+static inline void ccrush_write_zlib_header(uint8_t header[2], const int level)
+{
+    const int level_flags = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    const unsigned int h = (((Z_DEFLATED + ((MAX_WBITS - 8) << 4)) << 8) | (level_flags << 6));
+
+    header[0] = (uint8_t)(h >> 8);
+    header[1] = (uint8_t)((h + 31 - (h % 31)) & 0xFF);
+}
+
+/*
+ * Writes the 4-byte zlib stream trailer (big-endian Adler-32 checksum of the uncompressed data).
+ */
+static inline void ccrush_write_zlib_trailer(uint8_t trailer[4], const uLong adler)
+{
+    trailer[0] = (uint8_t)(adler >> 24);
+    trailer[1] = (uint8_t)(adler >> 16);
+    trailer[2] = (uint8_t)(adler >> 8);
+    trailer[3] = (uint8_t)(adler);
+}
+
+/*
+ * One unit of work for the block-parallel compressors: a raw deflate of one input block,
+ * primed with a preset dictionary and terminated with either a sync flush or (for the very last block) Z_FINISH.
+ * The outputs of consecutive blocks can simply be concatenated and wrapped into a zlib header + trailer.
+ */
+struct ccrush_deflate_block
+{
+    z_stream stream;
+    int stream_initialized;
+    int level;
+    int last;
+    const uint8_t* input;
+    size_t input_length;
+    const uint8_t* dictionary;
+    size_t dictionary_length;
+    uint8_t* output;
+    size_t output_capacity;
+    size_t output_length;
+    uLong adler;
+    int r;
+};
+
+static inline size_t ccrush_deflate_block_bound(const size_t input_length)
+{
+    // Sync flushes append an empty stored block (5 bytes) on top of the usual worst case.
+    return (size_t)compressBound((uLong)input_length) + 64;
+}
+
+static void ccrush_deflate_block_job(void* job)
+{
+    struct ccrush_deflate_block* block = (struct ccrush_deflate_block*)job;
+
+    if (!block->stream_initialized)
+    {
+        ccrush_zstream_setup(&block->stream, &ccrush_global_allocator);
+    }
+
+    int r = block->stream_initialized ? deflateReset(&block->stream) : deflateInit2(&block->stream, block->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    block->stream_initialized = 1;
+
+    if (block->dictionary_length != 0)
+    {
+        r = deflateSetDictionary(&block->stream, block->dictionary, (uInt)block->dictionary_length);
+        if (r != Z_OK)
+        {
+            goto exit;
+        }
+    }
+
+    assert(block->input_length <= UINT32_MAX && block->output_capacity <= UINT32_MAX);
+
+    block->stream.next_in = (Bytef*)block->input;
+    block->stream.avail_in = (uInt)block->input_length;
+    block->stream.next_out = block->output;
+    block->stream.avail_out = (uInt)block->output_capacity;
+
+    r = deflate(&block->stream, block->last ? Z_FINISH : Z_SYNC_FLUSH);
+
+    if (r != (block->last ? Z_STREAM_END : Z_OK) || block->stream.avail_in != 0 || block->stream.avail_out == 0)
+    {
+        r = r == Z_STREAM_ERROR ? r : Z_BUF_ERROR;
+        goto exit;
+    }
+
+    r = 0;
+    block->output_length = block->output_capacity - block->stream.avail_out;
+    block->adler = adler32_z(adler32(0L, Z_NULL, 0), block->input, (z_size_t)block->input_length);
+
+exit:
+    block->r = r;
+}
+
+static void ccrush_deflate_block_free(struct ccrush_deflate_block* block)
+{
+    if (block->stream_initialized)
+    {
+        deflateEnd(&block->stream);
+    }
+
+    memset(&block->stream, 0x00, sizeof(block->stream));
+    block->stream_initialized = 0;
+}
+
+static inline void ccrush_store_u64le(uint8_t* out, const uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static inline uint64_t ccrush_load_u64le(const uint8_t* in)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        value |= ((uint64_t)in[i]) << (8 * i);
+    }
+
+    return value;
+}
+
+static inline void ccrush_write_size_header(uint8_t header[CCRUSH_SIZE_HEADER_LENGTH], const uint64_t uncompressed_length)
+{
+    memcpy(header, CCRUSH_SIZE_HEADER_MAGIC, 4);
+    ccrush_store_u64le(header + 4, uncompressed_length);
+}
+
+static inline int ccrush_has_size_header(const uint8_t* data, const size_t data_length)
+{
+    return data_length > CCRUSH_SIZE_HEADER_LENGTH && memcmp(data, CCRUSH_SIZE_HEADER_MAGIC, 4) == 0;
+}
+
+static inline uint64_t ccrush_read_size_header(const uint8_t header[CCRUSH_SIZE_HEADER_LENGTH])
+{
+    return ccrush_load_u64le(header + 4);
+}
+
+static inline unsigned int ccrush_get_buffersize(const uint32_t buffer_size_kib)
+{
+    assert(sizeof(uint8_t) == 1);
+    const size_t buffer_size_b = ((size_t)buffer_size_kib) * 1024;
+    return (unsigned int)(buffer_size_b ? buffer_size_b : CCRUSH_DEFAULT_CHUNKSIZE);
+}
+
+static int ccrush_fopen_pair(const char* input_file_path, const char* output_file_path, FILE** input_file, FILE** output_file)
+{
+    *input_file = ccrush_fopen(input_file_path, "rb");
+    *output_file = ccrush_fopen(output_file_path, "wb");
+
+    if (*input_file == NULL || *output_file == NULL)
+    {
+        if (*input_file != NULL)
+        {
+            fclose(*input_file);
+        }
+
+        if (*output_file != NULL)
+        {
+            fclose(*output_file);
+        }
+
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return 0;
+}
+
+/*
+ * Adaptive compression (see ccrush_set_adaptive_compression()): blocks of input whose byte entropy (estimated from a strided sample)
+ * is at least this many bits per byte are stored instead of compressed. Deflate's Huffman coding can't gain more than a couple of percent on those,
+ * and anything it could still find on top of that (repeated strings in near-random data) is rare enough to not be worth burning a full compression pass on.
+ */
+#define CCRUSH_ADAPTIVE_ENTROPY_THRESHOLD 7.8
+
+/*
+ * How many bytes of each input block are sampled for its entropy estimate. Even uniformly random data
+ * only comes out at ~7.95 bits per byte from a sample this small, hence the minimum block size (smaller blocks keep the previous block's decision).
+ */
+#define CCRUSH_ADAPTIVE_SAMPLE_SIZE (1024 * 8)
+#define CCRUSH_ADAPTIVE_MIN_BLOCK_SIZE (1024 * 4)
+
+static int ccrush_adaptive_compression = 0;
+
+/*
+ * log2(x) for x >= 1 without pulling in libm: the integer part is the highest set bit,
+ * the fractional part is computed bit by bit by repeatedly squaring the mantissa (12 bits are plenty for an entropy estimate).
+ */
+static double ccrush_log2(const uint32_t x)
+{
+    int e = 0;
+
+    while ((x >> e) > 1)
+    {
+        ++e;
+    }
+
+    double mantissa = (double)x / (double)((uint32_t)1 << e);
+    double result = (double)e;
+    double bit = 0.5;
+
+    for (int i = 0; i < 12; ++i, bit *= 0.5)
+    {
+        mantissa *= mantissa;
+
+        if (mantissa >= 2.0)
+        {
+            mantissa *= 0.5;
+            result += bit;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Estimates the Shannon entropy (in bits per byte) of a block of data from a strided sample of it.
+ */
+static double ccrush_estimate_entropy(const uint8_t* data, const size_t length)
+{
+    uint32_t histogram[256] = { 0 };
+
+    const size_t stride = length > CCRUSH_ADAPTIVE_SAMPLE_SIZE ? length / CCRUSH_ADAPTIVE_SAMPLE_SIZE : 1;
+
+    uint32_t n = 0;
+
+    for (size_t i = 0; i < length; i += stride, ++n)
+    {
+        ++histogram[data[i]];
+    }
+
+    // H = -sum(p * log2(p)) = log2(n) - sum(c * log2(c)) / n
+    double sum = 0.0;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        if (histogram[i] > 1)
+        {
+            sum += histogram[i] * ccrush_log2(histogram[i]);
+        }
+    }
+
+    return n != 0 ? ccrush_log2(n) - sum / n : 0.0;
+}
+
+/*
+ * Everything a (de)compression call needs besides its input and output: the z_streams, the I/O buffers and the growable output buffer.
+ * Each of these is only set up when first needed, and then reused (z_streams via deflateReset()/inflateReset()) for as long as the context lives.
+ * The one-shot public functions use a short-lived context on the stack (or the calling thread's cached one, see ccrush_thread_cache_enable());
+ * the ccrush_ctx_* functions use a long-lived one.
+ */
+struct ccrush_ctx
+{
+    unsigned int buffersize;
+    uint8_t* input_buffer;
+    uint8_t* output_buffer;
+    z_stream deflate_stream;
+    int deflate_initialized;
+    int deflate_level;
+    int deflate_window_bits;
+    int deflate_mem_level;
+    int deflate_strategy;
+    int deflate_current_level;
+    int deflate_target_level;
+    z_stream inflate_stream;
+    int inflate_initialized;
+    struct ccrush_growbuf output;
+    int scrub;
+    int adaptive;
+    const uint8_t* dictionary;
+    size_t dictionary_length;
+    uLong dictionary_id;
+    uint8_t* owned_dictionary;
+    int window_bits;
+    int mem_level;
+    int strategy;
+    ccrush_stats* stats;
+    uint64_t stats_start_ns;
+    struct ccrush_allocator allocator;
+#ifdef CCRUSH_LIBDEFLATE
+    struct libdeflate_compressor* libdeflate_compressor;
+    int libdeflate_level;
+    struct libdeflate_decompressor* libdeflate_decompressor;
+#endif
+};
+
+/*
+ * Maps a compression profile's window size and header type onto the windowBits argument of deflateInit2()/inflateInit2(): negative for raw deflate, +16 for gzip.
+ */
+static inline int ccrush_params_window_bits(const ccrush_params* params)
+{
+    const int window_bits = params->window_bits != 0 ? params->window_bits : MAX_WBITS;
+
+    switch (params->header)
+    {
+        case CCRUSH_HEADER_GZIP:
+            return window_bits + 16;
+        case CCRUSH_HEADER_RAW:
+            return -window_bits;
+        default:
+            return window_bits;
+    }
+}
+
+static inline int ccrush_params_invalid(const ccrush_params* params)
+{
+    if (params == NULL)
+    {
+        return 1;
+    }
+
+    const int window_bits_invalid = params->window_bits != 0 && (params->window_bits < 9 || params->window_bits > MAX_WBITS);
+    const int mem_level_invalid = params->mem_level < 0 || params->mem_level > MAX_MEM_LEVEL;
+
+    return window_bits_invalid || mem_level_invalid || params->strategy < CCRUSH_STRATEGY_DEFAULT || params->strategy > CCRUSH_STRATEGY_FIXED || params->header < CCRUSH_HEADER_ZLIB || params->header > CCRUSH_HEADER_RAW;
+}
+
+/*
+ * Sets the window size, memory level, strategy and header type that the context's streams use from their next (re)initialization on. Pass NULL for zlib's defaults.
+ * The level isn't part of this: every call passes its own.
+ */
+static inline void ccrush_ctx_use_params(ccrush_ctx* ctx, const ccrush_params* params)
+{
+    if (params == NULL)
+    {
+        ctx->window_bits = MAX_WBITS;
+        ctx->mem_level = 8;
+        ctx->strategy = Z_DEFAULT_STRATEGY;
+        return;
+    }
+
+    ctx->window_bits = ccrush_params_window_bits(params);
+    ctx->mem_level = params->mem_level != 0 ? params->mem_level : 8;
+    ctx->strategy = params->strategy;
+}
+
+/*
+ * Only zlib streams can carry a preset dictionary ID or be prefixed with a size header.
+ */
+static inline int ccrush_ctx_is_zlib(const ccrush_ctx* ctx)
+{
+    return ctx->window_bits > 0 && ctx->window_bits <= MAX_WBITS;
+}
+
+static inline int ccrush_ctx_has_default_params(const ccrush_ctx* ctx)
+{
+    return ctx->window_bits == MAX_WBITS && ctx->mem_level == 8 && ctx->strategy == Z_DEFAULT_STRATEGY;
+}
+
+static inline int ccrush_ctx_has_size_header(const ccrush_ctx* ctx, const uint8_t* data, const size_t data_length)
+{
+    return ccrush_ctx_is_zlib(ctx) && ccrush_has_size_header(data, data_length);
+}
+
+static inline void ccrush_ctx_setup(ccrush_ctx* ctx, const uint32_t buffer_size_kib)
+{
+    memset(ctx, 0x00, sizeof(ccrush_ctx));
+    ctx->buffersize = ccrush_get_buffersize(buffer_size_kib);
+    ctx->scrub = ccrush_scrub_buffers;
+    ctx->adaptive = ccrush_adaptive_compression;
+    ctx->allocator = ccrush_global_allocator;
+    ccrush_ctx_use_params(ctx, NULL);
+}
+
+static void ccrush_ctx_free_buffers(ccrush_ctx* ctx)
+{
+    if (ctx->input_buffer != NULL)
+    {
+        ccrush_scrub(ctx->input_buffer, ctx->buffersize, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, ctx->input_buffer);
+        ctx->input_buffer = NULL;
+    }
+
+    if (ctx->output_buffer != NULL)
+    {
+        ccrush_scrub(ctx->output_buffer, ctx->buffersize, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, ctx->output_buffer);
+        ctx->output_buffer = NULL;
+    }
+
+    if (ctx->output.array != NULL)
+    {
+        ccrush_scrub(ctx->output.array, ctx->output.length, ctx->scrub);
+        ccrush_growbuf_free(&ctx->output);
+    }
+}
+
+static void ccrush_ctx_teardown(ccrush_ctx* ctx)
+{
+    if (ctx->deflate_initialized)
+    {
+        deflateEnd(&ctx->deflate_stream);
+    }
+
+    if (ctx->inflate_initialized)
+    {
+        inflateEnd(&ctx->inflate_stream);
+    }
+
+#ifdef CCRUSH_LIBDEFLATE
+    if (ctx->libdeflate_compressor != NULL)
+    {
+        libdeflate_free_compressor(ctx->libdeflate_compressor);
+    }
+
+    if (ctx->libdeflate_decompressor != NULL)
+    {
+        libdeflate_free_decompressor(ctx->libdeflate_decompressor);
+    }
+#endif
+
+    ccrush_ctx_free_buffers(ctx);
+
+    if (ctx->owned_dictionary != NULL)
+    {
+        ccrush_scrub(ctx->owned_dictionary, ctx->dictionary_length, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, ctx->owned_dictionary);
+    }
+
+    memset(ctx, 0x00, sizeof(ccrush_ctx));
+}
+
+/*
+ * Sets the preset dictionary that the context's streams use (without copying it!). Pass NULL to stop using one.
+ * Its ID is the Adler-32 checksum that deflate writes into the zlib header and that inflate asks for in return.
+ */
+static inline void ccrush_ctx_use_dictionary(ccrush_ctx* ctx, const uint8_t* dictionary, const size_t dictionary_length)
+{
+    ctx->dictionary = dictionary;
+    ctx->dictionary_length = dictionary != NULL ? dictionary_length : 0;
+    ctx->dictionary_id = dictionary != NULL ? adler32_z(adler32(0L, Z_NULL, 0), dictionary, (z_size_t)dictionary_length) : 0;
+}
+
+static inline int ccrush_dictionary_args_invalid(const uint8_t* dictionary, const size_t dictionary_length)
+{
+    return (dictionary == NULL) != (dictionary_length == 0) || dictionary_length > UINT_MAX;
+}
+
+static inline void ccrush_ctx_set_buffersize(ccrush_ctx* ctx, const uint32_t buffer_size_kib)
+{
+    const unsigned int buffersize = ccrush_get_buffersize(buffer_size_kib);
+
+    if (ctx->buffersize != buffersize)
+    {
+        ccrush_ctx_free_buffers(ctx);
+        ctx->buffersize = buffersize;
+    }
+}
+
+static uint64_t ccrush_now_ns()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/*
+ * Starts a new call on the context: its stats (if it has any) are zeroed, so that they only describe this call.
+ */
+static inline void ccrush_ctx_stats_begin(ccrush_ctx* ctx)
+{
+    if (ctx->stats != NULL)
+    {
+        memset(ctx->stats, 0x00, sizeof(ccrush_stats));
+        ctx->stats_start_ns = ccrush_now_ns();
+    }
+}
+
+static inline uint64_t ccrush_ctx_stats_clock(const ccrush_ctx* ctx)
+{
+    return ctx->stats != NULL ? ccrush_now_ns() : 0;
+}
+
+static inline void ccrush_ctx_stats_codec(ccrush_ctx* ctx, const uint64_t start, const uint64_t bytes_in, const uint64_t bytes_out)
+{
+    if (ctx->stats != NULL)
+    {
+        ctx->stats->codec_ns += ccrush_now_ns() - start;
+        ctx->stats->codec_calls++;
+        ctx->stats->bytes_in += bytes_in;
+        ctx->stats->bytes_out += bytes_out;
+    }
+}
+
+static inline void ccrush_ctx_stats_io(ccrush_ctx* ctx, const uint64_t start)
+{
+    if (ctx->stats != NULL)
+    {
+        ctx->stats->io_ns += ccrush_now_ns() - start;
+    }
+}
+
+/*
+ * With pipelined I/O and io_uring, reading and writing happen concurrently with the codec:
+ * whatever part of the call wasn't spent inside the codec was spent waiting for the I/O.
+ */
+static inline void ccrush_ctx_stats_io_wait(ccrush_ctx* ctx)
+{
+    if (ctx->stats != NULL)
+    {
+        const uint64_t elapsed = ccrush_now_ns() - ctx->stats_start_ns;
+        ctx->stats->io_ns = elapsed > ctx->stats->codec_ns ? elapsed - ctx->stats->codec_ns : 0;
+    }
+}
+
+/*
+ * Accounts for a buffer of the passed capacity that the call (de)compresses into (pass a non-zero growth if it was just reallocated to that capacity).
+ */
+static inline void ccrush_ctx_stats_buffer(ccrush_ctx* ctx, const size_t capacity, const int growth)
+{
+    if (ctx->stats != NULL)
+    {
+        ctx->stats->buffer_growths += growth != 0;
+        ctx->stats->peak_buffer_bytes = CCRUSH_MAX(ctx->stats->peak_buffer_bytes, (uint64_t)capacity);
+    }
+}
+
+#if defined(_MSC_VER)
+#define CCRUSH_THREAD_LOCAL __declspec(thread)
+#else
+#define CCRUSH_THREAD_LOCAL _Thread_local
+#endif
+
+#ifndef CCRUSH_THREAD_CACHE
+#define CCRUSH_THREAD_CACHE 0
+#endif
+
+/*
+ * Don't keep more than this much growable output buffer memory (in bytes) around in a thread's cache after a call
+ * (otherwise a single large ccrush_decompress() would pin that much memory for the rest of the thread's life).
+ */
+#define CCRUSH_THREAD_CACHE_MAX_RETAINED_OUTPUT (1024 * 1024 * 4)
+
+static int ccrush_thread_cache_enabled = CCRUSH_THREAD_CACHE;
+
+static CCRUSH_THREAD_LOCAL ccrush_ctx ccrush_thread_cache;
+
+static CCRUSH_THREAD_LOCAL ccrush_stats* ccrush_thread_stats;
+
+/*
+ * Gets the context that a one-shot public function should run on:
+ * the calling thread's cached one if the thread cache is enabled, or else the passed (short-lived) stack context.
+ * Hand it back using ccrush_ctx_release() when done.
+ */
+static inline ccrush_ctx* ccrush_ctx_acquire(ccrush_ctx* stack_ctx)
+{
+    ccrush_ctx* ctx = &ccrush_thread_cache;
+
+    if (!ccrush_thread_cache_enabled)
+    {
+        ctx = stack_ctx;
+        memset(ctx, 0x00, sizeof(ccrush_ctx));
+    }
+
+    // A thread's cached context sticks with the allocator it was first set up with (for as long as it holds any memory).
+    if (ctx->allocator.alloc == NULL)
+    {
+        ctx->allocator = ccrush_global_allocator;
+    }
+
+    ctx->scrub = ccrush_scrub_buffers;
+    ctx->adaptive = ccrush_adaptive_compression;
+    ctx->stats = ccrush_thread_stats;
+    ccrush_ctx_use_params(ctx, NULL);
+
+    ccrush_ctx_stats_begin(ctx);
+    return ctx;
+}
+
+static inline void ccrush_ctx_release(ccrush_ctx* ctx)
+{
+    if (ctx != &ccrush_thread_cache)
+    {
+        ccrush_ctx_teardown(ctx);
+        return;
+    }
+
+    ccrush_ctx_use_dictionary(ctx, NULL, 0);
+    ctx->stats = NULL;
+
+    if (ctx->output.capacity > CCRUSH_THREAD_CACHE_MAX_RETAINED_OUTPUT)
+    {
+        ccrush_scrub(ctx->output.array, ctx->output.length, ctx->scrub);
+        ccrush_growbuf_free(&ctx->output);
+    }
+}
+
+static int ccrush_ctx_get_deflate_stream(ccrush_ctx* ctx, const int level, z_stream** out_stream)
+{
+    // A stream that adaptive compression left at level 0 is re-initialized too: deflateReset() keeps the level, and deflateParams() on a fresh stream isn't safe with every zlib version.
+    if (ctx->deflate_initialized && (ctx->deflate_level != level || ctx->deflate_current_level != level || ctx->deflate_window_bits != ctx->window_bits || ctx->deflate_mem_level != ctx->mem_level || ctx->deflate_strategy != ctx->strategy))
+    {
+        deflateEnd(&ctx->deflate_stream);
+        ctx->deflate_initialized = 0;
+    }
+
+    int r;
+
+    if (ctx->deflate_initialized)
+    {
+        r = deflateReset(&ctx->deflate_stream);
+    }
+    else
+    {
+        ccrush_zstream_setup(&ctx->deflate_stream, &ctx->allocator);
+        r = deflateInit2(&ctx->deflate_stream, level, Z_DEFLATED, ctx->window_bits, ctx->mem_level, ctx->strategy);
+    }
+
+    if (r != Z_OK)
+    {
+        return r;
+    }
+
+    ctx->deflate_initialized = 1;
+    ctx->deflate_level = level;
+    ctx->deflate_current_level = level;
+    ctx->deflate_target_level = level;
+    ctx->deflate_window_bits = ctx->window_bits;
+    ctx->deflate_mem_level = ctx->mem_level;
+    ctx->deflate_strategy = ctx->strategy;
+
+    if (ctx->dictionary != NULL)
+    {
+        r = deflateSetDictionary(&ctx->deflate_stream, ctx->dictionary, (uInt)ctx->dictionary_length);
+        if (r != Z_OK)
+        {
+            return r;
+        }
+    }
+
+    *out_stream = &ctx->deflate_stream;
+    return 0;
+}
+
+static int ccrush_ctx_get_inflate_stream(ccrush_ctx* ctx, z_stream** out_stream)
+{
+    int r;
+
+    if (ctx->inflate_initialized)
+    {
+        r = inflateReset2(&ctx->inflate_stream, ctx->window_bits);
+    }
+    else
+    {
+        ccrush_zstream_setup(&ctx->inflate_stream, &ctx->allocator);
+        r = inflateInit2(&ctx->inflate_stream, ctx->window_bits);
+    }
+
+    if (r != Z_OK)
+    {
+        return r;
+    }
+
+    ctx->inflate_initialized = 1;
+
+    // Raw deflate has no header that could ask for the dictionary (Z_NEED_DICT): it has to be there from the start.
+    if (ctx->dictionary != NULL && ctx->window_bits < 0)
+    {
+        r = inflateSetDictionary(&ctx->inflate_stream, ctx->dictionary, (uInt)ctx->dictionary_length);
+        if (r != Z_OK)
+        {
+            return r;
+        }
+    }
+
+    *out_stream = &ctx->inflate_stream;
+    return 0;
+}
+
+/*
+ * Adaptive compression: picks the level for the next block of input that's about to be fed into the context's deflate stream.
+ * Blocks that look incompressible (already compressed media, encrypted data, ...) are stored; everything else gets the requested level.
+ * The actual switch happens in ccrush_ctx_deflate(), which is where there's room in the output buffer for deflateParams() to work with.
+ */
+static void ccrush_ctx_adapt(ccrush_ctx* ctx, const uint8_t* data, const size_t length)
+{
+    if (!ctx->adaptive || ctx->deflate_level == 0)
+    {
+        return;
+    }
+
+    if (length >= CCRUSH_ADAPTIVE_MIN_BLOCK_SIZE)
+    {
+        ctx->deflate_target_level = ccrush_estimate_entropy(data, length) >= CCRUSH_ADAPTIVE_ENTROPY_THRESHOLD ? 0 : ctx->deflate_level;
+    }
+
+    if (ctx->deflate_target_level == 0 && ctx->stats != NULL)
+    {
+        ctx->stats->bypassed_bytes += length;
+    }
+}
+
+/*
+ * Switches the deflate stream over to the level that ccrush_ctx_adapt() picked. deflateParams() first compresses whatever input deflate
+ * has already buffered using the old level, but none of what's still waiting in next_in (that's what the new level is for, after all).
+ */
+static int ccrush_ctx_switch_level(ccrush_ctx* ctx, z_stream* stream)
+{
+    const uInt avail_in = stream->avail_in;
+
+    stream->avail_in = 0;
+    const int r = deflateParams(stream, ctx->deflate_target_level, ctx->strategy);
+    stream->avail_in = avail_in;
+
+    if (r == Z_OK)
+    {
+        ctx->deflate_current_level = ctx->deflate_target_level;
+    }
+
+    return r;
+}
+
+/*
+ * deflate() that applies pending adaptive level switches and accounts for itself in the context's stats (if it has any).
+ */
+static int ccrush_ctx_deflate(ccrush_ctx* ctx, z_stream* stream, const int flush)
+{
+    if (ctx->deflate_target_level != ctx->deflate_current_level)
+    {
+        const uInt avail_out = stream->avail_out;
+
+        const int r = ccrush_ctx_switch_level(ctx, stream);
+        if (r != Z_OK && r != Z_BUF_ERROR)
+        {
+            return r;
+        }
+
+        // Out of output space before the switch (or right after it): let the caller empty the output buffer and call again, just like deflate() itself would.
+        if (stream->avail_out == 0)
+        {
+            return avail_out == 0 ? Z_BUF_ERROR : Z_OK;
+        }
+
+        // If deflateParams() gave up with output space left (which it shouldn't), just stay at the current level.
+        ctx->deflate_target_level = ctx->deflate_current_level;
+    }
+
+    if (ctx->stats == NULL)
+    {
+        return deflate(stream, flush);
+    }
+
+    const uInt avail_in = stream->avail_in;
+    const uInt avail_out = stream->avail_out;
+    const uint64_t start = ccrush_now_ns();
+
+    const int r = deflate(stream, flush);
+
+    ccrush_ctx_stats_codec(ctx, start, avail_in - stream->avail_in, avail_out - stream->avail_out);
+    return (r);
+}
+
+/*
+ * inflate() that supplies the context's preset dictionary when the stream asks for one,
+ * instead of failing with Z_NEED_DICT (which is only a useful error code if you know what it means).
+ */
+static int ccrush_ctx_inflate_with_dictionary(ccrush_ctx* ctx, z_stream* stream, const int flush)
+{
+    const int r = inflate(stream, flush);
+
+    if (r != Z_NEED_DICT)
+    {
+        return r;
+    }
+
+    if (ctx->dictionary == NULL)
+    {
+        return CCRUSH_ERROR_DICTIONARY_REQUIRED;
+    }
+
+    // When returning Z_NEED_DICT, inflate() has just read the ID of the dictionary that the data was compressed with into stream->adler.
+    if (stream->adler != ctx->dictionary_id)
+    {
+        return CCRUSH_ERROR_DICTIONARY_MISMATCH;
+    }
+
+    if (inflateSetDictionary(stream, ctx->dictionary, (uInt)ctx->dictionary_length) != Z_OK)
+    {
+        return Z_DATA_ERROR;
+    }
+
+    return inflate(stream, flush);
+}
+
+/*
+ * ccrush_ctx_inflate_with_dictionary() that accounts for itself in the context's stats (if it has any).
+ */
+static int ccrush_ctx_inflate(ccrush_ctx* ctx, z_stream* stream, const int flush)
+{
+    if (ctx->stats == NULL)
+    {
+        return ccrush_ctx_inflate_with_dictionary(ctx, stream, flush);
+    }
+
+    const uInt avail_in = stream->avail_in;
+    const uInt avail_out = stream->avail_out;
+    const uint64_t start = ccrush_now_ns();
+
+    const int r = ccrush_ctx_inflate_with_dictionary(ctx, stream, flush);
+
+    ccrush_ctx_stats_codec(ctx, start, avail_in - stream->avail_in, avail_out - stream->avail_out);
+    return (r);
+}
+
+/*
+ * fread() and fwrite() that account for themselves in the context's stats (if it has any).
+ */
+static inline size_t ccrush_ctx_fread(ccrush_ctx* ctx, uint8_t* buffer, const size_t length, FILE* file)
+{
+    const uint64_t start = ccrush_ctx_stats_clock(ctx);
+    const size_t n = fread(buffer, sizeof(uint8_t), length, file);
+
+    ccrush_ctx_stats_io(ctx, start);
+    return n;
+}
+
+static inline int ccrush_ctx_fwrite(ccrush_ctx* ctx, const uint8_t* buffer, const size_t length, FILE* file)
+{
+    const uint64_t start = ccrush_ctx_stats_clock(ctx);
+    const int r = fwrite(buffer, sizeof(uint8_t), length, file) != length || ferror(file);
+
+    ccrush_ctx_stats_io(ctx, start);
+    return (r);
+}
+
+static inline uint8_t* ccrush_ctx_get_buffer(ccrush_ctx* ctx, uint8_t** buffer)
+{
+    if (*buffer == NULL)
+    {
+        *buffer = ccrush_allocator_alloc(&ctx->allocator, ctx->buffersize);
+    }
+
+    return *buffer;
+}
+
+static int ccrush_ctx_get_output(ccrush_ctx* ctx, const size_t initial_capacity, struct ccrush_growbuf** out_output)
+{
+    if (ctx->output.array != NULL)
+    {
+        ctx->output.length = 0;
+    }
+    else if (ccrush_growbuf_init(&ctx->output, &ctx->allocator, initial_capacity) != 0)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    *out_output = &ctx->output;
+    return 0;
+}
+
+#ifdef CCRUSH_LIBDEFLATE
+
+/*
+ * libdeflate (see the ccrush_LIBDEFLATE CMake option) (de)compresses whole buffers in one go, which is 2-3x faster than zlib's streaming deflate()/inflate().
+ * The in-memory functions use it whenever they can; the FILE* and streaming functions stick to zlib.
+ * Its output is a regular zlib stream (though not necessarily byte-identical to zlib's for the same level).
+ */
+static struct libdeflate_compressor* ccrush_ctx_get_libdeflate_compressor(ccrush_ctx* ctx, const int level)
+{
+    if (ctx->libdeflate_compressor != NULL && ctx->libdeflate_level != level)
+    {
+        libdeflate_free_compressor(ctx->libdeflate_compressor);
+        ctx->libdeflate_compressor = NULL;
+    }
+
+    if (ctx->libdeflate_compressor == NULL)
+    {
+        ctx->libdeflate_compressor = libdeflate_alloc_compressor_ex(level, &ccrush_libdeflate_options);
+        ctx->libdeflate_level = level;
+    }
+
+    return ctx->libdeflate_compressor;
+}
+
+static struct libdeflate_decompressor* ccrush_ctx_get_libdeflate_decompressor(ccrush_ctx* ctx)
+{
+    if (ctx->libdeflate_decompressor == NULL)
+    {
+        ctx->libdeflate_decompressor = libdeflate_alloc_decompressor_ex(&ccrush_libdeflate_options);
+    }
+
+    return ctx->libdeflate_decompressor;
+}
+
+/*
+ * libdeflate has no notion of preset dictionaries: streams that were compressed with one (FDICT flag set in the zlib header) are left to zlib.
+ */
+static inline int ccrush_libdeflate_can_decompress(const uint8_t* data, const size_t data_length)
+{
+    return data_length >= 2 && (data[1] & 0x20) == 0;
+}
+
+static int ccrush_libdeflate_compress_into_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, const int level, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    struct libdeflate_compressor* compressor = ccrush_ctx_get_libdeflate_compressor(ctx, level);
+    if (compressor == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    const uint64_t start = ccrush_ctx_stats_clock(ctx);
+    const size_t n = libdeflate_zlib_compress(compressor, data, data_length, out, out_capacity);
+
+    ccrush_ctx_stats_codec(ctx, start, n != 0 ? data_length : 0, n);
+
+    if (n == 0)
+    {
+        return CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+    }
+
+    *out_written = n;
+    return 0;
+}
+
+static int ccrush_libdeflate_decompress_into_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    struct libdeflate_decompressor* decompressor = ccrush_ctx_get_libdeflate_decompressor(ctx);
+    if (decompressor == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    size_t in = 0, written = 0;
+
+    const uint64_t start = ccrush_ctx_stats_clock(ctx);
+    const enum libdeflate_result result = libdeflate_zlib_decompress_ex(decompressor, data, data_length, out, out_capacity, &in, &written);
+
+    ccrush_ctx_stats_codec(ctx, start, result == LIBDEFLATE_SUCCESS ? in : 0, result == LIBDEFLATE_SUCCESS ? written : 0);
+
+    switch (result)
+    {
+        case LIBDEFLATE_SUCCESS:
+            *out_written = written;
+            return 0;
+        case LIBDEFLATE_INSUFFICIENT_SPACE:
+            return CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+        default:
+            return Z_DATA_ERROR;
+    }
+}
+
+/*
+ * libdeflate needs the whole output buffer up front: guess its capacity, and retry with twice as much whenever that turns out to be too small.
+ * Deflate can't possibly expand anything by more than a factor of 1032:1, so anything that doesn't fit into that is corrupt.
+ */
+static int ccrush_libdeflate_decompress_alloc_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, uint8_t** out, size_t* out_length)
+{
+    const size_t max_capacity = data_length > (SIZE_MAX - 1) / 1032 ? SIZE_MAX - 1 : data_length * 1032;
+
+    size_t capacity = (size_t)CCRUSH_MIN(ccrush_nextpow2((uint64_t)data_length * 4), (uint64_t)max_capacity);
+
+    for (int growth = 0;; growth = 1)
+    {
+        uint8_t* output = ccrush_allocator_alloc(&ctx->allocator, capacity + 1);
+        if (output == NULL)
+        {
+            return CCRUSH_ERROR_OUT_OF_MEMORY;
+        }
+
+        ccrush_ctx_stats_buffer(ctx, capacity, growth);
+
+        size_t output_length = 0;
+
+        const int r = ccrush_libdeflate_decompress_into_impl(ctx, data, data_length, output, capacity, &output_length);
+        if (r == 0)
+        {
+            output[output_length] = 0x00;
+
+            *out = ccrush_allocator_shrink(&ctx->allocator, output, output_length + 1);
+            *out_length = output_length;
+
+            return 0;
+        }
+
+        ccrush_scrub(output, capacity, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, output);
+
+        if (r != CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL)
+        {
+            return r;
+        }
+
+        if (capacity >= max_capacity)
+        {
+            return Z_DATA_ERROR;
+        }
+
+        capacity = capacity > max_capacity / 2 ? max_capacity : capacity * 2;
+    }
+}
+
+#endif
+
+static int ccrush_compress_into_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, int level, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    level = level < 0 || level > 9 ? 6 : level;
+
+#ifdef CCRUSH_LIBDEFLATE
+    // If libdeflate's output doesn't fit, zlib's still might: ccrush_compress_bound() is zlib's worst case, not libdeflate's.
+    if (ctx->dictionary == NULL && !ctx->adaptive && ccrush_ctx_has_default_params(ctx) && ccrush_libdeflate_compress_into_impl(ctx, data, data_length, level, out, out_capacity, out_written) == 0)
+    {
+        return 0;
+    }
+#endif
+
+    z_stream* stream = NULL;
+
+    int r = ccrush_ctx_get_deflate_stream(ctx, level, &stream);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    stream->next_in = (Bytef*)data;
+    stream->avail_in = 0;
+    stream->next_out = out;
+    stream->avail_out = 0;
+
+    size_t remaining_in = data_length, remaining_out = out_capacity;
+
+    for (;;)
+    {
+        // Feed zlib straight from the caller's memory (no staging copies): the only limit is the width of avail_in/avail_out
+        // (and, for adaptive compression, the block size that it decides on).
+        if (stream->avail_in == 0)
+        {
+            const unsigned int n = (unsigned int)(CCRUSH_MIN(ctx->adaptive ? (size_t)CCRUSH_DEFAULT_CHUNKSIZE : (size_t)UINT_MAX, remaining_in));
+
+            stream->avail_in = n;
+            remaining_in -= n;
+
+            ccrush_ctx_adapt(ctx, stream->next_in, n);
+        }
+
+        if (stream->avail_out == 0)
+        {
+            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)UINT_MAX, remaining_out));
+
+            stream->avail_out = n;
+            remaining_out -= n;
+        }
+
+        r = ccrush_ctx_deflate(ctx, stream, remaining_in ? Z_NO_FLUSH : Z_FINISH);
+
+        if (r == Z_STREAM_END)
+        {
+            break;
+        }
+
+        if (r == Z_BUF_ERROR && stream->avail_out == 0 && remaining_out == 0)
+        {
+            return CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+        }
+
+        if (r != Z_OK)
+        {
+            return r;
+        }
+    }
+
+    *out_written = (size_t)(stream->next_out - out);
+    return 0;
+}
+
+/*
+ * ccrush_compress_bound() only holds for the default window size and memory level: with less memory, deflate emits shorter stored blocks (i.e. more block overhead),
+ * and smaller windows may make it pick static Huffman codes for incompressible data. Those get a rounded-up version of the conservative bound
+ * that deflateBound() falls back to for non-default parameters, which also has room for the largest wrapper (gzip's 18 bytes).
+ */
+static size_t ccrush_compress_bound_impl(const size_t data_length, const int window_bits, const int mem_level, const int strategy)
+{
+    const int default_window = window_bits == MAX_WBITS || window_bits == MAX_WBITS + 16 || window_bits == -MAX_WBITS;
+
+    if (default_window && mem_level == 8 && strategy == Z_DEFAULT_STRATEGY)
+    {
+        // A gzip wrapper is 12 bytes longer than a zlib one.
+        return ccrush_compress_bound(data_length) + (window_bits > MAX_WBITS ? 12 : 0);
+    }
+
+    return data_length + (data_length >> 3) + (data_length >> 6) + 32;
+}
+
+static inline size_t ccrush_ctx_compress_bound(const ccrush_ctx* ctx, const size_t data_length)
+{
+    return ccrush_compress_bound_impl(data_length, ctx->window_bits, ctx->mem_level, ctx->strategy);
+}
+
+static int ccrush_compress_alloc_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, const int level, const int size_header, uint8_t** out, size_t* out_length)
+{
+    const size_t header_length = size_header ? CCRUSH_SIZE_HEADER_LENGTH : 0;
+
+    // Deflate straight into one worst-case sized allocation (which is then shrunk to fit):
+    // no intermediate chunk buffer, no growing output buffer and no final copy.
+    const size_t output_capacity = header_length + ccrush_ctx_compress_bound(ctx, data_length);
+
+    uint8_t* output = ccrush_allocator_alloc(&ctx->allocator, output_capacity + 1);
+    if (output == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    ccrush_ctx_stats_buffer(ctx, output_capacity, 0);
+
+    if (size_header)
+    {
+        ccrush_write_size_header(output, (uint64_t)data_length);
+    }
+
+    size_t output_length = 0;
+
+    const int r = ccrush_compress_into_impl(ctx, data, data_length, level, output + header_length, output_capacity - header_length, &output_length);
+    if (r != 0)
+    {
+        ccrush_scrub(output, output_capacity, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, output);
+        return (r);
+    }
+
+    output_length += header_length;
+    output[output_length] = 0x00;
+
+    *out = ccrush_allocator_shrink(&ctx->allocator, output, output_length + 1);
+    *out_length = output_length;
+
+    return 0;
+}
+
+static int ccrush_decompress_into_impl(ccrush_ctx* ctx, const uint8_t* data, size_t data_length, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    if (ccrush_ctx_has_size_header(ctx, data, data_length))
+    {
+        if (ccrush_read_size_header(data) > (uint64_t)out_capacity)
+        {
+            return CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+        }
+
+        data += CCRUSH_SIZE_HEADER_LENGTH;
+        data_length -= CCRUSH_SIZE_HEADER_LENGTH;
+    }
+
+#ifdef CCRUSH_LIBDEFLATE
+    if (ccrush_ctx_is_zlib(ctx) && ccrush_libdeflate_can_decompress(data, data_length))
+    {
+        return ccrush_libdeflate_decompress_into_impl(ctx, data, data_length, out, out_capacity, out_written);
+    }
+#endif
+
+    z_stream* stream = NULL;
+
+    int r = ccrush_ctx_get_inflate_stream(ctx, &stream);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    stream->next_in = (Bytef*)data;
+    stream->avail_in = 0;
+    stream->next_out = out;
+    stream->avail_out = 0;
+
+    size_t remaining_in = data_length, remaining_out = out_capacity;
+
+    for (;;)
+    {
+        if (stream->avail_in == 0)
+        {
+            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)UINT_MAX, remaining_in));
+
+            stream->avail_in = n;
+            remaining_in -= n;
+        }
+
+        if (stream->avail_out == 0)
+        {
+            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)UINT_MAX, remaining_out));
+
+            stream->avail_out = n;
+            remaining_out -= n;
+        }
+
+        r = ccrush_ctx_inflate(ctx, stream, Z_NO_FLUSH);
+
+        if (r == Z_STREAM_END)
+        {
+            break;
+        }
+
+        if (r == Z_BUF_ERROR && stream->avail_out == 0 && remaining_out == 0)
+        {
+            return CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+        }
+
+        if (r != Z_OK)
+        {
+            return r;
+        }
+    }
+
+    *out_written = (size_t)(stream->next_out - out);
+    return 0;
+}
+
+/*
+ * Decompresses data that was compressed with ccrush_compress_with_size_header():
+ * the output is allocated exactly once (with the exact right size) and inflated into directly.
+ */
+static int ccrush_decompress_exact_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, uint8_t** out, size_t* out_length)
+{
+    const uint64_t decompressed_length = ccrush_read_size_header(data);
+
+    // Deflate can't possibly expand anything by more than a factor of 1032:1, so a header that claims more than that is corrupt (or malicious).
+    if (decompressed_length == 0 || decompressed_length / 1032 > (uint64_t)(data_length - CCRUSH_SIZE_HEADER_LENGTH) || decompressed_length >= SIZE_MAX)
+    {
+        return Z_DATA_ERROR;
+    }
+
+    uint8_t* output = ccrush_allocator_alloc(&ctx->allocator, (size_t)decompressed_length + 1);
+    if (output == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    ccrush_ctx_stats_buffer(ctx, (size_t)decompressed_length, 0);
+
+    size_t output_length = 0;
+
+    int r = ccrush_decompress_into_impl(ctx, data, data_length, output, (size_t)decompressed_length, &output_length);
+
+    if (r == 0 && output_length != decompressed_length)
+    {
+        r = Z_DATA_ERROR;
+    }
+
+    if (r != 0)
+    {
+        ccrush_scrub(output, (size_t)decompressed_length, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, output);
+        return r == CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL ? Z_DATA_ERROR : r;
+    }
+
+    output[output_length] = 0x00;
+
+    *out = output;
+    *out_length = output_length;
+
+    return 0;
+}
+
+/*
+ * Inflates a whole zlib stream (with or without size header) and appends the result to the passed output buffer.
+ */
+static int ccrush_inflate_append_impl(ccrush_ctx* ctx, const uint8_t* data, size_t data_length, struct ccrush_growbuf* output_buffer)
+{
+    if (ccrush_ctx_has_size_header(ctx, data, data_length))
+    {
+        data += CCRUSH_SIZE_HEADER_LENGTH;
+        data_length -= CCRUSH_SIZE_HEADER_LENGTH;
+    }
+
+    const unsigned int buffersize = ctx->buffersize;
+
+    z_stream* stream = NULL;
+
+    uint8_t* zoutbuf = ccrush_ctx_get_buffer(ctx, &ctx->output_buffer);
+    if (zoutbuf == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    int r = ccrush_ctx_get_inflate_stream(ctx, &stream);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    stream->next_in = (Bytef*)data;
+    stream->avail_in = 0;
+    stream->next_out = zoutbuf;
+    stream->avail_out = buffersize;
+
+    size_t remaining = data_length;
+
+    for (;;)
+    {
+        if (stream->avail_in == 0)
+        {
+            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)UINT_MAX, remaining));
+
+            stream->avail_in = n;
+            remaining -= n;
+        }
+
+        r = ccrush_ctx_inflate(ctx, stream, Z_SYNC_FLUSH);
+
+        if (r == Z_STREAM_END || stream->avail_out == 0)
+        {
+            const unsigned int n = buffersize - stream->avail_out;
+            const size_t capacity = output_buffer->capacity;
+
+            if (ccrush_growbuf_push_back(output_buffer, zoutbuf, n, ctx->scrub) != 0)
+            {
+                return CCRUSH_ERROR_OUT_OF_MEMORY;
+            }
+
+            ccrush_ctx_stats_buffer(ctx, output_buffer->capacity, output_buffer->capacity != capacity);
+
+            stream->next_out = zoutbuf;
+            stream->avail_out = buffersize;
+        }
+
+        if (r == Z_STREAM_END)
+        {
+            return 0;
+        }
+        else if (r != 0)
+        {
+            return r;
+        }
+    }
+}
+
+static int ccrush_decompress_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, uint8_t** out, size_t* out_length)
+{
+    if (ccrush_ctx_has_size_header(ctx, data, data_length))
+    {
+        return ccrush_decompress_exact_impl(ctx, data, data_length, out, out_length);
+    }
+
+#ifdef CCRUSH_LIBDEFLATE
+    if (ccrush_ctx_is_zlib(ctx) && ccrush_libdeflate_can_decompress(data, data_length))
+    {
+        return ccrush_libdeflate_decompress_alloc_impl(ctx, data, data_length, out, out_length);
+    }
+#endif
+
+    struct ccrush_growbuf* output_buffer = NULL;
+
+    if (ccrush_ctx_get_output(ctx, ccrush_nextpow2((uint64_t)data_length * 2), &output_buffer) != 0)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    ccrush_ctx_stats_buffer(ctx, output_buffer->capacity, 0);
+
+    const int r = ccrush_inflate_append_impl(ctx, data, data_length, output_buffer);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    *out = ccrush_allocator_alloc(&ctx->allocator, output_buffer->length + 1);
+    if (*out == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    *out_length = output_buffer->length;
+    (*out)[output_buffer->length] = '\0';
+    memcpy(*out, output_buffer->array, output_buffer->length);
+
+    return 0;
+}
+
+/*
+ * Hands the current output chunk over to the writer once it's full (or final), and points the stream at a fresh one.
+ */
+static int ccrush_pipeline_emit(struct ccrush_pipeline* pipeline, z_stream* stream, struct ccrush_pipeline_chunk** chunk, const int last)
+{
+    (*chunk)->length = pipeline->buffersize - stream->avail_out;
+    (*chunk)->last = last;
+
+    if (ccrush_pipeline_push(pipeline, &pipeline->written_output_chunks, *chunk) != 0)
+    {
+        return -1;
+    }
+
+    *chunk = last ? NULL : ccrush_pipeline_pop(pipeline, &pipeline->free_output_chunks);
+
+    if (*chunk != NULL)
+    {
+        stream->next_out = (*chunk)->data;
+        stream->avail_out = (uInt)pipeline->buffersize;
+    }
+
+    return last || *chunk != NULL ? 0 : -1;
+}
+
+static int ccrush_compress_pipelined_impl(ccrush_ctx* ctx, struct ccrush_pipeline* pipeline, const int level)
+{
+    z_stream* stream = NULL;
+
+    struct ccrush_pipeline_chunk* input = NULL;
+    struct ccrush_pipeline_chunk* output = NULL;
+
+    int r = ccrush_ctx_get_deflate_stream(ctx, level, &stream);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    output = ccrush_pipeline_pop(pipeline, &pipeline->free_output_chunks);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    stream->next_out = output->data;
+    stream->avail_out = (uInt)pipeline->buffersize;
+
+    int flush;
+
+    do
+    {
+        input = ccrush_pipeline_pop(pipeline, &pipeline->read_input_chunks);
+        if (input == NULL || input->error)
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+
+        flush = input->last ? Z_FINISH : Z_NO_FLUSH;
+
+        stream->next_in = input->data;
+        stream->avail_in = (uInt)input->length;
+
+        ccrush_ctx_adapt(ctx, input->data, input->length);
+
+        do
+        {
+            r = ccrush_ctx_deflate(ctx, stream, flush);
+            if (r == Z_STREAM_ERROR)
+            {
+                goto exit;
+            }
+
+            if (stream->avail_out == 0 && ccrush_pipeline_emit(pipeline, stream, &output, 0) != 0)
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+        } while (stream->avail_in != 0 || (flush == Z_FINISH && r != Z_STREAM_END));
+
+        if (ccrush_pipeline_push(pipeline, &pipeline->free_input_chunks, input) != 0)
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+
+    } while (flush != Z_FINISH);
+
+    if (ccrush_pipeline_emit(pipeline, stream, &output, 1) != 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:
+    ccrush_pipeline_finish(pipeline, r != 0);
+    ccrush_ctx_stats_io_wait(ctx);
+    return pipeline->write_error ? pipeline->write_error : r;
+}
+
+static int ccrush_decompress_pipelined_impl(ccrush_ctx* ctx, struct ccrush_pipeline* pipeline)
+{
+    z_stream* stream = NULL;
+
+    struct ccrush_pipeline_chunk* input = NULL;
+    struct ccrush_pipeline_chunk* output = NULL;
+
+    int r = ccrush_ctx_get_inflate_stream(ctx, &stream);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    output = ccrush_pipeline_pop(pipeline, &pipeline->free_output_chunks);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    stream->next_out = output->data;
+    stream->avail_out = (uInt)pipeline->buffersize;
+
+    while (r != Z_STREAM_END)
+    {
+        input = ccrush_pipeline_pop(pipeline, &pipeline->read_input_chunks);
+        if (input == NULL || input->error)
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+
+        stream->next_in = input->data;
+        stream->avail_in = (uInt)input->length;
+
+        int full = 0;
+
+        do
+        {
+            r = ccrush_ctx_inflate(ctx, stream, Z_NO_FLUSH);
+
+            switch (r)
+            {
+                case Z_DATA_ERROR:
+                case Z_MEM_ERROR:
+                case Z_STREAM_ERROR:
+                case CCRUSH_ERROR_DICTIONARY_REQUIRED:
+                case CCRUSH_ERROR_DICTIONARY_MISMATCH:
+                    goto exit;
+            }
+
+            full = stream->avail_out == 0;
+
+            if (full && ccrush_pipeline_emit(pipeline, stream, &output, 0) != 0)
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+        } while (r != Z_STREAM_END && (stream->avail_in != 0 || full));
+
+        // Ran out of input before the end of the compressed stream.
+        if (input->last && r != Z_STREAM_END)
+        {
+            r = Z_DATA_ERROR;
+            goto exit;
+        }
+
+        if (ccrush_pipeline_push(pipeline, &pipeline->free_input_chunks, input) != 0)
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+    }
+
+    if (ccrush_pipeline_emit(pipeline, stream, &output, 1) != 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:
+    ccrush_pipeline_finish(pipeline, r != 0);
+    ccrush_ctx_stats_io_wait(ctx);
+    return pipeline->write_error ? pipeline->write_error : r;
+}
+
+#ifdef CCRUSH_HAS_IO_URING
+
+static int ccrush_compress_uring_impl(ccrush_ctx* ctx, struct ccrush_uring* uring, FILE* input_file, FILE* output_file, const int level)
+{
+    const unsigned int buffersize = ctx->buffersize;
+
+    z_stream* stream = NULL;
+
+    struct ccrush_uring_buffer* output = NULL;
+
+    int r = ccrush_ctx_get_deflate_stream(ctx, level, &stream);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    output = ccrush_uring_next_write(uring);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    stream->next_out = output->data;
+    stream->avail_out = buffersize;
+
+    int flush;
+
+    do
+    {
+        const struct ccrush_uring_buffer* input = ccrush_uring_next_read(uring);
+        if (input == NULL && uring->error)
+        {
+            r = uring->error;
+            goto exit;
+        }
+
+        flush = input == NULL || ccrush_uring_at_last_read(uring) ? Z_FINISH : Z_NO_FLUSH;
+
+        stream->next_in = input != NULL ? input->data : Z_NULL;
+        stream->avail_in = input != NULL ? (uInt)input->length : 0;
+
+        ccrush_ctx_adapt(ctx, stream->next_in, stream->avail_in);
+
+        do
+        {
+            r = ccrush_ctx_deflate(ctx, stream, flush);
+            if (r == Z_STREAM_ERROR)
+            {
+                goto exit;
+            }
+
+            if (stream->avail_out == 0)
+            {
+                if (ccrush_uring_write(uring, output, buffersize) != 0 || (output = ccrush_uring_next_write(uring)) == NULL)
+                {
+                    r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                    goto exit;
+                }
+
+                stream->next_out = output->data;
+                stream->avail_out = buffersize;
+            }
+
+        } while (stream->avail_in != 0 || (flush == Z_FINISH && r != Z_STREAM_END));
+
+        if (input != NULL && ccrush_uring_release_read(uring) != 0)
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+
+    } while (flush != Z_FINISH);
+
+    if (ccrush_uring_write(uring, output, buffersize - stream->avail_out) != 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:;
+    const int io_error = ccrush_uring_finish(uring, input_file, output_file, uring->input_end);
+    ccrush_ctx_stats_io_wait(ctx);
+    return r != 0 ? r : io_error;
+}
+
+static int ccrush_decompress_uring_impl(ccrush_ctx* ctx, struct ccrush_uring* uring, FILE* input_file, FILE* output_file)
+{
+    const unsigned int buffersize = ctx->buffersize;
+
+    z_stream* stream = NULL;
+
+    struct ccrush_uring_buffer* output = NULL;
+
+    uint64_t input_consumed_end = uring->input_start;
+
+    int r = ccrush_ctx_get_inflate_stream(ctx, &stream);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    output = ccrush_uring_next_write(uring);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    stream->next_out = output->data;
+    stream->avail_out = buffersize;
+
+    while (r != Z_STREAM_END)
+    {
+        const struct ccrush_uring_buffer* input = ccrush_uring_next_read(uring);
+        if (input == NULL)
+        {
+            // Either an I/O error or the compressed stream is truncated.
+            r = uring->error ? uring->error : Z_DATA_ERROR;
+            goto exit;
+        }
+
+        stream->next_in = input->data;
+        stream->avail_in = (uInt)input->length;
+
+        int full = 0;
+
+        do
+        {
+            r = ccrush_ctx_inflate(ctx, stream, Z_NO_FLUSH);
+
+            switch (r)
+            {
+                case Z_DATA_ERROR:
+                case Z_MEM_ERROR:
+                case Z_STREAM_ERROR:
+                case CCRUSH_ERROR_DICTIONARY_REQUIRED:
+                case CCRUSH_ERROR_DICTIONARY_MISMATCH:
+                    goto exit;
+            }
+
+            full = stream->avail_out == 0;
+
+            if (full)
+            {
+                if (ccrush_uring_write(uring, output, buffersize) != 0 || (output = ccrush_uring_next_write(uring)) == NULL)
+                {
+                    r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                    goto exit;
+                }
+
+                stream->next_out = output->data;
+                stream->avail_out = buffersize;
+            }
+
+        } while (r != Z_STREAM_END && (stream->avail_in != 0 || full));
+
+        input_consumed_end = input->offset + (input->length - stream->avail_in);
+
+        if (ccrush_uring_release_read(uring) != 0)
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+    }
+
+    if (ccrush_uring_write(uring, output, buffersize - stream->avail_out) != 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:;
+    const int io_error = ccrush_uring_finish(uring, input_file, output_file, input_consumed_end);
+    ccrush_ctx_stats_io_wait(ctx);
+    return r != 0 ? r : io_error;
+}
+
+#endif
+
+static int ccrush_compress_file_raw_impl(ccrush_ctx* ctx, FILE* input_file, FILE* output_file, const int level)
+{
+    const unsigned int buffersize = ctx->buffersize;
+
+    ccrush_ctx_stats_buffer(ctx, buffersize, 0);
+
+#ifdef CCRUSH_HAS_IO_URING
+    {
+        struct ccrush_uring uring;
+
+        if (ccrush_uring_start(&uring, &ctx->allocator, buffersize, ctx->scrub, input_file, output_file) == 0)
+        {
+            return ccrush_compress_uring_impl(ctx, &uring, input_file, output_file, level);
+        }
+    }
+#endif
+
+    if (ccrush_pipelined_io)
+    {
+        struct ccrush_pipeline pipeline;
+
+        if (ccrush_pipeline_start(&pipeline, &ctx->allocator, buffersize, ctx->scrub, input_file, output_file) == 0)
+        {
+            return ccrush_compress_pipelined_impl(ctx, &pipeline, level);
+        }
+    }
+
+    z_stream* stream = NULL;
+
+    uint8_t* input_buffer = ccrush_ctx_get_buffer(ctx, &ctx->input_buffer);
+    uint8_t* output_buffer = ccrush_ctx_get_buffer(ctx, &ctx->output_buffer);
+
+    if (input_buffer == NULL || output_buffer == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    int r = ccrush_ctx_get_deflate_stream(ctx, level, &stream);
+    if (r != Z_OK)
+    {
+        return r;
+    }
+
+    int flush;
+
+    do
+    {
+        stream->avail_in = (uInt)ccrush_ctx_fread(ctx, input_buffer, buffersize, input_file);
+        if (ferror(input_file))
+        {
+            return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        }
+
+        flush = feof(input_file) ? Z_FINISH : Z_NO_FLUSH;
+        stream->next_in = input_buffer;
+
+        ccrush_ctx_adapt(ctx, input_buffer, stream->avail_in);
+
+        do
+        {
+            stream->avail_out = buffersize;
+            stream->next_out = output_buffer;
+
+            r = ccrush_ctx_deflate(ctx, stream, flush);
+            if (r == Z_STREAM_ERROR)
+            {
+                return r;
+            }
+
+            const unsigned int processed = buffersize - stream->avail_out;
+
+            if (ccrush_ctx_fwrite(ctx, output_buffer, processed, output_file) != 0)
+            {
+                return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            }
+
+        } while (stream->avail_out == 0);
+
+        if (stream->avail_in != 0)
+        {
+            return Z_STREAM_ERROR;
+        }
+
+    } while (flush != Z_FINISH);
+
+    return r == Z_STREAM_END ? 0 : Z_STREAM_ERROR;
+}
+
+static int ccrush_decompress_file_raw_impl(ccrush_ctx* ctx, FILE* input_file, FILE* output_file)
+{
+    const unsigned int buffersize = ctx->buffersize;
+
+    ccrush_ctx_stats_buffer(ctx, buffersize, 0);
+
+#ifdef CCRUSH_HAS_IO_URING
+    {
+        struct ccrush_uring uring;
+
+        if (ccrush_uring_start(&uring, &ctx->allocator, buffersize, ctx->scrub, input_file, output_file) == 0)
+        {
+            return ccrush_decompress_uring_impl(ctx, &uring, input_file, output_file);
+        }
+    }
+#endif
+
+    if (ccrush_pipelined_io)
+    {
+        struct ccrush_pipeline pipeline;
+
+        if (ccrush_pipeline_start(&pipeline, &ctx->allocator, buffersize, ctx->scrub, input_file, output_file) == 0)
+        {
+            return ccrush_decompress_pipelined_impl(ctx, &pipeline);
+        }
+    }
+
+    z_stream* stream = NULL;
+
+    uint8_t* input_buffer = ccrush_ctx_get_buffer(ctx, &ctx->input_buffer);
+    uint8_t* output_buffer = ccrush_ctx_get_buffer(ctx, &ctx->output_buffer);
+
+    if (input_buffer == NULL || output_buffer == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    int r = ccrush_ctx_get_inflate_stream(ctx, &stream);
+    if (r != Z_OK)
+    {
+        return r;
+    }
+
+    do
+    {
+        stream->avail_in = (uInt)ccrush_ctx_fread(ctx, input_buffer, buffersize, input_file);
+        if (ferror(input_file))
+        {
+            return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        }
+
+        if (stream->avail_in == 0)
+        {
+            break;
+        }
+
+        stream->next_in = input_buffer;
+
+        do
+        {
+            stream->avail_out = buffersize;
+            stream->next_out = output_buffer;
+
+            r = ccrush_ctx_inflate(ctx, stream, Z_NO_FLUSH);
+
+            switch (r)
+            {
+                case Z_DATA_ERROR:
+                case Z_MEM_ERROR:
+                case Z_STREAM_ERROR:
+                case CCRUSH_ERROR_DICTIONARY_REQUIRED:
+                case CCRUSH_ERROR_DICTIONARY_MISMATCH:
+                    return r;
+            }
+
+            const unsigned int processed = buffersize - stream->avail_out;
+
+            if (ccrush_ctx_fwrite(ctx, output_buffer, processed, output_file) != 0)
+            {
+                return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            }
+
+        } while (stream->avail_out == 0);
+
+    } while (r != Z_STREAM_END);
+
+    return r == Z_STREAM_END ? 0 : Z_DATA_ERROR;
+}
+
+static int ccrush_compress_mapped_impl(ccrush_ctx* ctx, const struct ccrush_file_map* map, FILE* output_file, const int level)
+{
+    const unsigned int buffersize = ctx->buffersize;
+
+    ccrush_ctx_stats_buffer(ctx, buffersize, 0);
+
+    z_stream* stream = NULL;
+
+    uint8_t* output_buffer = ccrush_ctx_get_buffer(ctx, &ctx->output_buffer);
+
+    if (output_buffer == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    int r = ccrush_ctx_get_deflate_stream(ctx, level, &stream);
+    if (r != Z_OK)
+    {
+        return r;
+    }
+
+    const uint8_t* next = map->data;
+    size_t remaining = map->length;
+
+    int flush;
+
+    do
+    {
+        // avail_in is only 32 bits wide, so huge mappings are fed to zlib in slices (buffer-sized ones for adaptive compression, which decides per slice).
+        const size_t slice = CCRUSH_MIN(remaining, ctx->adaptive ? (size_t)buffersize : (size_t)UINT_MAX);
+
+        stream->next_in = (Bytef*)next;
+        stream->avail_in = (uInt)slice;
+
+        ccrush_ctx_adapt(ctx, next, slice);
+
+        next += slice;
+        remaining -= slice;
+
+        flush = remaining == 0 ? Z_FINISH : Z_NO_FLUSH;
+
+        do
+        {
+            stream->avail_out = buffersize;
+            stream->next_out = output_buffer;
+
+            r = ccrush_ctx_deflate(ctx, stream, flush);
+            if (r == Z_STREAM_ERROR)
+            {
+                return r;
+            }
+
+            const unsigned int processed = buffersize - stream->avail_out;
+
+            if (ccrush_ctx_fwrite(ctx, output_buffer, processed, output_file) != 0)
+            {
+                return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            }
+
+        } while (stream->avail_out == 0);
+
+        if (stream->avail_in != 0)
+        {
+            return Z_STREAM_ERROR;
+        }
+
+    } while (flush != Z_FINISH);
+
+    return r == Z_STREAM_END ? 0 : Z_STREAM_ERROR;
+}
+
+static int ccrush_decompress_mapped_impl(ccrush_ctx* ctx, const struct ccrush_file_map* map, FILE* output_file)
+{
+    const unsigned int buffersize = ctx->buffersize;
+
+    ccrush_ctx_stats_buffer(ctx, buffersize, 0);
+
+    z_stream* stream = NULL;
+
+    uint8_t* output_buffer = ccrush_ctx_get_buffer(ctx, &ctx->output_buffer);
+
+    if (output_buffer == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    int r = ccrush_ctx_get_inflate_stream(ctx, &stream);
+    if (r != Z_OK)
+    {
+        return r;
+    }
+
+    const uint8_t* next = map->data;
+    size_t remaining = map->length;
+
+    while (remaining != 0 && r != Z_STREAM_END)
+    {
+        const size_t slice = CCRUSH_MIN(remaining, (size_t)UINT_MAX);
+
+        stream->next_in = (Bytef*)next;
+        stream->avail_in = (uInt)slice;
+
+        next += slice;
+        remaining -= slice;
+
+        do
+        {
+            stream->avail_out = buffersize;
+            stream->next_out = output_buffer;
+
+            r = ccrush_ctx_inflate(ctx, stream, Z_NO_FLUSH);
+
+            switch (r)
+            {
+                case Z_DATA_ERROR:
+                case Z_MEM_ERROR:
+                case Z_STREAM_ERROR:
+                case CCRUSH_ERROR_DICTIONARY_REQUIRED:
+                case CCRUSH_ERROR_DICTIONARY_MISMATCH:
+                    return r;
+            }
+
+            const unsigned int processed = buffersize - stream->avail_out;
+
+            if (ccrush_ctx_fwrite(ctx, output_buffer, processed, output_file) != 0)
+            {
+                return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            }
+
+        } while (stream->avail_out == 0);
+    }
+
+    return r == Z_STREAM_END ? 0 : Z_DATA_ERROR;
+}
+
+/*
+ * Backend of the file path functions: those open the input file themselves, so it can be mapped (see struct ccrush_file_map) and fed to zlib without copying it through an input buffer.
+ * Falls back to the regular stdio path if it can't be mapped. Closes both files.
+ */
+static int ccrush_compress_file_path_impl(ccrush_ctx* ctx, FILE* input_file, FILE* output_file, const int level)
+{
+    int r;
+
+    struct ccrush_file_map map;
+
+    if (ccrush_file_map_open(input_file, &map) == 0)
+    {
+        r = ccrush_compress_mapped_impl(ctx, &map, output_file, level);
+        ccrush_file_map_close(&map);
+    }
+    else
+    {
+        r = ccrush_compress_file_raw_impl(ctx, input_file, output_file, level);
+    }
+
+    fclose(input_file);
+    fclose(output_file);
+
+    return (r);
+}
+
+static int ccrush_decompress_file_path_impl(ccrush_ctx* ctx, FILE* input_file, FILE* output_file)
+{
+    int r;
+
+    struct ccrush_file_map map;
+
+    if (ccrush_file_map_open(input_file, &map) == 0)
+    {
+        r = ccrush_decompress_mapped_impl(ctx, &map, output_file);
+        ccrush_file_map_close(&map);
+    }
+    else
+    {
+        r = ccrush_decompress_file_raw_impl(ctx, input_file, output_file);
+    }
+
+    fclose(input_file);
+    fclose(output_file);
+
+    return (r);
+}
+
+size_t ccrush_compress_bound(const size_t data_length)
+{
+#ifdef ZLIBNG_VERSION
+    // zlib-ng's level 1 (deflate_quick) always emits static Huffman codes, which spend up to 9 bits on a literal: incompressible data can grow by 1/8th.
+    // This covers zlib-ng's own compressBound() (plus a byte), but again computed in size_t.
+    return data_length + (data_length >> 3) + 14;
+#else
+    // Same formula as zlib's compressBound(), but computed in size_t so that it doesn't truncate on platforms with a 32-bit uLong.
+    return data_length + (data_length >> 12) + (data_length >> 14) + (data_length >> 25) + 13;
+#endif
+}
+
+size_t ccrush_compress_bound_ex(const size_t data_length, const ccrush_params* params)
+{
+    if (params == NULL)
+    {
+        return ccrush_compress_bound(data_length);
+    }
+
+    return ccrush_compress_bound_impl(data_length, ccrush_params_window_bits(params), params->mem_level != 0 ? params->mem_level : 8, params->strategy);
+}
+
+int ccrush_compress_into(const uint8_t* data, const size_t data_length, const int level, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.level = level;
+
+    return ccrush_compress_into_ex(data, data_length, &params, out, out_capacity, out_written);
+}
+
+int ccrush_compress_into_ex(const uint8_t* data, const size_t data_length, const ccrush_params* params, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    if (data == NULL || data_length == 0 || out == NULL || out_capacity == 0 || out_written == NULL || ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_params(ctx, params);
+
+    const int r = ccrush_compress_into_impl(ctx, data, data_length, params->level, out, out_capacity, out_written);
+
+    ccrush_ctx_release(ctx);
+    return (r);
+}
+
+/*
+ * ccrush_estimate_ratio() compresses about 1/CCRUSH_ESTIMATE_BUDGET_DIVISOR of the input: CCRUSH_ESTIMATE_TARGET_SAMPLES samples spread evenly across it (more, smaller-than-max ones for big inputs),
+ * each one primed with up to CCRUSH_ESTIMATE_PRIME_FACTOR times its length of the data right in front of it, so that it finds the matches it would find in a full compression run.
+ * Priming only hashes the bytes in (no matching, no output), so it costs a fraction of compressing them.
+ * Inputs too small to fill CCRUSH_ESTIMATE_MIN_SAMPLES samples of CCRUSH_ESTIMATE_MIN_SAMPLE_SIZE bytes get the (even cheaper) entropy estimate instead.
+ */
+#define CCRUSH_ESTIMATE_BUDGET_DIVISOR 48
+#define CCRUSH_ESTIMATE_PRIME_FACTOR 8
+#define CCRUSH_ESTIMATE_TARGET_SAMPLES 8
+#define CCRUSH_ESTIMATE_MIN_SAMPLES 4
+#define CCRUSH_ESTIMATE_MAX_SAMPLES 256
+#define CCRUSH_ESTIMATE_MIN_SAMPLE_SIZE 512
+#define CCRUSH_ESTIMATE_MAX_SAMPLE_SIZE (1024 * 16)
+#define CCRUSH_ESTIMATE_MIN_SAMPLED_LENGTH (CCRUSH_ESTIMATE_BUDGET_DIVISOR * CCRUSH_ESTIMATE_MIN_SAMPLES * CCRUSH_ESTIMATE_MIN_SAMPLE_SIZE)
+
+/*
+ * Every sample ends in a sync flush, whose empty stored block (about 4 bytes) a single full compression run wouldn't have.
+ */
+#define CCRUSH_ESTIMATE_SYNC_FLUSH_OVERHEAD 4
+
+/*
+ * Samples miss the odd long-distance match and pay for their own block headers, so on top of the spread between the samples,
+ * the margin leaves this much (relative to the estimate) for the bias.
+ */
+#define CCRUSH_ESTIMATE_BIAS_FACTOR 0.08
+
+static double ccrush_sqrt(const double x)
+{
+    if (x <= 0.0)
+    {
+        return 0.0;
+    }
+
+    double root = x > 1.0 ? x : 1.0;
+
+    for (int i = 0; i < 64; ++i)
+    {
+        root = 0.5 * (root + x / root);
+    }
+
+    return root;
+}
+
+static int ccrush_estimate_sampled_impl(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, const int level, size_t* out_estimated_length, size_t* out_margin)
+{
+    const size_t budget = data_length / CCRUSH_ESTIMATE_BUDGET_DIVISOR;
+    const size_t sample_size = CCRUSH_MIN(CCRUSH_MAX(budget / CCRUSH_ESTIMATE_TARGET_SAMPLES, (size_t)CCRUSH_ESTIMATE_MIN_SAMPLE_SIZE), (size_t)CCRUSH_ESTIMATE_MAX_SAMPLE_SIZE);
+    const size_t sample_count = CCRUSH_MIN(CCRUSH_MAX(budget / sample_size, (size_t)CCRUSH_ESTIMATE_MIN_SAMPLES), (size_t)CCRUSH_ESTIMATE_MAX_SAMPLES);
+    const size_t stride = data_length / sample_count;
+    const size_t prime_size = CCRUSH_MIN(sample_size * CCRUSH_ESTIMATE_PRIME_FACTOR, (size_t)CCRUSH_WINDOW_SIZE);
+
+    uint8_t output_buffer[1024 * 8];
+
+    ccrush_params raw = CCRUSH_PARAMS_DEFAULT;
+    raw.header = CCRUSH_HEADER_RAW;
+    ccrush_ctx_use_params(ctx, &raw);
+
+    z_stream* stream = NULL;
+
+    int r = ccrush_ctx_get_deflate_stream(ctx, level, &stream);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    uint64_t random = 0x9E3779B97F4A7C15;
+
+    double sum = 0.0, sum_of_squares = 0.0;
+
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+        random ^= random << 13;
+        random ^= random >> 7;
+        random ^= random << 17;
+
+        const size_t offset = i * stride + random % (stride - sample_size + 1);
+        const size_t prime = CCRUSH_MIN(offset, prime_size);
+
+        if (prime != 0)
+        {
+            r = deflateSetDictionary(stream, data + offset - prime, (uInt)prime);
+            if (r != Z_OK)
+            {
+                return r;
+            }
+        }
+
+        const uint64_t total_out = stream->total_out;
+
+        stream->next_in = (Bytef*)data + offset;
+        stream->avail_in = (uInt)sample_size;
+
+        do
+        {
+            stream->next_out = output_buffer;
+            stream->avail_out = sizeof(output_buffer);
+
+            r = ccrush_ctx_deflate(ctx, stream, Z_SYNC_FLUSH);
+            if (r == Z_STREAM_ERROR)
+            {
+                return (r);
+            }
+        } while (stream->avail_out == 0);
+
+        const double ratio = (double)(stream->total_out - total_out - CCRUSH_ESTIMATE_SYNC_FLUSH_OVERHEAD) / (double)sample_size;
+
+        sum += ratio;
+        sum_of_squares += ratio * ratio;
+    }
+
+    const double n = (double)sample_count;
+    const double ratio = sum / n;
+    const double variance = (sum_of_squares - sum * ratio) / (n - 1.0);
+    const double t = sample_count < 8 ? 3.2 : sample_count < 16 ? 2.4 : sample_count < 32 ? 2.1 : 2.0;
+
+    const double estimated_length = CCRUSH_MIN(ratio * (double)data_length + 6.0, (double)ccrush_compress_bound(data_length));
+
+    *out_estimated_length = (size_t)estimated_length;
+    *out_margin = (size_t)((t * ccrush_sqrt(variance / n) + 0.01) * (double)data_length + CCRUSH_ESTIMATE_BIAS_FACTOR * estimated_length);
+
+    return 0;
+}
+
+/*
+ * The estimate for inputs too small to sample: one pass over (at most CCRUSH_ADAPTIVE_SAMPLE_SIZE bytes of) the data, just like adaptive compression's.
+ * Byte entropy can't see repetitions, though, which is what deflate's matches feed on: all it tells is roughly what Huffman coding alone would get the data down to.
+ * Across real-world files (source code, text, JSON, executables, images and archives), deflate's output came out at 0.1x to 1.1x of that, with
+ * the high-entropy ones (nothing left to match) at the top end. Hence the estimate leans towards that end with rising entropy, and the margin is half of the Huffman-coded size
+ * (plus some bytes for block headers and fixed Huffman codes, which dominate tiny inputs).
+ */
+static void ccrush_estimate_entropy_impl(const uint8_t* data, const size_t data_length, size_t* out_estimated_length, size_t* out_margin)
+{
+    const double entropy = ccrush_estimate_entropy(data, data_length);
+    const double huffman_length = entropy / 8.0 * (double)data_length;
+    const double match_factor = 0.5 + 0.5 * CCRUSH_MIN(CCRUSH_MAX((entropy - 5.0) / 2.5, 0.0), 1.0);
+
+    *out_estimated_length = (size_t)CCRUSH_MIN(match_factor * huffman_length + 32.0, (double)ccrush_compress_bound(data_length));
+    *out_margin = (size_t)(0.5 * huffman_length + 160.0);
+}
+
+int ccrush_estimate_ratio(const uint8_t* data, const size_t data_length, int level, size_t* out_estimated_length, size_t* out_margin)
+{
+    if (data == NULL || data_length == 0 || out_estimated_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    level = level < 0 || level > 9 ? 6 : level;
+
+    int r = 0;
+    size_t margin = 0;
+
+    if (data_length >= CCRUSH_ESTIMATE_MIN_SAMPLED_LENGTH)
+    {
+        ccrush_ctx stack_ctx;
+        ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+
+        r = ccrush_estimate_sampled_impl(ctx, data, data_length, level, out_estimated_length, &margin);
+
+        ccrush_ctx_release(ctx);
+    }
+    else
+    {
+        ccrush_estimate_entropy_impl(data, data_length, out_estimated_length, &margin);
+    }
+
+    if (r == 0 && out_margin != NULL)
+    {
+        *out_margin = margin;
+    }
+
+    return (r);
+}
+
+int ccrush_compress(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const int level, uint8_t** out, size_t* out_length)
+{
+    return ccrush_compress_with_dictionary(data, data_length, buffer_size_kib, level, NULL, 0, out, out_length);
+}
+
+static int ccrush_compress_with_params(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const ccrush_params* params, const uint8_t* dictionary, const size_t dictionary_length, uint8_t** out, size_t* out_length)
+{
+    if (data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (ccrush_dictionary_args_invalid(dictionary, dictionary_length))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib >= CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_dictionary(ctx, dictionary, dictionary_length);
+    ccrush_ctx_use_params(ctx, params);
+
+    const int r = ccrush_compress_alloc_impl(ctx, data, data_length, params->level, 0, out, out_length);
+
+    ccrush_ctx_release(ctx);
+    return (r);
+}
+
+int ccrush_compress_with_dictionary(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const int level, const uint8_t* dictionary, const size_t dictionary_length, uint8_t** out, size_t* out_length)
+{
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.level = level;
+
+    return ccrush_compress_with_params(data, data_length, buffer_size_kib, &params, dictionary, dictionary_length, out, out_length);
+}
+
+int ccrush_compress_ex(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const ccrush_params* params, uint8_t** out, size_t* out_length)
+{
+    if (ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    return ccrush_compress_with_params(data, data_length, buffer_size_kib, params, NULL, 0, out, out_length);
+}
+
+int ccrush_compress_with_size_header(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const int level, uint8_t** out, size_t* out_length)
+{
+    if (data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib >= CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+
+    const int r = ccrush_compress_alloc_impl(ctx, data, data_length, level, 1, out, out_length);
+
+    ccrush_ctx_release(ctx);
+    return (r);
+}
+
+int ccrush_get_decompressed_size(const uint8_t* data, const size_t data_length, uint64_t* out_decompressed_size)
+{
+    if (data == NULL || out_decompressed_size == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (!ccrush_has_size_header(data, data_length))
+    {
+        return CCRUSH_ERROR_NO_SIZE_HEADER;
+    }
+
+    *out_decompressed_size = ccrush_read_size_header(data);
+    return 0;
+}
+
+int ccrush_compress_file_raw(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, int close_input_file, int close_output_file)
+{
+    return ccrush_compress_file_raw_with_dictionary(input_file, output_file, buffer_size_kib, level, NULL, 0, close_input_file, close_output_file);
+}
+
+static int ccrush_compress_file_raw_with_params(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const ccrush_params* params, const uint8_t* dictionary, size_t dictionary_length, int close_input_file, int close_output_file)
+{
+    if (!input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (ccrush_dictionary_args_invalid(dictionary, dictionary_length))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_dictionary(ctx, dictionary, dictionary_length);
+    ccrush_ctx_use_params(ctx, params);
+    ccrush_ctx_set_buffersize(ctx, buffer_size_kib);
+
+    const int r = ccrush_compress_file_raw_impl(ctx, input_file, output_file, params->level);
+
+    ccrush_ctx_release(ctx);
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_compress_file_raw_with_dictionary(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, const uint8_t* dictionary, size_t dictionary_length, int close_input_file, int close_output_file)
+{
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.level = level;
+
+    return ccrush_compress_file_raw_with_params(input_file, output_file, buffer_size_kib, &params, dictionary, dictionary_length, close_input_file, close_output_file);
+}
+
+int ccrush_compress_file_raw_ex(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const ccrush_params* params, int close_input_file, int close_output_file)
+{
+    if (ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    return ccrush_compress_file_raw_with_params(input_file, output_file, buffer_size_kib, params, NULL, 0, close_input_file, close_output_file);
+}
+
+int ccrush_compress_file(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, int level)
+{
+    return ccrush_compress_file_with_dictionary(input_file_path, output_file_path, buffer_size_kib, level, NULL, 0);
+}
+
+static int ccrush_compress_file_with_params(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, const ccrush_params* params, const uint8_t* dictionary, size_t dictionary_length)
+{
+    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (ccrush_dictionary_args_invalid(dictionary, dictionary_length))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_dictionary(ctx, dictionary, dictionary_length);
+    ccrush_ctx_use_params(ctx, params);
+    ccrush_ctx_set_buffersize(ctx, buffer_size_kib);
+
+    const int r = ccrush_compress_file_path_impl(ctx, input_file, output_file, params->level);
+
+    ccrush_ctx_release(ctx);
+
+    return (r);
+}
+
+int ccrush_compress_file_with_dictionary(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, int level, const uint8_t* dictionary, size_t dictionary_length)
+{
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.level = level;
+
+    return ccrush_compress_file_with_params(input_file_path, output_file_path, buffer_size_kib, &params, dictionary, dictionary_length);
+}
+
+int ccrush_compress_file_ex(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, const ccrush_params* params)
+{
+    if (ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    return ccrush_compress_file_with_params(input_file_path, output_file_path, buffer_size_kib, params, NULL, 0);
+}
+
+int ccrush_decompress_into(const uint8_t* data, const size_t data_length, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    const ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    return ccrush_decompress_into_ex(data, data_length, &params, out, out_capacity, out_written);
+}
+
+int ccrush_decompress_into_ex(const uint8_t* data, const size_t data_length, const ccrush_params* params, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    if (data == NULL || data_length == 0 || out == NULL || out_capacity == 0 || out_written == NULL || ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_params(ctx, params);
+
+    const int r = ccrush_decompress_into_impl(ctx, data, data_length, out, out_capacity, out_written);
+
+    ccrush_ctx_release(ctx);
+    return (r);
+}
+
+int ccrush_decompress(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, uint8_t** out, size_t* out_length)
+{
+    return ccrush_decompress_with_dictionary(data, data_length, buffer_size_kib, NULL, 0, out, out_length);
+}
+
+static int ccrush_decompress_with_params(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const ccrush_params* params, const uint8_t* dictionary, const size_t dictionary_length, uint8_t** out, size_t* out_length)
+{
+    if (data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (ccrush_dictionary_args_invalid(dictionary, dictionary_length))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_dictionary(ctx, dictionary, dictionary_length);
+    ccrush_ctx_use_params(ctx, params);
+    ccrush_ctx_set_buffersize(ctx, buffer_size_kib);
+
+    const int r = ccrush_decompress_impl(ctx, data, data_length, out, out_length);
+
+    ccrush_ctx_release(ctx);
+    return (r);
+}
+
+int ccrush_decompress_with_dictionary(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const uint8_t* dictionary, const size_t dictionary_length, uint8_t** out, size_t* out_length)
+{
+    const ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    return ccrush_decompress_with_params(data, data_length, buffer_size_kib, &params, dictionary, dictionary_length, out, out_length);
+}
+
+int ccrush_decompress_ex(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const ccrush_params* params, uint8_t** out, size_t* out_length)
+{
+    if (ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    return ccrush_decompress_with_params(data, data_length, buffer_size_kib, params, NULL, 0, out, out_length);
+}
+
+int ccrush_decompress_file_raw(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int close_input_file, int close_output_file)
+{
+    return ccrush_decompress_file_raw_with_dictionary(input_file, output_file, buffer_size_kib, NULL, 0, close_input_file, close_output_file);
+}
+
+static int ccrush_decompress_file_raw_with_params(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const ccrush_params* params, const uint8_t* dictionary, size_t dictionary_length, int close_input_file, int close_output_file)
+{
+    if (!input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (ccrush_dictionary_args_invalid(dictionary, dictionary_length))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_dictionary(ctx, dictionary, dictionary_length);
+    ccrush_ctx_use_params(ctx, params);
+    ccrush_ctx_set_buffersize(ctx, buffer_size_kib);
+
+    const int r = ccrush_decompress_file_raw_impl(ctx, input_file, output_file);
+
+    ccrush_ctx_release(ctx);
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_decompress_file_raw_with_dictionary(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const uint8_t* dictionary, size_t dictionary_length, int close_input_file, int close_output_file)
+{
+    const ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    return ccrush_decompress_file_raw_with_params(input_file, output_file, buffer_size_kib, &params, dictionary, dictionary_length, close_input_file, close_output_file);
+}
+
+int ccrush_decompress_file_raw_ex(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, const ccrush_params* params, int close_input_file, int close_output_file)
+{
+    if (ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    return ccrush_decompress_file_raw_with_params(input_file, output_file, buffer_size_kib, params, NULL, 0, close_input_file, close_output_file);
+}
+
+int ccrush_decompress_file(const char* input_file_path, const char* output_file_path, const uint32_t buffer_size_kib)
+{
+    return ccrush_decompress_file_with_dictionary(input_file_path, output_file_path, buffer_size_kib, NULL, 0);
+}
+
+static int ccrush_decompress_file_with_params(const char* input_file_path, const char* output_file_path, const uint32_t buffer_size_kib, const ccrush_params* params, const uint8_t* dictionary, const size_t dictionary_length)
+{
+    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (ccrush_dictionary_args_invalid(dictionary, dictionary_length))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    ccrush_ctx stack_ctx;
+    ccrush_ctx* ctx = ccrush_ctx_acquire(&stack_ctx);
+    ccrush_ctx_use_dictionary(ctx, dictionary, dictionary_length);
+    ccrush_ctx_use_params(ctx, params);
+    ccrush_ctx_set_buffersize(ctx, buffer_size_kib);
+
+    const int r = ccrush_decompress_file_path_impl(ctx, input_file, output_file);
+
+    ccrush_ctx_release(ctx);
+
+    return (r);
+}
+
+int ccrush_decompress_file_with_dictionary(const char* input_file_path, const char* output_file_path, const uint32_t buffer_size_kib, const uint8_t* dictionary, const size_t dictionary_length)
+{
+    const ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    return ccrush_decompress_file_with_params(input_file_path, output_file_path, buffer_size_kib, &params, dictionary, dictionary_length);
+}
+
+int ccrush_decompress_file_ex(const char* input_file_path, const char* output_file_path, const uint32_t buffer_size_kib, const ccrush_params* params)
+{
+    if (ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    return ccrush_decompress_file_with_params(input_file_path, output_file_path, buffer_size_kib, params, NULL, 0);
+}
+
+int ccrush_compress_mt(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, int level, uint32_t thread_count, uint8_t** out, size_t* out_length)
+{
+    if (data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib >= CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    thread_count = ccrush_resolve_thread_count(thread_count);
+
+    // Aim for one slice per thread, but don't bother splitting up tiny inputs and keep every slice within the range of zlib's 32-bit counters.
+    size_t slice_size = CCRUSH_MAX((data_length + thread_count - 1) / thread_count, (size_t)CCRUSH_MT_MIN_SLICE_SIZE);
+    slice_size = CCRUSH_MIN(slice_size, (size_t)CCRUSH_MT_MAX_SLICE_SIZE);
+
+    const size_t slice_count = (data_length + slice_size - 1) / slice_size;
+
+    if (thread_count == 1 || slice_count == 1)
+    {
+        return ccrush_compress(data, data_length, buffer_size_kib, level, out, out_length);
+    }
+
+    level = level < 0 || level > 9 ? 6 : level;
+
+    int r = 0;
+
+    struct ccrush_deflate_block* blocks = ccrush_mem_calloc(slice_count, sizeof(struct ccrush_deflate_block));
+    if (blocks == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    // Every slice deflates straight out of the caller's data into its own worst-case region of one single output allocation;
+    // the regions are compacted afterwards. That way there is no input copy and no intermediate output buffer at all.
+    size_t output_capacity = 2 + 4 + 1;
+
+    for (size_t i = 0; i < slice_count; ++i)
+    {
+        struct ccrush_deflate_block* block = &blocks[i];
+
+        block->level = level;
+        block->last = i == slice_count - 1;
+        block->input = data + (i * slice_size);
+        block->input_length = block->last ? data_length - (i * slice_size) : slice_size;
+        block->dictionary = i == 0 ? NULL : block->input - CCRUSH_WINDOW_SIZE;
+        block->dictionary_length = i == 0 ? 0 : CCRUSH_WINDOW_SIZE;
+        block->output_capacity = ccrush_deflate_block_bound(block->input_length);
+
+        output_capacity += block->output_capacity;
+    }
+
+    uint8_t* output = ccrush_mem_alloc(output_capacity);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    size_t offset = 2;
+
+    for (size_t i = 0; i < slice_count; ++i)
+    {
+        blocks[i].output = output + offset;
+        offset += blocks[i].output_capacity;
+    }
+
+    for (size_t i = 0; i < slice_count; i += thread_count)
+    {
+        ccrush_run_jobs(blocks + i, sizeof(struct ccrush_deflate_block), (uint32_t)CCRUSH_MIN((size_t)thread_count, slice_count - i), &ccrush_deflate_block_job);
+    }
+
+    ccrush_write_zlib_header(output, level);
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    size_t output_length = 2;
+
+    for (size_t i = 0; i < slice_count; ++i)
+    {
+        const struct ccrush_deflate_block* block = &blocks[i];
+
+        if (block->r != 0)
+        {
+            r = block->r;
+            goto exit;
+        }
+
+        memmove(output + output_length, block->output, block->output_length);
+        output_length += block->output_length;
+
+        adler = adler32_combine(adler, block->adler, (z_off_t)block->input_length);
+    }
+
+    ccrush_write_zlib_trailer(output + output_length, adler);
+    output_length += 4;
+    output[output_length] = 0x00;
+
+    *out = ccrush_mem_shrink(output, output_length + 1);
+    *out_length = output_length;
+
+    output = NULL;
+    r = 0;
+
+exit:
+
+    for (size_t i = 0; i < slice_count; ++i)
+    {
+        ccrush_deflate_block_free(&blocks[i]);
+    }
+
+    ccrush_mem_free(blocks);
+
+    if (output != NULL)
+    {
+        ccrush_scrub(output, output_capacity, ccrush_scrub_buffers);
+        ccrush_mem_free(output);
+    }
+
+    return (r);
+}
+
+int ccrush_compress_file_raw_mt(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, uint32_t thread_count, int close_input_file, int close_output_file)
+{
+    if (!input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    level = level < 0 || level > 9 ? 6 : level;
+    thread_count = ccrush_resolve_thread_count(thread_count);
+
+    if (thread_count == 1)
+    {
+        return ccrush_compress_file_raw(input_file, output_file, buffer_size_kib, level, close_input_file, close_output_file);
+    }
+
+    int r = 0;
+
+    assert(sizeof(uint8_t) == 1);
+    const size_t blocksize = CCRUSH_MAX((size_t)ccrush_get_buffersize(buffer_size_kib), (size_t)CCRUSH_WINDOW_SIZE);
+    const size_t output_capacity = ccrush_deflate_block_bound(blocksize);
+
+    uint8_t* dictionary = ccrush_mem_alloc(CCRUSH_WINDOW_SIZE);
+    size_t dictionary_length = 0;
+
+    struct ccrush_deflate_block* blocks = ccrush_mem_calloc(thread_count, sizeof(struct ccrush_deflate_block));
+
+    if (dictionary == NULL || blocks == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        blocks[i].input = ccrush_mem_alloc(blocksize);
+        blocks[i].output = ccrush_mem_alloc(output_capacity);
+
+        if (blocks[i].input == NULL || blocks[i].output == NULL)
+        {
+            r = CCRUSH_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+
+        blocks[i].level = level;
+        blocks[i].output_capacity = output_capacity;
+    }
+
+    uint8_t header[2];
+    ccrush_write_zlib_header(header, level);
+
+    if (fwrite(header, sizeof(uint8_t), sizeof(header), output_file) != sizeof(header))
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    uLong adler = adler32(0L, Z_NULL, 0);
+    int eof = 0;
+
+    while (!eof)
+    {
+        uint32_t count = 0;
+
+        while (count < thread_count && !eof)
+        {
+            struct ccrush_deflate_block* block = &blocks[count];
+
+            block->input_length = fread((uint8_t*)block->input, sizeof(uint8_t), blocksize, input_file);
+            if (ferror(input_file))
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+            if (count == 0)
+            {
+                block->dictionary = dictionary;
+                block->dictionary_length = dictionary_length;
+            }
+            else
+            {
+                block->dictionary = blocks[count - 1].input + (blocksize - CCRUSH_WINDOW_SIZE);
+                block->dictionary_length = CCRUSH_WINDOW_SIZE;
+            }
+
+            eof = block->input_length < blocksize;
+            ++count;
+        }
+
+        if (!eof)
+        {
+            // A completely full batch could have been the end of the file: peek ahead to find out whether the last block needs to finish the stream.
+            const int c = fgetc(input_file);
+
+            if (c == EOF)
+            {
+                if (ferror(input_file))
+                {
+                    r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                    goto exit;
+                }
+
+                eof = 1;
+            }
+            else
+            {
+                ungetc(c, input_file);
+            }
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            blocks[i].last = eof && i == count - 1;
+        }
+
+        ccrush_run_jobs(blocks, sizeof(struct ccrush_deflate_block), count, &ccrush_deflate_block_job);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const struct ccrush_deflate_block* block = &blocks[i];
+
+            if (block->r != 0)
+            {
+                r = block->r;
+                goto exit;
+            }
+
+            if (fwrite(block->output, sizeof(uint8_t), block->output_length, output_file) != block->output_length || ferror(output_file))
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+            adler = adler32_combine(adler, block->adler, (z_off_t)block->input_length);
+        }
+
+        if (!eof)
+        {
+            dictionary_length = CCRUSH_WINDOW_SIZE;
+            memcpy(dictionary, blocks[count - 1].input + (blocksize - CCRUSH_WINDOW_SIZE), CCRUSH_WINDOW_SIZE);
+        }
+    }
+
+    uint8_t trailer[4];
+    ccrush_write_zlib_trailer(trailer, adler);
+
+    if (fwrite(trailer, sizeof(uint8_t), sizeof(trailer), output_file) != sizeof(trailer) || ferror(output_file))
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:
+
+    if (blocks != NULL)
+    {
+        for (uint32_t i = 0; i < thread_count; ++i)
+        {
+            ccrush_deflate_block_free(&blocks[i]);
+
+            if (blocks[i].input != NULL)
+            {
+                ccrush_scrub((uint8_t*)blocks[i].input, blocksize, ccrush_scrub_buffers);
+                ccrush_mem_free((uint8_t*)blocks[i].input);
+            }
+
+            if (blocks[i].output != NULL)
+            {
+                ccrush_scrub(blocks[i].output, output_capacity, ccrush_scrub_buffers);
+                ccrush_mem_free(blocks[i].output);
+            }
+        }
+
+        ccrush_mem_free(blocks);
+    }
+
+    if (dictionary != NULL)
+    {
+        ccrush_scrub(dictionary, CCRUSH_WINDOW_SIZE, ccrush_scrub_buffers);
+        ccrush_mem_free(dictionary);
+    }
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_compress_file_mt(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, int level, uint32_t thread_count)
+{
+    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return ccrush_compress_file_raw_mt(input_file, output_file, buffer_size_kib, level, thread_count, 1, 1);
+}
+
+/*
+ * Batches aren't split into jobs of less input than this: for a few KiB of records, spawning a thread costs more than it saves.
+ */
+#define CCRUSH_BATCH_MIN_JOB_SIZE (1024 * 64)
+
+/*
+ * A contiguous range of batch records [first; last) that one thread (de)compresses with its own, reused z_stream.
+ * Compression jobs deflate each record into its worst-case region of the shared output arena; decompression jobs append their records to their own output buffer.
+ */
+struct ccrush_batch_job
+{
+    int r;
+    int level;
+    const uint8_t* const* inputs;
+    const size_t* input_lengths;
+    size_t first;
+    size_t last;
+    uint8_t* arena;
+    const size_t* bound_offsets;
+    size_t* output_lengths;
+    ccrush_ctx ctx;
+};
+
+static void ccrush_compress_batch_job(void* arg)
+{
+    struct ccrush_batch_job* job = (struct ccrush_batch_job*)arg;
+
+    for (size_t i = job->first; i < job->last && job->r == 0; ++i)
+    {
+        job->r = ccrush_compress_into_impl(&job->ctx, job->inputs[i], job->input_lengths[i], job->level, job->arena + job->bound_offsets[i], job->bound_offsets[i + 1] - job->bound_offsets[i], &job->output_lengths[i]);
+    }
+}
+
+static void ccrush_decompress_batch_job(void* arg)
+{
+    struct ccrush_batch_job* job = (struct ccrush_batch_job*)arg;
+    struct ccrush_growbuf* output = NULL;
+    size_t input_length = 0;
+
+    for (size_t i = job->first; i < job->last; ++i)
+    {
+        input_length += job->input_lengths[i];
+    }
+
+    job->r = ccrush_ctx_get_output(&job->ctx, ccrush_nextpow2((uint64_t)input_length * 2), &output);
+
+    for (size_t i = job->first; i < job->last && job->r == 0; ++i)
+    {
+        const size_t length = output->length;
+
+        job->r = ccrush_inflate_append_impl(&job->ctx, job->inputs[i], job->input_lengths[i], output);
+        job->output_lengths[i] = output->length - length;
+    }
+}
+
+static int ccrush_batch_args_invalid(const uint8_t* const* inputs, const size_t* input_lengths, const size_t count, uint8_t** out, size_t* out_length, size_t* out_offsets)
+{
+    if (inputs == NULL || input_lengths == NULL || count == 0 || out == NULL || out_length == NULL || out_offsets == NULL)
+    {
+        return 1;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (inputs[i] == NULL || input_lengths[i] == 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Splits the records into (up to) one contiguous range per thread, each holding roughly the same amount of input bytes. Returns the amount of jobs.
+ */
+static uint32_t ccrush_batch_setup_jobs(struct ccrush_batch_job* jobs, const uint32_t max_job_count, const uint8_t* const* inputs, const size_t* input_lengths, const size_t count, const uint32_t buffer_size_kib)
+{
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += CCRUSH_MIN(input_lengths[i], SIZE_MAX - total);
+    }
+
+    const uint32_t job_count = (uint32_t)CCRUSH_MAX(1, CCRUSH_MIN((size_t)max_job_count, CCRUSH_MIN(count, total / CCRUSH_BATCH_MIN_JOB_SIZE)));
+    const size_t share = total / job_count;
+
+    size_t next = 0;
+
+    for (uint32_t j = 0; j < job_count; ++j)
+    {
+        struct ccrush_batch_job* job = &jobs[j];
+
+        job->inputs = inputs;
+        job->input_lengths = input_lengths;
+        job->first = next;
+
+        size_t job_total = 0;
+
+        // Leave at least one record for each of the remaining jobs.
+        while (next < count - (job_count - 1 - j) && (j == job_count - 1 || job_total < share || next == job->first))
+        {
+            job_total += input_lengths[next++];
+        }
+
+        job->last = next;
+
+        ccrush_ctx_setup(&job->ctx, buffer_size_kib);
+    }
+
+    return job_count;
+}
+
+int ccrush_compress_batch(const uint8_t* const* inputs, const size_t* input_lengths, const size_t count, const int level, uint32_t thread_count, uint8_t** out, size_t* out_length, size_t* out_offsets)
+{
+    if (ccrush_batch_args_invalid(inputs, input_lengths, count, out, out_length, out_offsets))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    int r = 0;
+
+    thread_count = ccrush_resolve_thread_count(thread_count);
+
+    uint8_t* output = NULL;
+    size_t output_capacity = 0;
+
+    size_t* bound_offsets = ccrush_mem_alloc((count + 1) * sizeof(size_t));
+    size_t* output_lengths = ccrush_mem_alloc(count * sizeof(size_t));
+    struct ccrush_batch_job* jobs = ccrush_mem_calloc(thread_count, sizeof(struct ccrush_batch_job));
+
+    if (bound_offsets == NULL || output_lengths == NULL || jobs == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    // Every record deflates into its own worst-case region of one single output arena; the regions are compacted afterwards.
+    bound_offsets[0] = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const size_t bound = ccrush_compress_bound(input_lengths[i]);
+
+        if (bound > SIZE_MAX - 1 - bound_offsets[i])
+        {
+            r = CCRUSH_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+
+        bound_offsets[i + 1] = bound_offsets[i] + bound;
+    }
+
+    output_capacity = bound_offsets[count] + 1;
+
+    output = ccrush_mem_alloc(output_capacity);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    const uint32_t job_count = ccrush_batch_setup_jobs(jobs, thread_count, inputs, input_lengths, count, 0);
+
+    for (uint32_t j = 0; j < job_count; ++j)
+    {
+        jobs[j].level = level < 0 || level > 9 ? 6 : level;
+        jobs[j].arena = output;
+        jobs[j].bound_offsets = bound_offsets;
+        jobs[j].output_lengths = output_lengths;
+    }
+
+    ccrush_run_jobs(jobs, sizeof(struct ccrush_batch_job), job_count, &ccrush_compress_batch_job);
+
+    for (uint32_t j = 0; j < job_count; ++j)
+    {
+        if (r == 0)
+        {
+            r = jobs[j].r;
+        }
+
+        ccrush_ctx_teardown(&jobs[j].ctx);
+    }
+
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    size_t output_length = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        memmove(output + output_length, output + bound_offsets[i], output_lengths[i]);
+
+        out_offsets[i] = output_length;
+        output_length += output_lengths[i];
+    }
+
+    out_offsets[count] = output_length;
+    output[output_length] = 0x00;
+
+    *out = ccrush_mem_shrink(output, output_length + 1);
+    *out_length = output_length;
+
+    output = NULL;
+
+exit:
+
+    if (output != NULL)
+    {
+        ccrush_scrub(output, output_capacity, ccrush_scrub_buffers);
+        ccrush_mem_free(output);
+    }
+
+    ccrush_mem_free(bound_offsets);
+    ccrush_mem_free(output_lengths);
+    ccrush_mem_free(jobs);
+
+    return (r);
+}
+
+int ccrush_decompress_batch(const uint8_t* const* inputs, const size_t* input_lengths, const size_t count, const uint32_t buffer_size_kib, uint32_t thread_count, uint8_t** out, size_t* out_length, size_t* out_offsets)
+{
+    if (ccrush_batch_args_invalid(inputs, input_lengths, count, out, out_length, out_offsets))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    int r = 0;
+    uint32_t job_count = 0;
+
+    thread_count = ccrush_resolve_thread_count(thread_count);
+
+    size_t* output_lengths = ccrush_mem_alloc(count * sizeof(size_t));
+    struct ccrush_batch_job* jobs = ccrush_mem_calloc(thread_count, sizeof(struct ccrush_batch_job));
+
+    if (output_lengths == NULL || jobs == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    job_count = ccrush_batch_setup_jobs(jobs, thread_count, inputs, input_lengths, count, buffer_size_kib);
+
+    for (uint32_t j = 0; j < job_count; ++j)
+    {
+        jobs[j].output_lengths = output_lengths;
+    }
+
+    ccrush_run_jobs(jobs, sizeof(struct ccrush_batch_job), job_count, &ccrush_decompress_batch_job);
+
+    size_t output_length = 0;
+
+    for (uint32_t j = 0; j < job_count && r == 0; ++j)
+    {
+        r = jobs[j].r;
+        output_length += jobs[j].ctx.output.length;
+    }
+
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    // The jobs' records are contiguous and in order, so their outputs just need to be concatenated.
+    uint8_t* output = ccrush_mem_alloc(output_length + 1);
+    if (output == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    size_t offset = 0;
+
+    for (uint32_t j = 0; j < job_count; ++j)
+    {
+        memcpy(output + offset, jobs[j].ctx.output.array, jobs[j].ctx.output.length);
+        offset += jobs[j].ctx.output.length;
+    }
+
+    offset = 0;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        out_offsets[i] = offset;
+        offset += output_lengths[i];
+    }
+
+    out_offsets[count] = offset;
+    output[output_length] = 0x00;
+
+    *out = output;
+    *out_length = output_length;
+
+exit:
+
+    if (jobs != NULL)
+    {
+        for (uint32_t j = 0; j < job_count; ++j)
+        {
+            ccrush_ctx_teardown(&jobs[j].ctx);
+        }
+    }
+
+    ccrush_mem_free(output_lengths);
+    ccrush_mem_free(jobs);
+
+    return (r);
+}
+
+/*
+ * Block container layout (all integers little-endian):
+ *
+ *   header:     magic #CCRUSH_CONTAINER_MAGIC, u32 block size (uncompressed)
+ *   blocks:     u32 compressed length, u32 uncompressed length, u32 Adler-32 of the uncompressed block, raw deflate data
+ *   terminator: an all-zero block header
+ *   table:      one entry per block: u64 file offset of the block header, u32 compressed length, u32 uncompressed length
+ *   footer:     u64 file offset of the table, u64 block count, u64 total uncompressed length, magic #CCRUSH_CONTAINER_MAGIC
+ *
+ * Every block is a complete, independent raw deflate stream: blocks can be (de)compressed concurrently and decoded on their own.
+ * The terminator makes the blocks readable front to back from a pipe; the table and footer make any single block reachable with two seeks.
+ */
+#define CCRUSH_CONTAINER_HEADER_LENGTH (4 + 4)
+#define CCRUSH_CONTAINER_BLOCK_HEADER_LENGTH (4 + 4 + 4)
+#define CCRUSH_CONTAINER_TABLE_ENTRY_LENGTH (8 + 4 + 4)
+#define CCRUSH_CONTAINER_FOOTER_LENGTH (8 + 8 + 8 + 4)
+
+static inline void ccrush_store_u32le(uint8_t* out, const uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static inline uint32_t ccrush_load_u32le(const uint8_t* in)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        value |= ((uint32_t)in[i]) << (8 * i);
+    }
+
+    return value;
+}
+
+/*
+ * Counterpart of struct ccrush_deflate_block: one raw inflate of a complete container block into an output buffer of exactly the block's uncompressed length.
+ */
+struct ccrush_inflate_block
+{
+    z_stream stream;
+    int stream_initialized;
+    uint8_t* input;
+    size_t input_length;
+    uint8_t* output;
+    size_t output_length;
+    uLong adler;
+    int r;
+};
+
+static void ccrush_inflate_block_job(void* job)
+{
+    struct ccrush_inflate_block* block = (struct ccrush_inflate_block*)job;
+
+    if (!block->stream_initialized)
+    {
+        ccrush_zstream_setup(&block->stream, &ccrush_global_allocator);
+    }
+
+    int r = block->stream_initialized ? inflateReset(&block->stream) : inflateInit2(&block->stream, -MAX_WBITS);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    block->stream_initialized = 1;
+
+    assert(block->input_length <= UINT32_MAX && block->output_length <= UINT32_MAX);
+
+    block->stream.next_in = block->input;
+    block->stream.avail_in = (uInt)block->input_length;
+    block->stream.next_out = block->output;
+    block->stream.avail_out = (uInt)block->output_length;
+
+    r = inflate(&block->stream, Z_FINISH);
+
+    // The block must end exactly where its header says it does (both in its compressed and uncompressed form), and match its checksum.
+    if (r != Z_STREAM_END || block->stream.avail_in != 0 || block->stream.avail_out != 0 || adler32_z(adler32(0L, Z_NULL, 0), block->output, (z_size_t)block->output_length) != block->adler)
+    {
+        r = r == Z_MEM_ERROR ? r : Z_DATA_ERROR;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:
+    block->r = r;
+}
+
+static void ccrush_inflate_block_free(struct ccrush_inflate_block* block)
+{
+    if (block->stream_initialized)
+    {
+        inflateEnd(&block->stream);
+    }
+
+    memset(&block->stream, 0x00, sizeof(z_stream));
+    block->stream_initialized = 0;
+}
+
+int ccrush_compress_container_file_raw(FILE* input_file, FILE* output_file, uint32_t block_size_kib, int level, uint32_t thread_count, int close_input_file, int close_output_file)
+{
+    if (!input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (block_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    thread_count = ccrush_resolve_thread_count(thread_count);
+    level = level < 0 || level > 9 ? 6 : level;
+
+    int r = 0;
+
+    const size_t blocksize = (size_t)(block_size_kib ? block_size_kib : CCRUSH_DEFAULT_CONTAINER_BLOCK_SIZE_KiB) * 1024;
+    const size_t output_capacity = ccrush_deflate_block_bound(blocksize);
+
+    struct ccrush_growbuf table = { 0 };
+    struct ccrush_deflate_block* blocks = ccrush_mem_calloc(thread_count, sizeof(struct ccrush_deflate_block));
+
+    if (blocks == NULL || ccrush_growbuf_init(&table, &ccrush_global_allocator, CCRUSH_CONTAINER_TABLE_ENTRY_LENGTH * 64) != 0)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        blocks[i].input = ccrush_mem_alloc(blocksize);
+        blocks[i].output = ccrush_mem_alloc(output_capacity);
+
+        if (blocks[i].input == NULL || blocks[i].output == NULL)
+        {
+            r = CCRUSH_ERROR_OUT_OF_MEMORY;
+            goto exit;
+        }
+
+        blocks[i].level = level;
+        blocks[i].last = 1;
+        blocks[i].output_capacity = output_capacity;
+    }
+
+    uint8_t header[CCRUSH_CONTAINER_HEADER_LENGTH];
+    memcpy(header, CCRUSH_CONTAINER_MAGIC, 4);
+    ccrush_store_u32le(header + 4, (uint32_t)blocksize);
+
+    if (fwrite(header, sizeof(uint8_t), sizeof(header), output_file) != sizeof(header))
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    uint64_t offset = CCRUSH_CONTAINER_HEADER_LENGTH;
+    uint64_t block_count = 0;
+    uint64_t total_uncompressed_length = 0;
+
+    int eof = 0;
+
+    while (!eof)
+    {
+        uint32_t count = 0;
+
+        while (count < thread_count && !eof)
+        {
+            struct ccrush_deflate_block* block = &blocks[count];
+
+            block->input_length = fread((uint8_t*)block->input, sizeof(uint8_t), blocksize, input_file);
+            if (ferror(input_file))
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+            eof = block->input_length < blocksize;
+
+            if (block->input_length != 0)
+            {
+                ++count;
+            }
+        }
+
+        ccrush_run_jobs(blocks, sizeof(struct ccrush_deflate_block), count, &ccrush_deflate_block_job);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const struct ccrush_deflate_block* block = &blocks[i];
+
+            if (block->r != 0)
+            {
+                r = block->r;
+                goto exit;
+            }
+
+            uint8_t block_header[CCRUSH_CONTAINER_BLOCK_HEADER_LENGTH];
+            ccrush_store_u32le(block_header, (uint32_t)block->output_length);
+            ccrush_store_u32le(block_header + 4, (uint32_t)block->input_length);
+            ccrush_store_u32le(block_header + 8, (uint32_t)block->adler);
+
+            uint8_t table_entry[CCRUSH_CONTAINER_TABLE_ENTRY_LENGTH];
+            ccrush_store_u64le(table_entry, offset);
+            memcpy(table_entry + 8, block_header, 8);
+
+            if (ccrush_growbuf_push_back(&table, table_entry, sizeof(table_entry), 0) != 0)
+            {
+                r = CCRUSH_ERROR_OUT_OF_MEMORY;
+                goto exit;
+            }
+
+            if (fwrite(block_header, sizeof(uint8_t), sizeof(block_header), output_file) != sizeof(block_header) || fwrite(block->output, sizeof(uint8_t), block->output_length, output_file) != block->output_length || ferror(output_file))
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+            offset += CCRUSH_CONTAINER_BLOCK_HEADER_LENGTH + block->output_length;
+            total_uncompressed_length += block->input_length;
+            ++block_count;
+        }
+    }
+
+    const uint8_t terminator[CCRUSH_CONTAINER_BLOCK_HEADER_LENGTH] = { 0x00 };
+    offset += CCRUSH_CONTAINER_BLOCK_HEADER_LENGTH;
+
+    uint8_t footer[CCRUSH_CONTAINER_FOOTER_LENGTH];
+    ccrush_store_u64le(footer, offset);
+    ccrush_store_u64le(footer + 8, block_count);
+    ccrush_store_u64le(footer + 16, total_uncompressed_length);
+    memcpy(footer + 24, CCRUSH_CONTAINER_MAGIC, 4);
+
+    if (fwrite(terminator, sizeof(uint8_t), sizeof(terminator), output_file) != sizeof(terminator) || fwrite(table.array, sizeof(uint8_t), table.length, output_file) != table.length || fwrite(footer, sizeof(uint8_t), sizeof(footer), output_file) != sizeof(footer) || ferror(output_file))
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:
+
+    if (blocks != NULL)
+    {
+        for (uint32_t i = 0; i < thread_count; ++i)
+        {
+            ccrush_deflate_block_free(&blocks[i]);
+
+            if (blocks[i].input != NULL)
+            {
+                ccrush_scrub((uint8_t*)blocks[i].input, blocksize, ccrush_scrub_buffers);
+                ccrush_mem_free((uint8_t*)blocks[i].input);
+            }
+
+            if (blocks[i].output != NULL)
+            {
+                ccrush_scrub(blocks[i].output, output_capacity, ccrush_scrub_buffers);
+                ccrush_mem_free(blocks[i].output);
+            }
+        }
+
+        ccrush_mem_free(blocks);
+    }
+
+    ccrush_growbuf_free(&table);
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_compress_container_file(const char* input_file_path, const char* output_file_path, uint32_t block_size_kib, int level, uint32_t thread_count)
+{
+    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (block_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return ccrush_compress_container_file_raw(input_file, output_file, block_size_kib, level, thread_count, 1, 1);
+}
+
+/*
+ * Reads and validates a container's header, returning its (uncompressed) block size.
+ */
+static int ccrush_read_container_header(FILE* input_file, size_t* out_blocksize)
+{
+    uint8_t header[CCRUSH_CONTAINER_HEADER_LENGTH];
+
+    if (fread(header, sizeof(uint8_t), sizeof(header), input_file) != sizeof(header))
+    {
+        return ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
+    }
+
+    const uint32_t blocksize = ccrush_load_u32le(header + 4);
+
+    if (memcmp(header, CCRUSH_CONTAINER_MAGIC, 4) != 0 || blocksize == 0 || blocksize > (uint32_t)CCRUSH_MAX_BUFFER_SIZE_KiB * 1024)
+    {
+        return Z_DATA_ERROR;
+    }
+
+    *out_blocksize = blocksize;
+    return 0;
+}
+
+/*
+ * Reads one block header. Returns <c>0</c> with *out_end set when the terminator was read instead.
+ * The lengths are validated against the container's block size, so that a corrupt header can't trigger oversized allocations.
+ */
+static int ccrush_read_container_block_header(FILE* input_file, const size_t blocksize, struct ccrush_inflate_block* block, int* out_end)
+{
+    uint8_t block_header[CCRUSH_CONTAINER_BLOCK_HEADER_LENGTH];
+
+    if (fread(block_header, sizeof(uint8_t), sizeof(block_header), input_file) != sizeof(block_header))
+    {
+        return ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
+    }
+
+    const uint32_t compressed_length = ccrush_load_u32le(block_header);
+    const uint32_t uncompressed_length = ccrush_load_u32le(block_header + 4);
+
+    *out_end = compressed_length == 0 && uncompressed_length == 0;
+
+    if (*out_end)
+    {
+        return 0;
+    }
+
+    if (compressed_length == 0 || uncompressed_length == 0 || uncompressed_length > blocksize || compressed_length > ccrush_deflate_block_bound(blocksize))
+    {
+        return Z_DATA_ERROR;
+    }
+
+    block->input_length = compressed_length;
+    block->output_length = uncompressed_length;
+    block->adler = ccrush_load_u32le(block_header + 8);
+
+    return 0;
+}
+
+int ccrush_decompress_container_file_raw(FILE* input_file, FILE* output_file, uint32_t thread_count, int close_input_file, int close_output_file)
+{
+    if (!input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    thread_count = ccrush_resolve_thread_count(thread_count);
+
+    int r;
+
+    size_t blocksize = 0;
+    size_t input_capacity = 0;
+
+    struct ccrush_inflate_block* blocks = NULL;
+
+    r = ccrush_read_container_header(input_file, &blocksize);
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    input_capacity = ccrush_deflate_block_bound(blocksize);
+
+    blocks = ccrush_mem_calloc(thread_count, sizeof(struct ccrush_inflate_block));
+    if (blocks == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    uint64_t block_count = 0;
+    uint64_t total_uncompressed_length = 0;
+
+    int end = 0;
+    int short_block_seen = 0;
+
+    while (!end)
+    {
+        uint32_t count = 0;
+
+        while (count < thread_count)
+        {
+            struct ccrush_inflate_block* block = &blocks[count];
+
+            r = ccrush_read_container_block_header(input_file, blocksize, block, &end);
+            if (r != 0)
+            {
+                goto exit;
+            }
+
+            if (end)
+            {
+                break;
+            }
+
+            // Only the last block may be shorter than the container's block size.
+            if (short_block_seen)
+            {
+                r = Z_DATA_ERROR;
+                goto exit;
+            }
+
+            short_block_seen = block->output_length < blocksize;
+
+            // Buffers are allocated lazily: small containers don't need a full set of worst-case sized buffers for every thread.
+            if (block->input == NULL)
+            {
+                block->input = ccrush_mem_alloc(input_capacity);
+                block->output = ccrush_mem_alloc(blocksize);
+
+                if (block->input == NULL || block->output == NULL)
+                {
+                    r = CCRUSH_ERROR_OUT_OF_MEMORY;
+                    goto exit;
+                }
+            }
+
+            if (fread(block->input, sizeof(uint8_t), block->input_length, input_file) != block->input_length)
+            {
+                r = ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
+                goto exit;
+            }
+
+            ++count;
+        }
+
+        ccrush_run_jobs(blocks, sizeof(struct ccrush_inflate_block), count, &ccrush_inflate_block_job);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const struct ccrush_inflate_block* block = &blocks[i];
+
+            if (block->r != 0)
+            {
+                r = block->r;
+                goto exit;
+            }
+
+            if (fwrite(block->output, sizeof(uint8_t), block->output_length, output_file) != block->output_length || ferror(output_file))
+            {
+                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+                goto exit;
+            }
+
+            total_uncompressed_length += block->output_length;
+            ++block_count;
+        }
+    }
+
+    // Skip over the block table (it's only needed for random access) and cross-check the footer with what was actually decompressed.
+    for (uint64_t i = 0; i < block_count; ++i)
+    {
+        uint8_t table_entry[CCRUSH_CONTAINER_TABLE_ENTRY_LENGTH];
+
+        if (fread(table_entry, sizeof(uint8_t), sizeof(table_entry), input_file) != sizeof(table_entry))
+        {
+            r = ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
+            goto exit;
+        }
+    }
+
+    uint8_t footer[CCRUSH_CONTAINER_FOOTER_LENGTH];
+
+    if (fread(footer, sizeof(uint8_t), sizeof(footer), input_file) != sizeof(footer))
+    {
+        r = ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
+        goto exit;
+    }
+
+    if (ccrush_load_u64le(footer + 8) != block_count || ccrush_load_u64le(footer + 16) != total_uncompressed_length || memcmp(footer + 24, CCRUSH_CONTAINER_MAGIC, 4) != 0)
+    {
+        r = Z_DATA_ERROR;
+        goto exit;
+    }
+
+    r = 0;
+
+exit:
+
+    if (blocks != NULL)
+    {
+        for (uint32_t i = 0; i < thread_count; ++i)
+        {
+            ccrush_inflate_block_free(&blocks[i]);
+
+            if (blocks[i].input != NULL)
+            {
+                ccrush_scrub(blocks[i].input, input_capacity, ccrush_scrub_buffers);
+                ccrush_mem_free(blocks[i].input);
+            }
+
+            if (blocks[i].output != NULL)
+            {
+                ccrush_scrub(blocks[i].output, blocksize, ccrush_scrub_buffers);
+                ccrush_mem_free(blocks[i].output);
+            }
+        }
+
+        ccrush_mem_free(blocks);
+    }
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_decompress_container_file(const char* input_file_path, const char* output_file_path, uint32_t thread_count)
+{
+    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return ccrush_decompress_container_file_raw(input_file, output_file, thread_count, 1, 1);
+}
+
+int ccrush_container_get_block_count(FILE* input_file, uint64_t* out_block_count)
+{
+    if (input_file == NULL || out_block_count == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    uint8_t footer[CCRUSH_CONTAINER_FOOTER_LENGTH];
+
+    if (fseek(input_file, -(long)CCRUSH_CONTAINER_FOOTER_LENGTH, SEEK_END) != 0 || fread(footer, sizeof(uint8_t), sizeof(footer), input_file) != sizeof(footer))
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    if (memcmp(footer + 24, CCRUSH_CONTAINER_MAGIC, 4) != 0)
+    {
+        return Z_DATA_ERROR;
+    }
+
+    *out_block_count = ccrush_load_u64le(footer + 8);
+    return 0;
+}
+
+int ccrush_container_decompress_block(FILE* input_file, const uint64_t block_index, uint8_t** out, size_t* out_length)
+{
+    if (input_file == NULL || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    int r;
+
+    size_t blocksize = 0;
+    uint64_t block_count = 0;
+
+    struct ccrush_inflate_block block;
+    memset(&block, 0x00, sizeof(block));
+
+    r = ccrush_container_get_block_count(input_file, &block_count);
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    if (block_index >= block_count)
+    {
+        r = CCRUSH_ERROR_INVALID_ARGS;
+        goto exit;
+    }
+
+    uint8_t footer[CCRUSH_CONTAINER_FOOTER_LENGTH];
+    uint8_t table_entry[CCRUSH_CONTAINER_TABLE_ENTRY_LENGTH];
+
+    if (fseek(input_file, -(long)CCRUSH_CONTAINER_FOOTER_LENGTH, SEEK_END) != 0 || fread(footer, sizeof(uint8_t), sizeof(footer), input_file) != sizeof(footer))
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    if (ccrush_fseek64(input_file, 0) != 0 || (r = ccrush_read_container_header(input_file, &blocksize)) != 0)
+    {
+        r = r ? r : CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    if (ccrush_fseek64(input_file, ccrush_load_u64le(footer) + block_index * CCRUSH_CONTAINER_TABLE_ENTRY_LENGTH) != 0 || fread(table_entry, sizeof(uint8_t), sizeof(table_entry), input_file) != sizeof(table_entry))
+    {
+        r = Z_DATA_ERROR;
+        goto exit;
+    }
+
+    int end = 0;
+
+    if (ccrush_fseek64(input_file, ccrush_load_u64le(table_entry)) != 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    r = ccrush_read_container_block_header(input_file, blocksize, &block, &end);
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    if (end || block.input_length != ccrush_load_u32le(table_entry + 8) || block.output_length != ccrush_load_u32le(table_entry + 12))
+    {
+        r = Z_DATA_ERROR;
+        goto exit;
+    }
+
+    block.input = ccrush_mem_alloc(block.input_length);
+    block.output = ccrush_mem_alloc(block.output_length + 1);
+
+    if (block.input == NULL || block.output == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    if (fread(block.input, sizeof(uint8_t), block.input_length, input_file) != block.input_length)
+    {
+        r = ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
+        goto exit;
+    }
+
+    ccrush_inflate_block_job(&block);
+
+    r = block.r;
+    if (r != 0)
+    {
+        goto exit;
+    }
+
+    block.output[block.output_length] = 0x00;
+
+    *out = block.output;
+    *out_length = block.output_length;
+
+    block.output = NULL;
+
+exit:
+
+    ccrush_inflate_block_free(&block);
+
+    if (block.input != NULL)
+    {
+        ccrush_scrub(block.input, block.input_length, ccrush_scrub_buffers);
+        ccrush_mem_free(block.input);
+    }
+
+    if (block.output != NULL)
+    {
+        ccrush_scrub(block.output, block.output_length, ccrush_scrub_buffers);
+        ccrush_mem_free(block.output);
+    }
+
+    return (r);
+}
+
+int ccrush_ctx_new(const uint32_t buffer_size_kib, ccrush_ctx** out_ctx)
+{
+    return ccrush_ctx_new_ex(buffer_size_kib, NULL, NULL, NULL, out_ctx);
+}
+
+int ccrush_ctx_new_ex(const uint32_t buffer_size_kib, ccrush_alloc_function alloc_function, ccrush_free_function free_function, void* user, ccrush_ctx** out_ctx)
+{
+    if (out_ctx == NULL || (alloc_function == NULL) != (free_function == NULL))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    struct ccrush_allocator allocator = ccrush_global_allocator;
+
+    if (alloc_function != NULL)
+    {
+        allocator.alloc = alloc_function;
+        allocator.free = free_function;
+        allocator.user = user;
+    }
+
+    ccrush_ctx* ctx = ccrush_allocator_alloc(&allocator, sizeof(ccrush_ctx));
+    if (ctx == NULL)
+    {
+        return CCRUSH_ERROR_OUT_OF_MEMORY;
+    }
+
+    ccrush_ctx_setup(ctx, buffer_size_kib);
+    ctx->allocator = allocator;
+
+    *out_ctx = ctx;
+    return 0;
+}
+
+void ccrush_ctx_free(ccrush_ctx* ctx)
+{
+    if (ctx == NULL)
+    {
+        return;
+    }
+
+    // The context itself was allocated using its own allocator, which the teardown wipes.
+    const struct ccrush_allocator allocator = ctx->allocator;
+
+    ccrush_ctx_teardown(ctx);
+    ccrush_allocator_free(&allocator, ctx);
+}
+
+int ccrush_ctx_compress(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, const int level, uint8_t** out, size_t* out_length)
+{
+    if (ctx == NULL || data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    return ccrush_compress_alloc_impl(ctx, data, data_length, level, 0, out, out_length);
+}
+
+int ccrush_ctx_compress_into(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, const int level, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    if (ctx == NULL || data == NULL || data_length == 0 || out == NULL || out_capacity == 0 || out_written == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    return ccrush_compress_into_impl(ctx, data, data_length, level, out, out_capacity, out_written);
+}
+
+int ccrush_ctx_decompress(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, uint8_t** out, size_t* out_length)
+{
+    if (ctx == NULL || data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    return ccrush_decompress_impl(ctx, data, data_length, out, out_length);
+}
+
+int ccrush_ctx_decompress_into(ccrush_ctx* ctx, const uint8_t* data, const size_t data_length, uint8_t* out, const size_t out_capacity, size_t* out_written)
+{
+    if (ctx == NULL || data == NULL || data_length == 0 || out == NULL || out_capacity == 0 || out_written == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    return ccrush_decompress_into_impl(ctx, data, data_length, out, out_capacity, out_written);
+}
+
+int ccrush_ctx_compress_file_raw(ccrush_ctx* ctx, FILE* input_file, FILE* output_file, const int level, const int close_input_file, const int close_output_file)
+{
+    if (ctx == NULL || !input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    const int r = ccrush_compress_file_raw_impl(ctx, input_file, output_file, level);
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_ctx_compress_file(ccrush_ctx* ctx, const char* input_file_path, const char* output_file_path, const int level)
+{
+    if (ctx == NULL || !input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return ccrush_compress_file_path_impl(ctx, input_file, output_file, level);
+}
+
+int ccrush_ctx_decompress_file_raw(ccrush_ctx* ctx, FILE* input_file, FILE* output_file, const int close_input_file, const int close_output_file)
+{
+    if (ctx == NULL || !input_file || !output_file || input_file == output_file)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    const int r = ccrush_decompress_file_raw_impl(ctx, input_file, output_file);
+
+    if (close_input_file)
+    {
+        fclose(input_file);
+    }
+
+    if (close_output_file)
+    {
+        fclose(output_file);
+    }
+
+    return (r);
+}
+
+int ccrush_ctx_decompress_file(ccrush_ctx* ctx, const char* input_file_path, const char* output_file_path)
+{
+    if (ctx == NULL || !input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    ccrush_ctx_stats_begin(ctx);
+
+    FILE* input_file = NULL;
+    FILE* output_file = NULL;
+
+    if (ccrush_fopen_pair(input_file_path, output_file_path, &input_file, &output_file) != 0)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return ccrush_decompress_file_path_impl(ctx, input_file, output_file);
+}
+
+struct ccrush_stream
+{
+    int mode;
+    z_stream zstream;
+    int zstream_initialized;
+    int finished;
+    int r;
+    unsigned int buffersize;
+    uint8_t* output_buffer;
+    ccrush_stream_write_function write_function;
+    void* user;
+    int scrub;
+    uint8_t size_header[CCRUSH_SIZE_HEADER_LENGTH];
+    size_t size_header_length;
+    int size_header_checked;
+};
+
+/*
+ * Pushes the passed input through the stream's z_stream, handing every filled output buffer to the write callback,
+ * until all of the input is consumed and (for the passed flush mode) no more output is pending.
+ */
+static int ccrush_stream_pump(ccrush_stream* stream, const uint8_t* data, const size_t data_length, const int flush)
+{
+    z_stream* zstream = &stream->zstream;
+    const int deflating = stream->mode == CCRUSH_STREAM_MODE_COMPRESS;
+
+    zstream->next_in = (Bytef*)data;
+    zstream->avail_in = 0;
+
+    size_t remaining = data_length;
+
+    for (;;)
+    {
+        if (zstream->avail_in == 0)
+        {
+            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)UINT_MAX, remaining));
+
+            zstream->avail_in = n;
+            remaining -= n;
+        }
+
+        zstream->next_out = stream->output_buffer;
+        zstream->avail_out = stream->buffersize;
+
+        int r = deflating ? deflate(zstream, remaining ? Z_NO_FLUSH : flush) : inflate(zstream, Z_NO_FLUSH);
+
+        const unsigned int produced = stream->buffersize - zstream->avail_out;
+
+        if (produced != 0)
+        {
+            const int w = stream->write_function(stream->user, stream->output_buffer, produced);
+            if (w != 0)
+            {
+                return w;
+            }
+        }
+
+        if (r == Z_STREAM_END)
+        {
+            stream->finished = 1;
+
+            // Anything after the end of a zlib stream is trailing garbage.
+            return zstream->avail_in != 0 || remaining != 0 ? Z_DATA_ERROR : 0;
+        }
+
+        if (r == Z_NEED_DICT)
+        {
+            return Z_DATA_ERROR;
+        }
+
+        if (r != Z_OK && r != Z_BUF_ERROR)
+        {
+            return r;
+        }
+
+        // Z_BUF_ERROR just means that no progress was possible: with all of the input consumed and the output drained, that's the normal end of a call.
+        if (zstream->avail_in == 0 && remaining == 0 && zstream->avail_out != 0)
+        {
+            return 0;
+        }
+    }
+}
+
+/*
+ * Strips a leading size header (as written by ccrush_compress_with_size_header()) off of the first bytes fed into a decompression stream,
+ * even if it arrives split across several ccrush_stream_update() calls. Advances the passed data pointer and length past the consumed bytes.
+ */
+static int ccrush_stream_skip_size_header(ccrush_stream* stream, const uint8_t** data, size_t* data_length)
+{
+    while (!stream->size_header_checked && *data_length != 0)
+    {
+        const uint8_t byte = **data;
+
+        if (stream->size_header_length < 4 && byte != (uint8_t)CCRUSH_SIZE_HEADER_MAGIC[stream->size_header_length])
+        {
+            if (stream->size_header_length != 0)
+            {
+                // Started out like a size header but wasn't one: such data can't be a valid zlib stream either.
+                return Z_DATA_ERROR;
+            }
+
+            stream->size_header_checked = 1;
+            break;
+        }
+
+        stream->size_header[stream->size_header_length++] = byte;
+
+        *data += 1;
+        *data_length -= 1;
+
+        if (stream->size_header_length == CCRUSH_SIZE_HEADER_LENGTH)
+        {
+            stream->size_header_checked = 1;
+        }
+    }
+
+    return 0;
+}
+
+int ccrush_stream_init(ccrush_stream** out_stream, const int mode, const int level, const uint32_t buffer_size_kib, ccrush_stream_write_function write_function, void* user)
+{
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.level = level;
+
+    return ccrush_stream_init_ex(out_stream, mode, &params, buffer_size_kib, write_function, user);
+}
+
+int ccrush_stream_init_ex(ccrush_stream** out_stream, const int mode, const ccrush_params* params, const uint32_t buffer_size_kib, ccrush_stream_write_function write_function, void* user)
+{
+    if (out_stream == NULL || write_function == NULL || (mode != CCRUSH_STREAM_MODE_COMPRESS && mode != CCRUSH_STREAM_MODE_DECOMPRESS) || ccrush_params_invalid(params))
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    {
+        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+    }
+
+    int r;
+
+    ccrush_stream* stream = ccrush_mem_calloc(1, sizeof(ccrush_stream));
+    if (stream == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    stream->mode = mode;
+    stream->buffersize = ccrush_get_buffersize(buffer_size_kib);
+    stream->write_function = write_function;
+    stream->user = user;
+    stream->scrub = ccrush_scrub_buffers;
+    stream->size_header_checked = mode == CCRUSH_STREAM_MODE_COMPRESS || params->header != CCRUSH_HEADER_ZLIB;
+
+    stream->output_buffer = ccrush_mem_alloc(stream->buffersize);
+    if (stream->output_buffer == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    ccrush_zstream_setup(&stream->zstream, &ccrush_global_allocator);
+
+    const int level = params->level < 0 || params->level > 9 ? 6 : params->level;
+    const int window_bits = ccrush_params_window_bits(params);
+    const int mem_level = params->mem_level != 0 ? params->mem_level : 8;
+
+    r = mode == CCRUSH_STREAM_MODE_COMPRESS ? deflateInit2(&stream->zstream, level, Z_DEFLATED, window_bits, mem_level, params->strategy) : inflateInit2(&stream->zstream, window_bits);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    stream->zstream_initialized = 1;
+
+    *out_stream = stream;
+    stream = NULL;
+    r = 0;
+
+exit:
+    ccrush_stream_free(stream);
+    return (r);
+}
+
+int ccrush_stream_update(ccrush_stream* stream, const uint8_t* data, size_t data_length)
 {
-#ifdef _WIN32
-    wchar_t* wpath = malloc(CCRUSH_MAX_WIN_FILEPATH_LENGTH * sizeof(wchar_t));
-    if (wpath == NULL)
+    if (stream == NULL || (data == NULL && data_length != 0))
     {
-        return NULL;
+        return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    wchar_t wmode[256];
+    if (stream->r != 0)
+    {
+        return stream->r;
+    }
 
-    wpath[0] = 0x00;
-    wmode[0] = 0x00;
+    if (data_length == 0)
+    {
+        return 0;
+    }
 
-    MultiByteToWideChar(CP_UTF8, 0, filename, -1, wpath, CCRUSH_MAX_WIN_FILEPATH_LENGTH);
-    MultiByteToWideChar(CP_UTF8, 0, mode, -1, wmode, 256);
+    if (stream->finished)
+    {
+        return stream->r = stream->mode == CCRUSH_STREAM_MODE_COMPRESS ? Z_STREAM_ERROR : Z_DATA_ERROR;
+    }
 
-    FILE* file = _wfopen(wpath, wmode);
-    free(wpath);
-    return file;
-#else // Hope that the fopen() implementation on whatever platform you're on accepts UTF-8 encoded strings. For most *nix environments, this holds true :)
-    return fopen(filename, mode);
-#endif
+    stream->r = ccrush_stream_skip_size_header(stream, &data, &data_length);
+
+    if (stream->r == 0 && data_length != 0)
+    {
+        stream->r = ccrush_stream_pump(stream, data, data_length, Z_NO_FLUSH);
+    }
+
+    return stream->r;
 }
 
-int ccrush_compress(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, const int level, uint8_t** out, size_t* out_length)
+int ccrush_stream_flush(ccrush_stream* stream)
 {
-    if (data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    if (stream == NULL)
     {
         return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    if (buffer_size_kib >= CCRUSH_MAX_BUFFER_SIZE_KiB)
+    if (stream->r != 0 || stream->mode != CCRUSH_STREAM_MODE_COMPRESS || stream->finished)
     {
-        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+        return stream->r;
+    }
+
+    return stream->r = ccrush_stream_pump(stream, NULL, 0, Z_SYNC_FLUSH);
+}
+
+int ccrush_stream_finish(ccrush_stream* stream)
+{
+    if (stream == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (stream->r != 0 || stream->finished)
+    {
+        return stream->r;
+    }
+
+    // A decompression stream that hasn't seen the end of its zlib stream yet was fed truncated data.
+    stream->r = stream->mode == CCRUSH_STREAM_MODE_COMPRESS ? ccrush_stream_pump(stream, NULL, 0, Z_FINISH) : Z_DATA_ERROR;
+
+    return stream->r;
+}
+
+void ccrush_stream_free(ccrush_stream* stream)
+{
+    if (stream == NULL)
+    {
+        return;
+    }
+
+    if (stream->zstream_initialized)
+    {
+        if (stream->mode == CCRUSH_STREAM_MODE_COMPRESS)
+        {
+            deflateEnd(&stream->zstream);
+        }
+        else
+        {
+            inflateEnd(&stream->zstream);
+        }
+    }
+
+    if (stream->output_buffer != NULL)
+    {
+        ccrush_scrub(stream->output_buffer, stream->buffersize, stream->scrub);
+        ccrush_mem_free(stream->output_buffer);
+    }
+
+    ccrush_scrub(stream, sizeof(ccrush_stream), stream->scrub);
+    ccrush_mem_free(stream);
+}
+
+/*
+ * Size of the compressed input chunks read while building an index or extracting a range
+ * (small on purpose: a range extraction only ever needs to read from its checkpoint up to the end of the range).
+ */
+#define CCRUSH_INDEX_CHUNK_SIZE (1024 * 32)
+
+/*
+ * Length of a serialized index header (magic, span, uncompressed length and point count)
+ * and of a serialized checkpoint (uncompressed offset, compressed offset, bit offset and window).
+ */
+#define CCRUSH_INDEX_HEADER_LENGTH (4 + 8 + 8 + 8)
+#define CCRUSH_INDEX_POINT_LENGTH (8 + 8 + 1 + CCRUSH_WINDOW_SIZE)
+
+/*
+ * One inflate checkpoint (see zlib's examples/zran.c): everything needed to start inflating in the middle of a deflate stream.
+ */
+struct ccrush_index_point
+{
+    uint64_t out;
+    uint64_t in;
+    int bits;
+    uint8_t window[CCRUSH_WINDOW_SIZE];
+};
+
+struct ccrush_index
+{
+    uint64_t span;
+    uint64_t uncompressed_length;
+    size_t count;
+    size_t capacity;
+    struct ccrush_index_point* points;
+};
+
+static int ccrush_index_add_point(ccrush_index* index, const int bits, const uint64_t in, const uint64_t out, const unsigned int left, const uint8_t* window)
+{
+    if (index->count == index->capacity)
+    {
+        const size_t new_capacity = index->capacity ? index->capacity * 2 : 8;
+
+        struct ccrush_index_point* new_points = ccrush_mem_calloc(new_capacity, sizeof(struct ccrush_index_point));
+        if (new_points == NULL)
+        {
+            return CCRUSH_ERROR_OUT_OF_MEMORY;
+        }
+
+        if (index->count != 0)
+        {
+            memcpy(new_points, index->points, index->count * sizeof(struct ccrush_index_point));
+        }
+
+        ccrush_mem_free(index->points);
+
+        index->points = new_points;
+        index->capacity = new_capacity;
+    }
+
+    struct ccrush_index_point* point = &index->points[index->count++];
+
+    point->out = out;
+    point->in = in;
+    point->bits = bits;
+
+    // The window buffer is circular: the last "left" bytes of it are the oldest ones.
+    if (left != 0)
+    {
+        memcpy(point->window, window + CCRUSH_WINDOW_SIZE - left, left);
+    }
+
+    if (left < CCRUSH_WINDOW_SIZE)
+    {
+        memcpy(point->window + left, window, CCRUSH_WINDOW_SIZE - left);
+    }
+
+    return 0;
+}
+
+int ccrush_index_build(FILE* input_file, const uint32_t span_kib, ccrush_index** out_index)
+{
+    if (input_file == NULL || out_index == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
     }
 
     int r;
 
     z_stream stream;
-    memset(&stream, 0x00, sizeof(stream));
-
-    assert(sizeof(uint8_t) == 1);
-    const size_t buffer_size_b = ((size_t)buffer_size_kib) * 1024;
-    const unsigned int buffersize = (unsigned int)(buffer_size_b ? buffer_size_b : CCRUSH_DEFAULT_CHUNKSIZE);
+    ccrush_zstream_setup(&stream, &ccrush_global_allocator);
 
-    uint8_t* zinbuf = malloc(buffersize);
-    uint8_t* zoutbuf = malloc(buffersize);
+    int stream_initialized = 0;
 
-    chillbuff output_buffer;
-    r = chillbuff_init(&output_buffer, ccrush_nextpow2(CCRUSH_MAX(compressBound((unsigned long)data_length), buffersize)), sizeof(uint8_t), CHILLBUFF_GROW_DUPLICATIVE);
+    uint8_t* input = ccrush_mem_alloc(CCRUSH_INDEX_CHUNK_SIZE);
+    uint8_t* window = ccrush_mem_calloc(1, CCRUSH_WINDOW_SIZE);
+    ccrush_index* index = ccrush_mem_calloc(1, sizeof(ccrush_index));
 
-    if (r != 0 || zinbuf == NULL || zoutbuf == NULL)
+    if (input == NULL || window == NULL || index == NULL)
     {
         r = CCRUSH_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
 
-    r = deflateInit(&stream, level < 0 || level > 9 ? 6 : level);
+    index->span = (uint64_t)(span_kib ? span_kib : CCRUSH_DEFAULT_INDEX_SPAN_KiB) * 1024;
+
+    // 47 = 32 (automatic zlib/gzip header detection) + 15 (maximum window size).
+    r = inflateInit2(&stream, 47);
     if (r != Z_OK)
     {
         goto exit;
     }
 
-    stream.next_in = zinbuf;
-    stream.avail_in = 0;
-    stream.next_out = zoutbuf;
-    stream.avail_out = buffersize;
+    stream_initialized = 1;
 
-    size_t remaining = data_length, consumed = 0;
+    uint64_t total_in = 0, total_out = 0, last = 0;
 
-    for (;;)
+    stream.avail_out = 0;
+
+    do
     {
+        stream.avail_in = (uInt)fread(input, sizeof(uint8_t), CCRUSH_INDEX_CHUNK_SIZE, input_file);
+        if (ferror(input_file))
+        {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+
         if (stream.avail_in == 0)
         {
-            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)buffersize, remaining));
+            r = Z_DATA_ERROR;
+            goto exit;
+        }
 
-            memcpy(zinbuf, data + consumed, n);
+        stream.next_in = input;
 
-            stream.next_in = zinbuf;
-            stream.avail_in = n;
+        do
+        {
+            if (stream.avail_out == 0)
+            {
+                stream.avail_out = CCRUSH_WINDOW_SIZE;
+                stream.next_out = window;
+            }
 
-            consumed += n;
-            remaining -= n;
-        }
+            total_in += stream.avail_in;
+            total_out += stream.avail_out;
 
-        r = deflate(&stream, remaining ? Z_NO_FLUSH : Z_FINISH);
+            // Z_BLOCK makes inflate() stop at every deflate block boundary: those are the only places where a checkpoint can be set.
+            r = inflate(&stream, Z_BLOCK);
 
-        if (r == Z_STREAM_END || stream.avail_out == 0)
-        {
-            const unsigned int n = buffersize - stream.avail_out;
+            total_in -= stream.avail_in;
+            total_out -= stream.avail_out;
 
-            chillbuff_push_back(&output_buffer, zoutbuf, n);
+            if (r == Z_NEED_DICT)
+            {
+                r = Z_DATA_ERROR;
+            }
 
-            stream.next_out = zoutbuf;
-            stream.avail_out = buffersize;
-        }
+            if (r == Z_MEM_ERROR || r == Z_DATA_ERROR)
+            {
+                goto exit;
+            }
 
-        if (r == Z_STREAM_END)
-        {
-            break;
-        }
-        else if (r != 0)
+            if (r == Z_STREAM_END)
+            {
+                break;
+            }
+
+            const int at_block_boundary = (stream.data_type & 128) && !(stream.data_type & 64);
+
+            if (at_block_boundary && (total_out == 0 || total_out - last > index->span))
+            {
+                r = ccrush_index_add_point(index, stream.data_type & 7, total_in, total_out, stream.avail_out, window);
+                if (r != 0)
+                {
+                    goto exit;
+                }
+
+                last = total_out;
+            }
+
+        } while (stream.avail_in != 0);
+
+    } while (r != Z_STREAM_END);
+
+    if (index->count == 0)
+    {
+        r = Z_DATA_ERROR;
+        goto exit;
+    }
+
+    index->uncompressed_length = total_out;
+
+    *out_index = index;
+    index = NULL;
+    r = 0;
+
+exit:
+
+    if (stream_initialized)
+    {
+        inflateEnd(&stream);
+    }
+
+    ccrush_index_free(index);
+    ccrush_mem_free(input);
+
+    if (window != NULL)
+    {
+        ccrush_scrub(window, CCRUSH_WINDOW_SIZE, ccrush_scrub_buffers);
+        ccrush_mem_free(window);
+    }
+
+    return (r);
+}
+
+int ccrush_index_save(const ccrush_index* index, const char* output_file_path)
+{
+    if (index == NULL || output_file_path == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    FILE* output_file = ccrush_fopen(output_file_path, "wb");
+    if (output_file == NULL)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    int r = 0;
+
+    uint8_t header[CCRUSH_INDEX_HEADER_LENGTH];
+    memcpy(header, CCRUSH_INDEX_MAGIC, 4);
+    ccrush_store_u64le(header + 4, index->span);
+    ccrush_store_u64le(header + 12, index->uncompressed_length);
+    ccrush_store_u64le(header + 20, (uint64_t)index->count);
+
+    if (fwrite(header, sizeof(uint8_t), sizeof(header), output_file) != sizeof(header))
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    for (size_t i = 0; i < index->count; ++i)
+    {
+        const struct ccrush_index_point* point = &index->points[i];
+
+        uint8_t point_header[8 + 8 + 1];
+        ccrush_store_u64le(point_header, point->out);
+        ccrush_store_u64le(point_header + 8, point->in);
+        point_header[16] = (uint8_t)point->bits;
+
+        if (fwrite(point_header, sizeof(uint8_t), sizeof(point_header), output_file) != sizeof(point_header) || fwrite(point->window, sizeof(uint8_t), CCRUSH_WINDOW_SIZE, output_file) != CCRUSH_WINDOW_SIZE)
         {
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
             goto exit;
         }
     }
 
-    *out = malloc(output_buffer.length + 1);
-    if (*out == NULL)
+exit:
+
+    if (fclose(output_file) != 0 && r == 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    return (r);
+}
+
+int ccrush_index_load(const char* input_file_path, ccrush_index** out_index)
+{
+    if (input_file_path == NULL || out_index == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    FILE* input_file = ccrush_fopen(input_file_path, "rb");
+    if (input_file == NULL)
+    {
+        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    int r;
+
+    ccrush_index* index = ccrush_mem_calloc(1, sizeof(ccrush_index));
+    if (index == NULL)
     {
         r = CCRUSH_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
 
-    r = 0;
-    *out_length = output_buffer.length;
-    memcpy(*out, output_buffer.array, output_buffer.length);
-    (*out)[output_buffer.length] = 0x00;
+    uint8_t header[CCRUSH_INDEX_HEADER_LENGTH];
 
-exit:
+    if (fread(header, sizeof(uint8_t), sizeof(header), input_file) != sizeof(header) || memcmp(header, CCRUSH_INDEX_MAGIC, 4) != 0)
+    {
+        r = CCRUSH_ERROR_INVALID_INDEX;
+        goto exit;
+    }
 
-    deflateEnd(&stream);
-    memset(&stream, 0x00, sizeof(stream));
+    index->span = ccrush_load_u64le(header + 4);
+    index->uncompressed_length = ccrush_load_u64le(header + 12);
 
-    if (zinbuf != NULL)
+    const uint64_t count = ccrush_load_u64le(header + 20);
+
+    if (count == 0 || count > SIZE_MAX / sizeof(struct ccrush_index_point))
     {
-        memset(zinbuf, 0x00, buffersize);
-        free(zinbuf);
+        r = CCRUSH_ERROR_INVALID_INDEX;
+        goto exit;
     }
 
-    if (zoutbuf != NULL)
+    for (uint64_t i = 0; i < count; ++i)
     {
-        memset(zoutbuf, 0x00, buffersize);
-        free(zoutbuf);
+        uint8_t point_header[8 + 8 + 1];
+        uint8_t window[CCRUSH_WINDOW_SIZE];
+
+        // Points are read one by one (rather than trusting the count for one big allocation) so that a corrupt count fails on EOF instead of on a huge malloc.
+        if (fread(point_header, sizeof(uint8_t), sizeof(point_header), input_file) != sizeof(point_header) || fread(window, sizeof(uint8_t), CCRUSH_WINDOW_SIZE, input_file) != CCRUSH_WINDOW_SIZE)
+        {
+            r = CCRUSH_ERROR_INVALID_INDEX;
+            goto exit;
+        }
+
+        const uint64_t out = ccrush_load_u64le(point_header);
+        const uint64_t in = ccrush_load_u64le(point_header + 8);
+        const int bits = point_header[16];
+
+        const int out_of_order = i == 0 ? out != 0 : out <= index->points[index->count - 1].out;
+
+        if (bits > 7 || out_of_order || out > index->uncompressed_length)
+        {
+            r = CCRUSH_ERROR_INVALID_INDEX;
+            goto exit;
+        }
+
+        r = ccrush_index_add_point(index, bits, in, out, CCRUSH_WINDOW_SIZE, window);
+        if (r != 0)
+        {
+            goto exit;
+        }
     }
 
-    chillbuff_free(&output_buffer);
+    *out_index = index;
+    index = NULL;
+    r = 0;
 
+exit:
+    ccrush_index_free(index);
+    fclose(input_file);
     return (r);
 }
 
-int ccrush_compress_file_raw(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int level, int close_input_file, int close_output_file)
+int ccrush_index_get_uncompressed_size(const ccrush_index* index, uint64_t* out_uncompressed_size)
 {
-    if (!input_file || !output_file || input_file == output_file)
+    if (index == NULL || out_uncompressed_size == NULL)
     {
         return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    *out_uncompressed_size = index->uncompressed_length;
+    return 0;
+}
+
+void ccrush_index_free(ccrush_index* index)
+{
+    if (index == NULL)
     {
-        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+        return;
+    }
+
+    if (index->points != NULL)
+    {
+        ccrush_scrub(index->points, index->capacity * sizeof(struct ccrush_index_point), ccrush_scrub_buffers);
+        ccrush_mem_free(index->points);
+    }
+
+    ccrush_mem_free(index);
+}
+
+int ccrush_decompress_range(FILE* input_file, const ccrush_index* index, const uint64_t offset, uint8_t* out, const size_t length, size_t* out_written)
+{
+    if (input_file == NULL || index == NULL || out == NULL || out_written == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    if (offset >= index->uncompressed_length || length == 0)
+    {
+        *out_written = 0;
+        return 0;
+    }
+
+    const size_t wanted = (size_t)CCRUSH_MIN((uint64_t)length, index->uncompressed_length - offset);
+
+    // Binary search for the last checkpoint at or before the requested offset.
+    size_t lo = 0, hi = index->count - 1;
+
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo + 1) / 2;
+
+        if (index->points[mid].out <= offset)
+        {
+            lo = mid;
+        }
+        else
+        {
+            hi = mid - 1;
+        }
     }
 
+    const struct ccrush_index_point* point = &index->points[lo];
+
     int r;
 
     z_stream stream;
-    memset(&stream, 0x00, sizeof(stream));
-
-    assert(sizeof(uint8_t) == 1);
-    const size_t buffer_size_b = ((size_t)buffer_size_kib) * 1024;
-    const unsigned int buffersize = (unsigned int)(buffer_size_b ? buffer_size_b : CCRUSH_DEFAULT_CHUNKSIZE);
+    ccrush_zstream_setup(&stream, &ccrush_global_allocator);
 
-    uint8_t* input_buffer = malloc(buffersize);
-    uint8_t* output_buffer = malloc(buffersize);
+    int stream_initialized = 0;
 
-    if (input_buffer == NULL || output_buffer == NULL)
+    uint8_t* input = ccrush_mem_alloc(CCRUSH_INDEX_CHUNK_SIZE);
+    uint8_t* discard = ccrush_mem_alloc(CCRUSH_WINDOW_SIZE);
+
+    if (input == NULL || discard == NULL)
     {
         r = CCRUSH_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
 
-    r = deflateInit(&stream, level);
+    r = inflateInit2(&stream, -MAX_WBITS);
     if (r != Z_OK)
     {
         goto exit;
     }
 
-    int flush;
+    stream_initialized = 1;
 
-    do
+    // A checkpoint in the middle of a byte needs the remaining bits of the previous byte to be primed first.
+    if (ccrush_fseek64(input_file, point->in - (point->bits ? 1 : 0)) != 0)
     {
-        stream.avail_in = fread(input_buffer, sizeof(uint8_t), buffersize, input_file);
-        if (ferror(input_file))
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    if (point->bits)
+    {
+        const int byte = fgetc(input_file);
+        if (byte == EOF)
         {
-            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            r = ferror(input_file) ? CCRUSH_ERROR_FILE_ACCESS_FAILED : Z_DATA_ERROR;
             goto exit;
         }
 
-        flush = feof(input_file) ? Z_FINISH : Z_NO_FLUSH;
-        stream.next_in = input_buffer;
-
-        do
+        r = inflatePrime(&stream, point->bits, byte >> (8 - point->bits));
+        if (r != Z_OK)
         {
-            stream.avail_out = buffersize;
-            stream.next_out = output_buffer;
+            goto exit;
+        }
+    }
 
-            r = deflate(&stream, flush);
-            if (r == Z_STREAM_ERROR)
+    r = inflateSetDictionary(&stream, point->window, CCRUSH_WINDOW_SIZE);
+    if (r != Z_OK)
+    {
+        goto exit;
+    }
+
+    uint64_t skip = offset - point->out;
+    size_t remaining_out = wanted;
+
+    stream.avail_in = 0;
+    stream.avail_out = 0;
+
+    int skipping = 1;
+
+    for (;;)
+    {
+        if (stream.avail_out == 0)
+        {
+            if (skip != 0)
             {
-                goto exit;
+                const unsigned int n = (unsigned int)CCRUSH_MIN(skip, (uint64_t)CCRUSH_WINDOW_SIZE);
+
+                stream.next_out = discard;
+                stream.avail_out = n;
+                skip -= n;
             }
+            else if (remaining_out != 0)
+            {
+                if (skipping)
+                {
+                    stream.next_out = out;
+                    skipping = 0;
+                }
 
-            const unsigned int processed = buffersize - stream.avail_out;
+                const unsigned int n = (unsigned int)CCRUSH_MIN((size_t)UINT_MAX, remaining_out);
 
-            if (fwrite(output_buffer, sizeof(uint8_t), processed, output_file) != processed || ferror(output_file))
+                stream.avail_out = n;
+                remaining_out -= n;
+            }
+            else
+            {
+                break;
+            }
+        }
+
+        if (stream.avail_in == 0)
+        {
+            stream.avail_in = (uInt)fread(input, sizeof(uint8_t), CCRUSH_INDEX_CHUNK_SIZE, input_file);
+            if (ferror(input_file))
             {
                 r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
                 goto exit;
             }
 
-        } while (stream.avail_out == 0);
+            if (stream.avail_in == 0)
+            {
+                r = Z_DATA_ERROR;
+                goto exit;
+            }
+
+            stream.next_in = input;
+        }
+
+        r = inflate(&stream, Z_NO_FLUSH);
+
+        if (r == Z_NEED_DICT)
+        {
+            r = Z_DATA_ERROR;
+        }
 
-        if (stream.avail_in != 0)
+        if (r == Z_MEM_ERROR || r == Z_DATA_ERROR || r == Z_STREAM_ERROR)
         {
-            r = Z_STREAM_ERROR;
             goto exit;
         }
 
-    } while (flush != Z_FINISH);
+        if (r == Z_STREAM_END)
+        {
+            break;
+        }
+    }
 
-    if (r != Z_STREAM_END)
+    const size_t written = skipping ? 0 : (size_t)(stream.next_out - out);
+
+    // The index promised more data than the stream actually holds: index and file don't belong together.
+    if (written != wanted)
     {
-        r = Z_STREAM_ERROR;
+        r = CCRUSH_ERROR_INVALID_INDEX;
         goto exit;
     }
 
+    *out_written = written;
     r = 0;
 
 exit:
 
-    deflateEnd(&stream);
-    memset(&stream, 0x00, sizeof(stream));
-
-    if (input_buffer != NULL)
+    if (stream_initialized)
     {
-        memset(input_buffer, 0x00, buffersize);
-        free(input_buffer);
+        inflateEnd(&stream);
     }
 
-    if (output_buffer != NULL)
-    {
-        memset(output_buffer, 0x00, buffersize);
-        free(output_buffer);
-    }
-
-    if (close_input_file)
-    {
-        fclose(input_file);
-    }
+    ccrush_mem_free(input);
 
-    if (close_output_file)
+    if (discard != NULL)
     {
-        fclose(output_file);
+        ccrush_scrub(discard, CCRUSH_WINDOW_SIZE, ccrush_scrub_buffers);
+        ccrush_mem_free(discard);
     }
 
     return (r);
 }
 
-int ccrush_compress_file(const char* input_file_path, const char* output_file_path, uint32_t buffer_size_kib, int level)
+int ccrush_ctx_set_dictionary(ccrush_ctx* ctx, const uint8_t* dictionary, const size_t dictionary_length)
 {
-    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    if (ctx == NULL || ccrush_dictionary_args_invalid(dictionary, dictionary_length))
     {
         return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
-    {
-        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
-    }
-
-    FILE* input_file = ccrush_fopen(input_file_path, "rb");
-    FILE* output_file = ccrush_fopen(output_file_path, "wb");
+    uint8_t* copy = NULL;
 
-    if (input_file == NULL || output_file == NULL)
+    if (dictionary != NULL)
     {
-        if (input_file != NULL)
+        copy = ccrush_allocator_alloc(&ctx->allocator, dictionary_length);
+        if (copy == NULL)
         {
-            fclose(input_file);
+            return CCRUSH_ERROR_OUT_OF_MEMORY;
         }
 
-        if (output_file != NULL)
-        {
-            fclose(output_file);
-        }
+        memcpy(copy, dictionary, dictionary_length);
+    }
 
-        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    if (ctx->owned_dictionary != NULL)
+    {
+        ccrush_scrub(ctx->owned_dictionary, ctx->dictionary_length, ctx->scrub);
+        ccrush_allocator_free(&ctx->allocator, ctx->owned_dictionary);
     }
 
-    return ccrush_compress_file_raw(input_file, output_file, buffer_size_kib, level, 1, 1);
+    ctx->owned_dictionary = copy;
+    ccrush_ctx_use_dictionary(ctx, copy, dictionary_length);
+
+    return 0;
 }
 
-int ccrush_decompress(const uint8_t* data, const size_t data_length, const uint32_t buffer_size_kib, uint8_t** out, size_t* out_length)
+int ccrush_ctx_set_params(ccrush_ctx* ctx, const ccrush_params* params)
 {
-    if (data == NULL || data_length == 0 || out == NULL || out_length == NULL)
+    if (ctx == NULL || (params != NULL && ccrush_params_invalid(params)))
     {
         return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
-    {
-        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
-    }
-
-    int r;
-
-    z_stream stream;
-    memset(&stream, 0x00, sizeof(stream));
+    ccrush_ctx_use_params(ctx, params);
+    return 0;
+}
 
-    assert(sizeof(uint8_t) == 1);
-    const size_t buffer_size_b = ((size_t)buffer_size_kib) * 1024;
-    const unsigned int buffersize = (unsigned int)(buffer_size_b ? buffer_size_b : CCRUSH_DEFAULT_CHUNKSIZE);
+/*
+ * Dictionary training is a simplified take on the "fast cover" algorithm: every 6-byte substring (d-mer) of the corpus
+ * is counted in a hashed frequency table, then the corpus is split into epochs and each epoch gets to contribute the segment
+ * whose distinct d-mers are the most frequent ones. The chosen d-mers' frequencies are zeroed, so that later picks favour
+ * content that the dictionary doesn't cover yet, and the picks are packed from the end backwards: deflate reaches the end
+ * of a preset dictionary with the shortest (cheapest) distances, so that's where the most valuable bytes belong.
+ */
+#define CCRUSH_TRAIN_DMER_LENGTH 6
+#define CCRUSH_TRAIN_SEGMENT_LENGTH 64
+#define CCRUSH_TRAIN_HASH_BITS 20
+#define CCRUSH_TRAIN_EPOCH_PASSES 4
 
-    uint8_t* zinbuf = malloc(buffersize);
-    uint8_t* zoutbuf = malloc(buffersize);
+/*
+ * Big corpora only get scanned this much per epoch visit (moving on to the next stretch of the epoch with every pass),
+ * so that the segment selection costs the same for 10 MB as for 1 GB. The frequencies are still counted over everything.
+ */
+#define CCRUSH_TRAIN_MAX_EPOCH_SCAN_LENGTH (1024 * 128)
 
-    stream.next_in = zinbuf;
-    stream.avail_in = 0;
-    stream.next_out = zoutbuf;
-    stream.avail_out = buffersize;
+static inline uint32_t ccrush_train_hash(const uint8_t* dmer)
+{
+    const uint64_t value = (uint64_t)ccrush_load_u32le(dmer) | ((uint64_t)dmer[4] << 32) | ((uint64_t)dmer[5] << 40);
+    return (uint32_t)((value * 0xCF1BBCDCB7A56463ULL) >> (64 - CCRUSH_TRAIN_HASH_BITS));
+}
 
-    chillbuff output_buffer;
-    r = chillbuff_init(&output_buffer, ccrush_nextpow2((uint64_t)data_length * 2), sizeof(uint8_t), CHILLBUFF_GROW_DUPLICATIVE);
+/* Finds the segment of [begin; end) (in d-mers) that scores highest and takes its d-mers out of the frequency table. Returns its score. */
+static uint64_t ccrush_train_select_segment(const uint8_t* corpus, uint32_t* frequencies, uint16_t* active, const size_t begin, const size_t end, size_t* out_begin, size_t* out_end)
+{
+    const size_t segment_dmers = CCRUSH_TRAIN_SEGMENT_LENGTH - CCRUSH_TRAIN_DMER_LENGTH + 1;
 
-    if (zinbuf == NULL || zoutbuf == NULL || r == CHILLBUFF_OUT_OF_MEM)
-    {
-        r = CCRUSH_ERROR_OUT_OF_MEMORY;
-        goto exit;
-    }
+    uint64_t score = 0;
+    uint64_t best_score = 0;
+    size_t best_begin = begin;
+    size_t best_end = begin;
+    size_t window_begin = begin;
 
-    r = inflateInit(&stream);
-    if (r != 0)
+    for (size_t window_end = begin; window_end < end; ++window_end)
     {
-        goto exit;
-    }
+        const uint32_t added = ccrush_train_hash(corpus + window_end);
 
-    size_t remaining = data_length, consumed = 0;
-
-    for (;;)
-    {
-        if (stream.avail_in == 0)
+        // Repetitions within a segment don't count: the dictionary only needs to hold a string once.
+        if (active[added]++ == 0)
         {
-            const unsigned int n = (unsigned int)(CCRUSH_MIN((size_t)buffersize, remaining));
-
-            memcpy(zinbuf, data + consumed, n);
-
-            stream.next_in = zinbuf;
-            stream.avail_in = n;
-
-            consumed += n;
-            remaining -= n;
+            score += frequencies[added];
         }
 
-        r = inflate(&stream, Z_SYNC_FLUSH);
-
-        if (r == Z_STREAM_END || stream.avail_out == 0)
+        if (window_end - window_begin + 1 > segment_dmers)
         {
-            const unsigned int n = buffersize - stream.avail_out;
+            const uint32_t removed = ccrush_train_hash(corpus + window_begin);
 
-            chillbuff_push_back(&output_buffer, zoutbuf, n);
+            if (--active[removed] == 0)
+            {
+                score -= frequencies[removed];
+            }
 
-            stream.next_out = zoutbuf;
-            stream.avail_out = buffersize;
+            ++window_begin;
         }
 
-        if (r == Z_STREAM_END)
-        {
-            break;
-        }
-        else if (r != 0)
+        if (score > best_score)
         {
-            goto exit;
+            best_score = score;
+            best_begin = window_begin;
+            best_end = window_end + 1;
         }
     }
 
-    *out = malloc(output_buffer.length + 1);
-    if (*out == NULL)
+    for (; window_begin < end; ++window_begin)
     {
-        r = CCRUSH_ERROR_OUT_OF_MEMORY;
-        goto exit;
+        --active[ccrush_train_hash(corpus + window_begin)];
     }
 
-    r = 0;
-    *out_length = output_buffer.length;
-    (*out)[output_buffer.length] = '\0';
-    memcpy(*out, output_buffer.array, output_buffer.length);
-
-exit:
+    if (best_score == 0)
+    {
+        return 0;
+    }
 
-    inflateEnd(&stream);
+    // Trim the edges that don't earn anything anymore.
+    while (best_begin < best_end && frequencies[ccrush_train_hash(corpus + best_begin)] == 0)
+    {
+        ++best_begin;
+    }
 
-    if (zinbuf != NULL)
+    while (best_end > best_begin && frequencies[ccrush_train_hash(corpus + best_end - 1)] == 0)
     {
-        memset(zinbuf, 0x00, buffersize);
-        free(zinbuf);
+        --best_end;
     }
 
-    if (zoutbuf != NULL)
+    for (size_t i = best_begin; i < best_end; ++i)
     {
-        memset(zoutbuf, 0x00, buffersize);
-        free(zoutbuf);
+        frequencies[ccrush_train_hash(corpus + i)] = 0;
     }
 
-    chillbuff_free(&output_buffer);
+    *out_begin = best_begin;
+    *out_end = best_end;
 
-    return (r);
+    return best_score;
 }
 
-int ccrush_decompress_file_raw(FILE* input_file, FILE* output_file, uint32_t buffer_size_kib, int close_input_file, int close_output_file)
+int ccrush_train_dictionary(const uint8_t* const* samples, const size_t* sample_lengths, const size_t sample_count, uint8_t* out, const size_t out_capacity, size_t* out_written)
 {
-    if (!input_file || !output_file || input_file == output_file)
+    if (samples == NULL || sample_lengths == NULL || sample_count == 0 || out == NULL || out_capacity == 0 || out_written == NULL)
     {
         return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    size_t corpus_length = 0;
+
+    for (size_t i = 0; i < sample_count; ++i)
     {
-        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
-    }
+        if ((samples[i] == NULL && sample_lengths[i] != 0) || sample_lengths[i] > SIZE_MAX - corpus_length)
+        {
+            return CCRUSH_ERROR_INVALID_ARGS;
+        }
 
-    int r;
+        corpus_length += sample_lengths[i];
+    }
 
-    z_stream stream;
-    memset(&stream, 0x00, sizeof(stream));
+    if (corpus_length < CCRUSH_TRAIN_DMER_LENGTH)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
 
-    assert(sizeof(uint8_t) == 1);
-    const size_t buffer_size_b = ((size_t)buffer_size_kib) * 1024;
-    const unsigned int buffersize = (unsigned int)(buffer_size_b ? buffer_size_b : CCRUSH_DEFAULT_CHUNKSIZE);
+    int r = -1;
 
-    uint8_t* input_buffer = malloc(buffersize);
-    uint8_t* output_buffer = malloc(buffersize);
+    uint8_t* corpus = ccrush_mem_alloc(corpus_length);
+    uint32_t* frequencies = ccrush_mem_calloc((size_t)1 << CCRUSH_TRAIN_HASH_BITS, sizeof(uint32_t));
+    uint16_t* active = ccrush_mem_calloc((size_t)1 << CCRUSH_TRAIN_HASH_BITS, sizeof(uint16_t));
 
-    if (input_buffer == NULL || output_buffer == NULL)
+    if (corpus == NULL || frequencies == NULL || active == NULL)
     {
         r = CCRUSH_ERROR_OUT_OF_MEMORY;
         goto exit;
     }
 
-    r = inflateInit(&stream);
-    if (r != Z_OK)
-    {
-        goto exit;
-    }
+    size_t offset = 0;
 
-    do
+    for (size_t i = 0; i < sample_count; ++i)
     {
-        stream.avail_in = fread(input_buffer, sizeof(uint8_t), buffersize, input_file);
-        if (ferror(input_file))
+        if (sample_lengths[i] != 0)
         {
-            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
-            goto exit;
+            memcpy(corpus + offset, samples[i], sample_lengths[i]);
+            offset += sample_lengths[i];
         }
+    }
 
-        if (stream.avail_in == 0)
+    const size_t dmer_count = corpus_length - CCRUSH_TRAIN_DMER_LENGTH + 1;
+
+    for (size_t i = 0; i < dmer_count; ++i)
+    {
+        uint32_t* frequency = frequencies + ccrush_train_hash(corpus + i);
+
+        if (*frequency != UINT32_MAX)
         {
-            break;
+            ++*frequency;
         }
+    }
 
-        stream.next_in = input_buffer;
+    const size_t dictionary_capacity = CCRUSH_MIN(out_capacity, CCRUSH_MAX_DICTIONARY_SIZE);
+    const size_t min_epoch_length = CCRUSH_TRAIN_SEGMENT_LENGTH * 10;
 
-        do
-        {
-            stream.avail_out = buffersize;
-            stream.next_out = output_buffer;
+    // Every epoch is visited about CCRUSH_TRAIN_EPOCH_PASSES times until the dictionary is full.
+    size_t epoch_count = CCRUSH_MAX(1, dictionary_capacity / CCRUSH_TRAIN_SEGMENT_LENGTH / CCRUSH_TRAIN_EPOCH_PASSES);
 
-            r = inflate(&stream, Z_NO_FLUSH);
+    if (dmer_count / epoch_count < min_epoch_length)
+    {
+        epoch_count = CCRUSH_MAX(1, dmer_count / min_epoch_length);
+    }
 
-            switch (r)
-            {
-                case Z_NEED_DICT:
-                    r = Z_DATA_ERROR; /* Intentional fall-through. */
-                case Z_DATA_ERROR:
-                case Z_MEM_ERROR:
-                case Z_STREAM_ERROR:
-                    goto exit;
-            }
+    const size_t epoch_length = dmer_count / epoch_count;
+    const size_t max_zero_score_run = CCRUSH_MIN(CCRUSH_MAX(epoch_count, 10), 100);
+
+    size_t tail = dictionary_capacity;
+    size_t zero_score_run = 0;
+
+    for (size_t epoch = 0, pass = 0; tail > 0; pass += (epoch + 1) / epoch_count, epoch = (epoch + 1) % epoch_count)
+    {
+        size_t epoch_begin = epoch * epoch_length;
+        size_t epoch_end = epoch == epoch_count - 1 ? dmer_count : epoch_begin + epoch_length;
 
-            const unsigned int processed = buffersize - stream.avail_out;
+        if (epoch_end - epoch_begin > CCRUSH_TRAIN_MAX_EPOCH_SCAN_LENGTH)
+        {
+            epoch_begin += (pass * CCRUSH_TRAIN_MAX_EPOCH_SCAN_LENGTH) % (epoch_end - epoch_begin - CCRUSH_TRAIN_MAX_EPOCH_SCAN_LENGTH + 1);
+            epoch_end = epoch_begin + CCRUSH_TRAIN_MAX_EPOCH_SCAN_LENGTH;
+        }
 
-            if (fwrite(output_buffer, sizeof(uint8_t), processed, output_file) != processed || ferror(output_file))
+        size_t segment_begin = 0;
+        size_t segment_end = 0;
+
+        if (ccrush_train_select_segment(corpus, frequencies, active, epoch_begin, epoch_end, &segment_begin, &segment_end) == 0)
+        {
+            if (++zero_score_run >= max_zero_score_run)
             {
-                r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
-                goto exit;
+                break;
             }
 
-        } while (stream.avail_out == 0);
+            continue;
+        }
 
-    } while (r != Z_STREAM_END);
+        zero_score_run = 0;
 
-    r = r == Z_STREAM_END ? 0 : Z_DATA_ERROR;
+        const size_t segment_length = CCRUSH_MIN(segment_end - segment_begin + CCRUSH_TRAIN_DMER_LENGTH - 1, tail);
 
-exit:
+        tail -= segment_length;
+        memcpy(out + tail, corpus + segment_begin, segment_length);
+    }
 
-    inflateEnd(&stream);
-    memset(&stream, 0x00, sizeof(stream));
+    const size_t written = dictionary_capacity - tail;
 
-    if (input_buffer != NULL)
+    if (tail != 0)
     {
-        memset(input_buffer, 0x00, buffersize);
-        free(input_buffer);
+        memmove(out, out + tail, written);
     }
 
-    if (output_buffer != NULL)
-    {
-        memset(output_buffer, 0x00, buffersize);
-        free(output_buffer);
-    }
+    *out_written = written;
+    r = 0;
 
-    if (close_input_file)
-    {
-        fclose(input_file);
-    }
+exit:
 
-    if (close_output_file)
+    if (corpus != NULL)
     {
-        fclose(output_file);
+        ccrush_scrub(corpus, corpus_length, ccrush_scrub_buffers);
+        ccrush_mem_free(corpus);
     }
 
+    ccrush_mem_free(frequencies);
+    ccrush_mem_free(active);
+
     return (r);
 }
 
-int ccrush_decompress_file(const char* input_file_path, const char* output_file_path, const uint32_t buffer_size_kib)
+void ccrush_set_scrub_buffers(const int scrub)
 {
-    if (!input_file_path || !output_file_path || input_file_path == output_file_path || strcmp(input_file_path, output_file_path) == 0)
+    ccrush_scrub_buffers = scrub != 0;
+}
+
+int ccrush_get_scrub_buffers()
+{
+    return ccrush_scrub_buffers;
+}
+
+int ccrush_ctx_set_scrub_buffers(ccrush_ctx* ctx, const int scrub)
+{
+    if (ctx == NULL)
     {
         return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    if (buffer_size_kib > CCRUSH_MAX_BUFFER_SIZE_KiB)
+    ctx->scrub = scrub != 0;
+    return 0;
+}
+
+void ccrush_set_pipelined_io(const int enabled)
+{
+    ccrush_pipelined_io = enabled != 0;
+}
+
+int ccrush_get_pipelined_io()
+{
+    return ccrush_pipelined_io;
+}
+
+void ccrush_set_adaptive_compression(const int enabled)
+{
+    ccrush_adaptive_compression = enabled != 0;
+}
+
+int ccrush_get_adaptive_compression()
+{
+    return ccrush_adaptive_compression;
+}
+
+int ccrush_ctx_set_adaptive_compression(ccrush_ctx* ctx, const int enabled)
+{
+    if (ctx == NULL)
     {
-        return CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE;
+        return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    FILE* input_file = ccrush_fopen(input_file_path, "rb");
-    FILE* output_file = ccrush_fopen(output_file_path, "wb");
+    ctx->adaptive = enabled != 0;
+    return 0;
+}
 
-    if (input_file == NULL || output_file == NULL)
+int ccrush_set_allocator(ccrush_alloc_function alloc_function, ccrush_free_function free_function, void* user)
+{
+    if ((alloc_function == NULL) != (free_function == NULL))
     {
-        if (input_file != NULL)
-        {
-            fclose(input_file);
-        }
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
 
-        if (output_file != NULL)
-        {
-            fclose(output_file);
-        }
+    ccrush_global_allocator.alloc = alloc_function != NULL ? alloc_function : &ccrush_default_alloc;
+    ccrush_global_allocator.free = free_function != NULL ? free_function : &ccrush_default_free;
+    ccrush_global_allocator.user = alloc_function != NULL ? user : NULL;
 
-        return CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    return 0;
+}
+
+void ccrush_thread_cache_enable(const int enabled)
+{
+    ccrush_thread_cache_enabled = enabled != 0;
+}
+
+int ccrush_thread_cache_is_enabled()
+{
+    return ccrush_thread_cache_enabled;
+}
+
+void ccrush_thread_cache_release()
+{
+    ccrush_ctx_teardown(&ccrush_thread_cache);
+}
+
+int ccrush_ctx_set_stats(ccrush_ctx* ctx, ccrush_stats* stats)
+{
+    if (ctx == NULL)
+    {
+        return CCRUSH_ERROR_INVALID_ARGS;
     }
 
-    return ccrush_decompress_file_raw(input_file, output_file, buffer_size_kib, 1, 1);
+    ctx->stats = stats;
+    return 0;
+}
+
+void ccrush_set_thread_stats(ccrush_stats* stats)
+{
+    ccrush_thread_stats = stats;
 }
 
 void ccrush_free(void* mem)
 {
-    free(mem);
+    ccrush_mem_free(mem);
 }
 
 uint32_t ccrush_get_version_nr()
@@ -52,15 +52,27 @@ static const char HELP_TEXT[] = "\n"
                                 "Compress and decompress data easily using zlib v%s.\n\n"
                                 "Usage:\n\n"
                                 "Pass the data to compress or decompress into the CLI's stdin (for example with a pipe).\n\n"
-                                "When decompressing, pass the \"-d\" argument to put ccrush into decompression mode.\n\n"
+                                "When decompressing, pass the \"-d\" argument to put ccrush into decompression mode.\n"
+                                "Block containers (see \"-p\") are detected automatically and decompressed using the threads set with \"-t\".\n\n"
                                 "Optional parameters are:\n\n"
                                 "  -c\n  Sets the compression level to use when deflating the input data.\n  Must be a number between 0 and 9, where 0 means no compression at all and 9 is maximum compression (slowest).\n  Default value: 6\n\n"
                                 "  -b\n  Sets the buffer size (in KiB) to use for compressing/decompressing.\n  Must be less than 262144.\n  Default value: 256\n\n"
+                                "  -t\n  Sets the amount of threads to use when compressing. Pass 0 to use one thread per available CPU core.\n  The output is still one single, standard zlib stream that can be decompressed by any inflater.\n  Default value: 1\n\n"
+                                "  -p\n  Compresses into a block container instead of a zlib stream: independently deflated blocks (of the size set with \"-b\", default 1024 KiB) plus a block table.\n  Slightly bigger output, but unlike a zlib stream it can also be decompressed in parallel (using \"ccrush -d -t 0\").\n  The output can ONLY be decompressed by ccrush.\n\n"
+                                "  -D\n  Compresses/decompresses using the preset dictionary stored in the file whose path is passed after the argument (see \"--train\").\n  Data compressed with a dictionary can only be decompressed with that exact same dictionary.\n  Can't be combined with \"-p\" or \"-t\".\n\n"
+                                "  -a\n  Enables adaptive compression: blocks of input that look incompressible (already compressed media, archives, encrypted data, ...) are stored as they are instead of being deflated.\n  Saves lots of CPU on mixed inputs; the output is still a standard zlib stream. Has no effect with \"-p\" or \"-t\".\n\n"
+                                "  --train\n  Trains a preset dictionary (of up to 32 KiB) from a set of sample files instead of compressing anything.\n  The first path after the argument is the dictionary output file, all the following ones are the samples.\n\n"
                                 "Compression examples:\n\n"
                                 "  cat file-to-compress.txt | ccrush > my-compressed-file.txt.zlib\n\n  ---\n  OR\n  ---\n\n"
                                 "  echo -n \"Why do we all have to wear these ridiculous ties?!\" | ccrush > my-compressed-file.txt.zlib\n\nn  ---\n  OR\n  ---\n\n"
                                 "  ccrush < cat file-to-compress.txt > my-compressed-file.txt.zlib\n\n  ---\n  OR\n  ---\n\n"
-                                "  ccrush -c 8 -b 1024 < cat file-to-compress.txt > my-compressed-file.txt.zlib\n\n"
+                                "  ccrush -c 8 -b 1024 < cat file-to-compress.txt > my-compressed-file.txt.zlib\n\n  ---\n  OR\n  ---\n\n"
+                                "  ccrush -c 6 -t 0 < cat big-file-to-compress.tar > my-compressed-file.tar.zlib\n\n  ---\n  OR\n  ---\n\n"
+                                "  ccrush -p -t 0 < cat big-file-to-compress.tar > my-compressed-file.tar.ccrb\n\n"
+                                "Dictionary examples:\n\n"
+                                "  ccrush --train my-dictionary.bin samples/*.json\n\n"
+                                "  ccrush -c 9 -D my-dictionary.bin < cat small-message.json > small-message.json.zlib\n\n"
+                                "  ccrush -d -D my-dictionary.bin < cat small-message.json.zlib > small-message.json\n\n"
                                 "Decompression examples:\n\n"
                                 "  cat my-compressed-file.txt.zlib | ccrush -d > decompressed-file.txt\n\n  ---\n  OR\n  ---\n\n"
                                 "  ccrush -d < cat my-compressed-file.txt.zlib\n\n"
@@ -72,16 +84,156 @@ static void print_help_text()
     fprintf(stdout, HELP_TEXT, CCRUSH_VERSION_STR, ZLIB_VERSION);
 }
 
+static uint8_t* read_file(const char* file_path, size_t* out_length)
+{
+    FILE* file = fopen(file_path, "rb");
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    uint8_t* data = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+
+    for (;;)
+    {
+        if (length == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 1024 * 64;
+
+            uint8_t* new_data = realloc(data, capacity);
+            if (new_data == NULL)
+            {
+                free(data);
+                data = NULL;
+                break;
+            }
+
+            data = new_data;
+        }
+
+        const size_t n = fread(data + length, 1, capacity - length, file);
+        length += n;
+
+        if (n == 0)
+        {
+            if (ferror(file))
+            {
+                free(data);
+                data = NULL;
+            }
+
+            break;
+        }
+    }
+
+    fclose(file);
+
+    *out_length = length;
+    return data;
+}
+
+static int train(const int argc, char* argv[], const int first)
+{
+    if (argc - first < 2)
+    {
+        fprintf(stderr, "Please specify the dictionary output file and at least one sample file after the \"--train\" argument.\n");
+        return CCRUSH_ERROR_INVALID_ARGS;
+    }
+
+    int r = -1;
+
+    const size_t sample_count = (size_t)(argc - first - 1);
+    uint8_t** samples = calloc(sample_count, sizeof(uint8_t*));
+    size_t* sample_lengths = calloc(sample_count, sizeof(size_t));
+
+    if (samples == NULL || sample_lengths == NULL)
+    {
+        r = CCRUSH_ERROR_OUT_OF_MEMORY;
+        goto exit;
+    }
+
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+        samples[i] = read_file(argv[first + 1 + i], &sample_lengths[i]);
+
+        if (samples[i] == NULL)
+        {
+            fprintf(stderr, "Failed to read sample file \"%s\".\n", argv[first + 1 + i]);
+            r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+            goto exit;
+        }
+    }
+
+    uint8_t dictionary[CCRUSH_MAX_DICTIONARY_SIZE];
+    size_t dictionary_length = 0;
+
+    r = ccrush_train_dictionary((const uint8_t* const*)samples, sample_lengths, sample_count, dictionary, sizeof(dictionary), &dictionary_length);
+    if (r != 0)
+    {
+        fprintf(stderr, "Dictionary training failed; ccrush_train_dictionary returned error code: %d.\n", r);
+        goto exit;
+    }
+
+    FILE* output_file = fopen(argv[first], "wb");
+    if (output_file == NULL)
+    {
+        fprintf(stderr, "Failed to open dictionary output file \"%s\".\n", argv[first]);
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+        goto exit;
+    }
+
+    if (fwrite(dictionary, 1, dictionary_length, output_file) != dictionary_length)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    if (fclose(output_file) != 0)
+    {
+        r = CCRUSH_ERROR_FILE_ACCESS_FAILED;
+    }
+
+    if (r != 0)
+    {
+        fprintf(stderr, "Failed to write dictionary output file \"%s\".\n", argv[first]);
+    }
+
+exit:
+
+    if (samples != NULL)
+    {
+        for (size_t i = 0; i < sample_count; ++i)
+        {
+            free(samples[i]);
+        }
+    }
+
+    free(samples);
+    free(sample_lengths);
+
+    return r;
+}
+
 int main(const int argc, char* argv[])
 {
     int decompress = 0;
+    int parallel_format = 0;
     int compression_level = 6;
     int buffer_size_kib = 256;
+    int buffer_size_set = 0;
+    uint32_t thread_count = 1;
+    const char* dictionary_file_path = NULL;
 
     for (int i = 1; i < argc; ++i)
     {
         const char* arg = argv[i];
 
+        if (strncmp(arg, "--train", 7) == 0)
+        {
+            return train(argc, argv, i + 1);
+        }
+
         if (strncmp(arg, "-h", 2) == 0 || strncmp(arg, "--help", 6) == 0)
         {
             print_help_text();
@@ -129,18 +281,113 @@ int main(const int argc, char* argv[])
             }
 
             buffer_size_kib = (int)buffer_size;
+            buffer_size_set = 1;
+        }
+
+        if (strncmp(arg, "-t", 2) == 0 || strncmp(arg, "--threads", 9) == 0)
+        {
+            if (i == argc - 1)
+            {
+                fprintf(stderr, "Please specify the amount of threads to use after the \"-t\" argument.\n");
+                return CCRUSH_ERROR_INVALID_ARGS;
+            }
+
+            thread_count = (uint32_t)CCRUSH_MIN(strtoul(argv[i + 1], NULL, 10), CCRUSH_MAX_THREAD_COUNT);
+        }
+
+        if (strncmp(arg, "-p", 2) == 0 || strncmp(arg, "--parallel-format", 17) == 0)
+        {
+            parallel_format = 1;
+        }
+
+        if (strncmp(arg, "-a", 2) == 0 || strncmp(arg, "--adaptive", 10) == 0)
+        {
+            ccrush_set_adaptive_compression(1);
+        }
+
+        if (strncmp(arg, "-D", 2) == 0 || strncmp(arg, "--dictionary", 12) == 0)
+        {
+            if (i == argc - 1)
+            {
+                fprintf(stderr, "Please specify the path to the dictionary file after the \"-D\" argument.\n");
+                return CCRUSH_ERROR_INVALID_ARGS;
+            }
+
+            dictionary_file_path = argv[i + 1];
+        }
+    }
+
+    uint8_t* dictionary = NULL;
+    size_t dictionary_length = 0;
+
+    if (dictionary_file_path != NULL)
+    {
+        if (parallel_format || thread_count != 1)
+        {
+            fprintf(stderr, "The \"-D\" argument can't be combined with \"-p\" or \"-t\".\n");
+            return CCRUSH_ERROR_INVALID_ARGS;
+        }
+
+        dictionary = read_file(dictionary_file_path, &dictionary_length);
+
+        if (dictionary == NULL || dictionary_length == 0)
+        {
+            fprintf(stderr, "Failed to read dictionary file \"%s\".\n", dictionary_file_path);
+            free(dictionary);
+            return CCRUSH_ERROR_FILE_ACCESS_FAILED;
         }
     }
 
     int r = -1;
+    const char* function_name = NULL;
 
     if (decompress)
     {
-        r = ccrush_decompress_file_raw(stdin, stdout, (uint32_t)buffer_size_kib, 0, 1);
+        // A zlib stream can never start with a 'C' (its compression method nibble would be 3), but a block container always does.
+        const int first_byte = fgetc(stdin);
+        parallel_format = first_byte == CCRUSH_CONTAINER_MAGIC[0];
+
+        // Seeking back (rather than pushing the byte back) leaves no read-ahead in stdin's buffer, so the I/O backend can take over the file descriptor directly.
+        if (first_byte != EOF && fseek(stdin, -1, SEEK_CUR) != 0)
+        {
+            ungetc(first_byte, stdin);
+        }
+
+        if (parallel_format && dictionary != NULL)
+        {
+            function_name = "ccrush_decompress_container_file_raw";
+            r = CCRUSH_ERROR_INVALID_ARGS;
+        }
+        else if (parallel_format)
+        {
+            function_name = "ccrush_decompress_container_file_raw";
+            r = ccrush_decompress_container_file_raw(stdin, stdout, thread_count, 0, 1);
+        }
+        else if (dictionary != NULL)
+        {
+            function_name = "ccrush_decompress_file_raw_with_dictionary";
+            r = ccrush_decompress_file_raw_with_dictionary(stdin, stdout, (uint32_t)buffer_size_kib, dictionary, dictionary_length, 0, 1);
+        }
+        else
+        {
+            function_name = "ccrush_decompress_file_raw";
+            r = ccrush_decompress_file_raw(stdin, stdout, (uint32_t)buffer_size_kib, 0, 1);
+        }
+    }
+    else if (dictionary != NULL)
+    {
+        function_name = "ccrush_compress_file_raw_with_dictionary";
+        r = ccrush_compress_file_raw_with_dictionary(stdin, stdout, (uint32_t)buffer_size_kib, compression_level, dictionary, dictionary_length, 0, 1);
+    }
+    else if (parallel_format)
+    {
+        function_name = "ccrush_compress_container_file_raw";
+        r = ccrush_compress_container_file_raw(stdin, stdout, buffer_size_set ? (uint32_t)buffer_size_kib : 0, compression_level, thread_count, 0, 1);
     }
     else
     {
-        r = ccrush_compress_file_raw(stdin, stdout, (uint32_t)buffer_size_kib, compression_level, 0, 1);
+        function_name = "ccrush_compress_file_raw_mt";
+        r = ccrush_compress_file_raw_mt(stdin, stdout, (uint32_t)buffer_size_kib, compression_level, thread_count, 0, 1);
     }
 
     switch (r)
@@ -164,11 +411,20 @@ int main(const int argc, char* argv[])
             fprintf(stderr, "Invalid buffer size argument; it must be in the range of [1 KiB; 256 MiB]\n");
             break;
         }
+        case CCRUSH_ERROR_DICTIONARY_REQUIRED: {
+            fprintf(stderr, "The input was compressed using a dictionary; please pass it using the \"-D\" argument.\n");
+            break;
+        }
+        case CCRUSH_ERROR_DICTIONARY_MISMATCH: {
+            fprintf(stderr, "The input was compressed using a different dictionary than the one passed.\n");
+            break;
+        }
         default: {
-            fprintf(stderr, "%s failed; %s returned error code: %d.\n", decompress ? "Decompression" : "Compression", decompress ? "ccrush_decompress_file_raw": "ccrush_compress_file_raw", r);
+            fprintf(stderr, "%s failed; %s returned error code: %d.\n", decompress ? "Decompression" : "Compression", function_name, r);
             break;
         }
     }
 
+    free(dictionary);
     return r;
 }
\ No newline at end of file
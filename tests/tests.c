@@ -36,6 +36,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <ccrush.h>
 #include <acutest.h>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 /* A test case that does nothing and succeeds. */
 static void null_test_success()
 {
@@ -460,6 +470,2345 @@ static void ccrush_decompress_wrong_data_fails()
     free(decompressed_data);
 }
 
+static void ccrush_compress_into_invalid_args()
+{
+    uint8_t out[256];
+    size_t written = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_into(NULL, text_length, 6, out, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_into((uint8_t*)text, 0, 6, out, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_into((uint8_t*)text, text_length, 6, NULL, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_into((uint8_t*)text, text_length, 6, out, 0, &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_into((uint8_t*)text, text_length, 6, out, sizeof(out), NULL));
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_into(NULL, text_length, out, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_into((uint8_t*)text, 0, out, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_into((uint8_t*)text, text_length, NULL, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_into((uint8_t*)text, text_length, out, 0, &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_into((uint8_t*)text, text_length, out, sizeof(out), NULL));
+}
+
+static void ccrush_compress_into_and_decompress_into_succeed()
+{
+    uint8_t compressed[1024];
+    size_t compressed_length = 0;
+
+    TEST_ASSERT(ccrush_compress_bound(text_length) <= sizeof(compressed));
+    TEST_CHECK(0 == ccrush_compress_into((uint8_t*)text, text_length, 8, compressed, ccrush_compress_bound(text_length), &compressed_length));
+    TEST_CHECK(compressed_length < text_length);
+
+    char decompressed[1024];
+    size_t decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_decompress_into(compressed, compressed_length, (uint8_t*)decompressed, sizeof(decompressed), &decompressed_length));
+    TEST_CHECK(text_length == decompressed_length);
+    TEST_CHECK(0 == memcmp(text, decompressed, text_length));
+
+    // Exactly fitting output buffers must work too.
+    TEST_CHECK(0 == ccrush_decompress_into(compressed, compressed_length, (uint8_t*)decompressed, text_length, &decompressed_length));
+    TEST_CHECK(text_length == decompressed_length);
+}
+
+static void ccrush_compress_into_and_decompress_into_output_buffer_too_small_fails()
+{
+    uint8_t compressed[1024];
+    size_t compressed_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL == ccrush_compress_into((uint8_t*)text, text_length, 8, compressed, 16, &compressed_length));
+    TEST_CHECK(0 == ccrush_compress_into((uint8_t*)text, text_length, 8, compressed, sizeof(compressed), &compressed_length));
+
+    uint8_t decompressed[1024];
+    size_t decompressed_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL == ccrush_decompress_into(compressed, compressed_length, decompressed, text_length - 1, &decompressed_length));
+}
+
+static void ccrush_compress_with_size_header_and_decompression_succeeds()
+{
+    uint8_t* compressed_text = NULL;
+    size_t compressed_text_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress_with_size_header((uint8_t*)text, text_length, 0, 8, &compressed_text, &compressed_text_length));
+    TEST_CHECK(compressed_text_length < text_length);
+    TEST_CHECK(0 == memcmp(compressed_text, CCRUSH_SIZE_HEADER_MAGIC, 4));
+
+    uint64_t decompressed_size = 0;
+    TEST_CHECK(0 == ccrush_get_decompressed_size(compressed_text, compressed_text_length, &decompressed_size));
+    TEST_CHECK(text_length == decompressed_size);
+
+    char* decompressed_text = NULL;
+    size_t decompressed_text_length = 0;
+
+    TEST_CHECK(0 == ccrush_decompress(compressed_text, compressed_text_length, 0, (uint8_t**)(&decompressed_text), &decompressed_text_length));
+    TEST_CHECK(text_length == decompressed_text_length);
+    TEST_CHECK(0 == strncmp(text, decompressed_text, text_length));
+
+    uint8_t too_small[64];
+    size_t written = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL == ccrush_decompress_into(compressed_text, compressed_text_length, too_small, sizeof(too_small), &written));
+
+    free(compressed_text);
+    free(decompressed_text);
+}
+
+static void ccrush_decompress_without_size_header_still_works()
+{
+    uint8_t* compressed_text = NULL;
+    size_t compressed_text_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress((uint8_t*)text, text_length, 0, 8, &compressed_text, &compressed_text_length));
+
+    uint64_t decompressed_size = 0;
+    TEST_CHECK(CCRUSH_ERROR_NO_SIZE_HEADER == ccrush_get_decompressed_size(compressed_text, compressed_text_length, &decompressed_size));
+
+    free(compressed_text);
+}
+
+static void ccrush_decompress_with_forged_size_header_fails()
+{
+    uint8_t* compressed_text = NULL;
+    size_t compressed_text_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress_with_size_header((uint8_t*)text, text_length, 0, 8, &compressed_text, &compressed_text_length));
+
+    uint8_t* decompressed_text = NULL;
+    size_t decompressed_text_length = 0;
+
+    // Lie about the uncompressed length: once by a little, once by an impossible amount.
+    compressed_text[4] ^= 0x01;
+    TEST_CHECK(0 != ccrush_decompress(compressed_text, compressed_text_length, 0, &decompressed_text, &decompressed_text_length));
+    TEST_CHECK(decompressed_text == NULL);
+
+    compressed_text[10] = 0xFF;
+    TEST_CHECK(0 != ccrush_decompress(compressed_text, compressed_text_length, 0, &decompressed_text, &decompressed_text_length));
+    TEST_CHECK(decompressed_text == NULL);
+
+    free(compressed_text);
+}
+
+static int files_are_equal(const char* file_path_1, const char* file_path_2)
+{
+    FILE* f1 = fopen(file_path_1, "rb");
+    FILE* f2 = fopen(file_path_2, "rb");
+
+    int equal = f1 != NULL && f2 != NULL;
+
+    while (equal)
+    {
+        const int c1 = fgetc(f1);
+        const int c2 = fgetc(f2);
+
+        equal = c1 == c2;
+
+        if (c1 == EOF || c2 == EOF)
+        {
+            break;
+        }
+    }
+
+    if (f1 != NULL)
+        fclose(f1);
+
+    if (f2 != NULL)
+        fclose(f2);
+
+    return equal;
+}
+
+static void write_test_file(const char* file_path, const size_t text_repetitions)
+{
+    FILE* file = fopen(file_path, "wb");
+    TEST_ASSERT(file != NULL);
+
+    uint32_t x = 1337;
+
+    for (size_t i = 0; i < text_repetitions; ++i)
+    {
+        fwrite(text, sizeof(char), text_length, file);
+
+        // Sprinkle in some noise to make sure that not every block looks the same.
+        x = x * 1103515245 + 12345;
+        fwrite(&x, sizeof(x), 1, file);
+    }
+
+    fclose(file);
+}
+
+static void ccrush_compress_file_mt_invalid_args()
+{
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_file_mt(NULL, NULL, 256, 6, 4));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_file_raw_mt(NULL, NULL, 256, 6, 4, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_compress_file_mt("test", "test2", 1024 * 1024, 6, 4));
+}
+
+static void ccrush_compress_file_mt_result_is_standard_zlib_and_decompression_succeeds()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char output2_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(output2_file_path, "%s", tmpnam(NULL));
+
+    const size_t repetitions[] = { 0, 1, 4096, 65536 };
+
+    for (size_t i = 0; i < sizeof(repetitions) / sizeof(size_t); ++i)
+    {
+        write_test_file(input_file_path, repetitions[i]);
+
+        TEST_CHECK(0 == ccrush_compress_file_mt(input_file_path, output_file_path, 64, 6, 4));
+        TEST_CHECK(0 == ccrush_decompress_file(output_file_path, output2_file_path, 256));
+        TEST_CHECK(files_are_equal(input_file_path, output2_file_path));
+    }
+
+    // Out of range levels mean 6, no matter the thread count.
+    for (uint32_t thread_count = 1; thread_count <= 4; thread_count += 3)
+    {
+        TEST_CHECK(0 == ccrush_compress_file_mt(input_file_path, output_file_path, 64, 11, thread_count));
+        TEST_CHECK(0 == ccrush_decompress_file(output_file_path, output2_file_path, 256));
+        TEST_CHECK(files_are_equal(input_file_path, output2_file_path));
+    }
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(output2_file_path);
+}
+
+static void ccrush_compress_mt_invalid_args()
+{
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_mt(NULL, 256, 256, 8, 4, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_mt((uint8_t*)text, 0, 256, 8, 4, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_mt((uint8_t*)text, text_length, 256, 8, 4, NULL, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_mt((uint8_t*)text, text_length, 256, 8, 4, &out, NULL));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_compress_mt((uint8_t*)text, text_length, 1024 * 1024, 8, 4, &out, &out_length));
+}
+
+static void ccrush_compress_mt_result_is_standard_zlib_and_decompression_succeeds()
+{
+    const size_t lengths[] = { text_length, 1024 * 128 + 1, 1024 * 1024 * 3 + 77 };
+
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(size_t); ++i)
+    {
+        const size_t data_length = lengths[i];
+
+        uint8_t* data = malloc(data_length);
+        TEST_ASSERT(data != NULL);
+
+        uint32_t x = 1337;
+
+        for (size_t j = 0; j < data_length; ++j)
+        {
+            x = x * 1103515245 + 12345;
+            data[j] = (j / 4096) % 3 == 2 ? (uint8_t)(x >> 24) : (uint8_t)text[j % text_length];
+        }
+
+        uint8_t* compressed_data = NULL;
+        size_t compressed_data_length = 0;
+
+        TEST_CHECK(0 == ccrush_compress_mt(data, data_length, 0, 6, 4, &compressed_data, &compressed_data_length));
+        TEST_CHECK(compressed_data_length < data_length);
+
+        uint8_t* decompressed_data = NULL;
+        size_t decompressed_data_length = 0;
+
+        TEST_CHECK(0 == ccrush_decompress(compressed_data, compressed_data_length, 0, &decompressed_data, &decompressed_data_length));
+        TEST_CHECK(data_length == decompressed_data_length);
+        TEST_CHECK(0 == memcmp(data, decompressed_data, data_length));
+
+        free(data);
+        free(compressed_data);
+        free(decompressed_data);
+    }
+}
+
+static void ccrush_ctx_invalid_args()
+{
+    ccrush_ctx* ctx = NULL;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_new(0, NULL));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_ctx_new(CCRUSH_MAX_BUFFER_SIZE_KiB + 1, &ctx));
+    TEST_CHECK(ctx == NULL);
+
+    TEST_CHECK(0 == ccrush_ctx_new(0, &ctx));
+
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_compress(NULL, (uint8_t*)text, text_length, 6, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_compress(ctx, NULL, text_length, 6, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_compress(ctx, (uint8_t*)text, 0, 6, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_decompress(NULL, (uint8_t*)text, text_length, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_decompress(ctx, (uint8_t*)text, text_length, NULL, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_compress_file(ctx, NULL, NULL, 6));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_compress_file(ctx, "test.txt", "test.txt", 6));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_decompress_file(NULL, "test.txt", "test2.txt"));
+    TEST_CHECK(out == NULL);
+
+    ccrush_ctx_free(ctx);
+    ccrush_ctx_free(NULL);
+}
+
+static void ccrush_ctx_reused_across_many_calls_succeeds()
+{
+    ccrush_ctx* ctx = NULL;
+    TEST_CHECK(0 == ccrush_ctx_new(0, &ctx));
+
+    uint8_t compressed[1024];
+    uint8_t decompressed[1024];
+
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        // Vary length and level so that the reused streams are reset (and re-initialized on level changes) between calls.
+        const size_t length = 1 + (i * 7) % text_length;
+        const int level = (int)(i % 10);
+
+        size_t compressed_length = 0, decompressed_length = 0;
+
+        TEST_CHECK(0 == ccrush_ctx_compress_into(ctx, (uint8_t*)text, length, level, compressed, sizeof(compressed), &compressed_length));
+        TEST_CHECK(0 == ccrush_ctx_decompress_into(ctx, compressed, compressed_length, decompressed, sizeof(decompressed), &decompressed_length));
+        TEST_CHECK(length == decompressed_length);
+        TEST_CHECK(0 == memcmp(text, decompressed, length));
+
+        uint8_t* out = NULL;
+        uint8_t* out2 = NULL;
+        size_t out_length = 0, out2_length = 0;
+
+        TEST_CHECK(0 == ccrush_ctx_compress(ctx, (uint8_t*)text, length, level, &out, &out_length));
+        TEST_CHECK(0 == ccrush_ctx_decompress(ctx, out, out_length, &out2, &out2_length));
+        TEST_CHECK(length == out2_length);
+        TEST_CHECK(0 == memcmp(text, out2, length));
+
+        free(out);
+        free(out2);
+    }
+
+    // A failed call must not poison the context for the next one.
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+
+    TEST_CHECK(0 != ccrush_ctx_decompress(ctx, (uint8_t*)text, text_length, &out, &out_length));
+    TEST_CHECK(0 == ccrush_ctx_compress(ctx, (uint8_t*)text, text_length, 6, &out, &out_length));
+
+    uint8_t* out2 = NULL;
+    size_t out2_length = 0;
+
+    TEST_CHECK(0 == ccrush_ctx_decompress(ctx, out, out_length, &out2, &out2_length));
+    TEST_CHECK(text_length == out2_length);
+    TEST_CHECK(0 == memcmp(text, out2, text_length));
+
+    free(out);
+    free(out2);
+
+    ccrush_ctx_free(ctx);
+}
+
+static void ccrush_ctx_compress_file_and_decompression_succeeds()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char output2_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(output2_file_path, "%s", tmpnam(NULL));
+
+    ccrush_ctx* ctx = NULL;
+    TEST_CHECK(0 == ccrush_ctx_new(64, &ctx));
+
+    const size_t repetitions[] = { 0, 1, 4096, 3 };
+
+    for (size_t i = 0; i < sizeof(repetitions) / sizeof(size_t); ++i)
+    {
+        write_test_file(input_file_path, repetitions[i]);
+
+        TEST_CHECK(0 == ccrush_ctx_compress_file(ctx, input_file_path, output_file_path, 6));
+        TEST_CHECK(0 == ccrush_ctx_decompress_file(ctx, output_file_path, output2_file_path));
+        TEST_CHECK(files_are_equal(input_file_path, output2_file_path));
+    }
+
+    ccrush_ctx_free(ctx);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(output2_file_path);
+}
+
+static void ccrush_thread_cache_reused_across_calls_succeeds()
+{
+    const int was_enabled = ccrush_thread_cache_is_enabled();
+
+    ccrush_thread_cache_release();
+    ccrush_thread_cache_enable(1);
+    TEST_CHECK(ccrush_thread_cache_is_enabled());
+
+    for (size_t i = 0; i < 200; ++i)
+    {
+        // Switch buffer sizes and levels around, so that the cached buffers and streams need to be swapped out every now and then.
+        const size_t length = 1 + (i * 13) % text_length;
+        const uint32_t buffer_size_kib = (uint32_t)(i % 3) * 32;
+        const int level = (int)(i % 10);
+
+        uint8_t* compressed = NULL;
+        uint8_t* decompressed = NULL;
+        size_t compressed_length = 0, decompressed_length = 0;
+
+        TEST_CHECK(0 == ccrush_compress((uint8_t*)text, length, buffer_size_kib, level, &compressed, &compressed_length));
+        TEST_CHECK(0 == ccrush_decompress(compressed, compressed_length, buffer_size_kib, &decompressed, &decompressed_length));
+        TEST_CHECK(length == decompressed_length);
+        TEST_CHECK(0 == memcmp(text, decompressed, length));
+
+        free(compressed);
+        free(decompressed);
+
+        if (i % 50 == 49)
+        {
+            ccrush_thread_cache_release();
+        }
+    }
+
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char output2_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(output2_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 4096);
+
+    TEST_CHECK(0 == ccrush_compress_file(input_file_path, output_file_path, 64, 6));
+    TEST_CHECK(0 == ccrush_decompress_file(output_file_path, output2_file_path, 0));
+    TEST_CHECK(files_are_equal(input_file_path, output2_file_path));
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(output2_file_path);
+
+    ccrush_thread_cache_release();
+    ccrush_thread_cache_release();
+    ccrush_thread_cache_enable(was_enabled);
+}
+
+struct counting_allocator
+{
+    volatile long allocations;
+    volatile long frees;
+};
+
+// The hooks are called concurrently by the multi-threaded functions.
+static void counting_increment(volatile long* counter)
+{
+#ifdef _MSC_VER
+    _InterlockedIncrement(counter);
+#else
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+static void* counting_alloc(void* user, size_t size)
+{
+    counting_increment(&((struct counting_allocator*)user)->allocations);
+    return malloc(size);
+}
+
+static void counting_free(void* user, void* mem)
+{
+    counting_increment(&((struct counting_allocator*)user)->frees);
+    free(mem);
+}
+
+static void ccrush_set_allocator_invalid_args()
+{
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_set_allocator(&counting_alloc, NULL, NULL));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_set_allocator(NULL, &counting_free, NULL));
+    TEST_CHECK(0 == ccrush_set_allocator(NULL, NULL, NULL));
+}
+
+static void ccrush_set_allocator_routes_all_allocations()
+{
+    struct counting_allocator counter = { 0 };
+
+    // Nothing that was allocated before may outlive the switch (in case the thread cache is enabled by default).
+    ccrush_thread_cache_release();
+    TEST_CHECK(0 == ccrush_set_allocator(&counting_alloc, &counting_free, &counter));
+
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t compressed_length = 0, decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress((uint8_t*)text, text_length, 0, 6, &compressed, &compressed_length));
+
+#ifdef CCRUSH_LIBDEFLATE
+    // The output buffer + libdeflate's compressor (which it allocates in one piece).
+    TEST_CHECK(counter.allocations >= 2);
+#else
+    // The output buffer + deflate's internal state (which zlib allocates in several pieces).
+    TEST_CHECK(counter.allocations > 2);
+#endif
+
+    TEST_CHECK(0 == ccrush_decompress(compressed, compressed_length, 1, &decompressed, &decompressed_length));
+    TEST_CHECK(text_length == decompressed_length);
+    TEST_CHECK(0 == memcmp(text, decompressed, text_length));
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+
+    const size_t data_length = 1024 * 1024;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        data[i] = (uint8_t)text[i % text_length];
+    }
+
+    TEST_CHECK(0 == ccrush_compress_mt(data, data_length, 0, 6, 4, &compressed, &compressed_length));
+    TEST_CHECK(0 == ccrush_decompress(compressed, compressed_length, 0, &decompressed, &decompressed_length));
+    TEST_CHECK(data_length == decompressed_length);
+    TEST_CHECK(0 == memcmp(data, decompressed, data_length));
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    free(data);
+
+    ccrush_ctx* ctx = NULL;
+    TEST_CHECK(0 == ccrush_ctx_new(0, &ctx));
+    TEST_CHECK(0 == ccrush_ctx_compress(ctx, (uint8_t*)text, text_length, 6, &compressed, &compressed_length));
+    TEST_CHECK(0 == ccrush_ctx_decompress(ctx, compressed, compressed_length, &decompressed, &decompressed_length));
+    ccrush_ctx_free(ctx);
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+
+    ccrush_thread_cache_release();
+    TEST_CHECK(0 == ccrush_set_allocator(NULL, NULL, NULL));
+
+    // Everything that went through the hooks also came back through them.
+    TEST_CHECK(counter.allocations == counter.frees);
+    TEST_MSG("Allocations: %ld; frees: %ld", counter.allocations, counter.frees);
+}
+
+static void ccrush_ctx_new_ex_invalid_args()
+{
+    struct counting_allocator counter = { 0 };
+    ccrush_ctx* ctx = NULL;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_new_ex(0, &counting_alloc, NULL, &counter, &ctx));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_new_ex(0, NULL, &counting_free, &counter, &ctx));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_new_ex(0, &counting_alloc, &counting_free, &counter, NULL));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_ctx_new_ex(CCRUSH_MAX_BUFFER_SIZE_KiB + 1, &counting_alloc, &counting_free, &counter, &ctx));
+    TEST_CHECK(ctx == NULL);
+    TEST_CHECK(counter.allocations == 0);
+
+    // Without functions, it's just ccrush_ctx_new().
+    TEST_CHECK(0 == ccrush_ctx_new_ex(0, NULL, NULL, &counter, &ctx));
+    TEST_CHECK(ctx != NULL);
+    ccrush_ctx_free(ctx);
+    TEST_CHECK(counter.allocations == 0);
+}
+
+struct arena_job
+{
+    struct counting_allocator arena;
+    const uint8_t* data;
+    size_t data_length;
+    int result;
+};
+
+static int arena_job_run(struct arena_job* job)
+{
+    ccrush_ctx* ctx = NULL;
+
+    int r = ccrush_ctx_new_ex(0, &counting_alloc, &counting_free, &job->arena, &ctx);
+    if (r != 0)
+    {
+        return r;
+    }
+
+    r = ccrush_ctx_set_dictionary(ctx, (const uint8_t*)text, text_length);
+
+    for (int i = 0; i < 8 && r == 0; ++i)
+    {
+        uint8_t* compressed = NULL;
+        uint8_t* decompressed = NULL;
+        size_t compressed_length = 0, decompressed_length = 0;
+
+        r = ccrush_ctx_compress(ctx, job->data, job->data_length, 1 + i, &compressed, &compressed_length);
+
+        if (r == 0)
+        {
+            r = ccrush_ctx_decompress(ctx, compressed, compressed_length, &decompressed, &decompressed_length);
+        }
+
+        if (r == 0 && (decompressed_length != job->data_length || memcmp(decompressed, job->data, job->data_length) != 0))
+        {
+            r = -1;
+        }
+
+        // The outputs came from the context's allocator, so that's where they go back to.
+        if (compressed != NULL)
+        {
+            counting_free(&job->arena, compressed);
+        }
+
+        if (decompressed != NULL)
+        {
+            counting_free(&job->arena, decompressed);
+        }
+    }
+
+    ccrush_ctx_free(ctx);
+    return r;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI arena_job_thread(LPVOID arg)
+{
+    ((struct arena_job*)arg)->result = arena_job_run(arg);
+    return 0;
+}
+#else
+static void* arena_job_thread(void* arg)
+{
+    ((struct arena_job*)arg)->result = arena_job_run(arg);
+    return NULL;
+}
+#endif
+
+static void ccrush_ctx_new_ex_uses_one_arena_per_context_across_threads()
+{
+    struct counting_allocator global = { 0 };
+
+    ccrush_thread_cache_release();
+    TEST_CHECK(0 == ccrush_set_allocator(&counting_alloc, &counting_free, &global));
+
+    const size_t data_length = 1024 * 256;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        data[i] = (uint8_t)text[(i * 7) % text_length];
+    }
+
+    struct arena_job jobs[2] = { 0 };
+    jobs[0].data = (const uint8_t*)text;
+    jobs[0].data_length = text_length;
+    jobs[1].data = data;
+    jobs[1].data_length = data_length;
+
+#ifdef _WIN32
+    HANDLE threads[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        threads[i] = CreateThread(NULL, 0, &arena_job_thread, &jobs[i], 0, NULL);
+        TEST_ASSERT(threads[i] != NULL);
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+#else
+    pthread_t threads[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        TEST_ASSERT(0 == pthread_create(&threads[i], NULL, &arena_job_thread, &jobs[i]));
+    }
+    for (int i = 0; i < 2; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+
+    TEST_CHECK(0 == ccrush_set_allocator(NULL, NULL, NULL));
+    free(data);
+
+    for (int i = 0; i < 2; ++i)
+    {
+        TEST_CHECK(jobs[i].result == 0);
+        TEST_CHECK(jobs[i].arena.allocations > 0);
+        TEST_CHECK(jobs[i].arena.allocations == jobs[i].arena.frees);
+        TEST_MSG("Arena %d: allocations: %ld; frees: %ld", i, jobs[i].arena.allocations, jobs[i].arena.frees);
+    }
+
+#ifdef CCRUSH_LIBDEFLATE
+    // libdeflate's (de)compressors can only come from the global allocator.
+    TEST_CHECK(global.allocations == global.frees);
+#else
+    // The contexts didn't touch the global allocator at all.
+    TEST_CHECK(global.allocations == 0);
+    TEST_MSG("Global allocations: %ld", global.allocations);
+#endif
+}
+
+static void ccrush_scrub_buffers_opt_out_succeeds()
+{
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_set_scrub_buffers(NULL, 0));
+    TEST_CHECK(ccrush_get_scrub_buffers());
+
+    ccrush_set_scrub_buffers(0);
+    TEST_CHECK(!ccrush_get_scrub_buffers());
+
+    uint8_t* compressed = NULL;
+    uint8_t* decompressed = NULL;
+    size_t compressed_length = 0, decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress((uint8_t*)text, text_length, 0, 6, &compressed, &compressed_length));
+    TEST_CHECK(0 == ccrush_decompress(compressed, compressed_length, 1, &decompressed, &decompressed_length));
+    TEST_CHECK(text_length == decompressed_length);
+    TEST_CHECK(0 == memcmp(text, decompressed, text_length));
+
+    free(compressed);
+    free(decompressed);
+
+    ccrush_set_scrub_buffers(1);
+    TEST_CHECK(ccrush_get_scrub_buffers());
+
+    ccrush_ctx* secrets_ctx = NULL;
+    ccrush_ctx* telemetry_ctx = NULL;
+
+    TEST_CHECK(0 == ccrush_ctx_new(0, &secrets_ctx));
+    TEST_CHECK(0 == ccrush_ctx_new(0, &telemetry_ctx));
+    TEST_CHECK(0 == ccrush_ctx_set_scrub_buffers(telemetry_ctx, 0));
+
+    for (int i = 0; i < 2; ++i)
+    {
+        ccrush_ctx* ctx = i ? telemetry_ctx : secrets_ctx;
+
+        TEST_CHECK(0 == ccrush_ctx_compress(ctx, (uint8_t*)text, text_length, 6, &compressed, &compressed_length));
+        TEST_CHECK(0 == ccrush_ctx_decompress(ctx, compressed, compressed_length, &decompressed, &decompressed_length));
+        TEST_CHECK(text_length == decompressed_length);
+        TEST_CHECK(0 == memcmp(text, decompressed, text_length));
+
+        free(compressed);
+        free(decompressed);
+    }
+
+    ccrush_ctx_free(secrets_ctx);
+    ccrush_ctx_free(telemetry_ctx);
+}
+
+struct stream_sink
+{
+    uint8_t* data;
+    size_t length;
+    size_t capacity;
+    size_t calls;
+    int fail;
+};
+
+static int stream_sink_write(void* user, const uint8_t* data, size_t data_length)
+{
+    struct stream_sink* sink = (struct stream_sink*)user;
+
+    if (sink->fail)
+    {
+        return -1;
+    }
+
+    if (sink->length + data_length > sink->capacity)
+    {
+        sink->capacity = (sink->length + data_length) * 2;
+        sink->data = realloc(sink->data, sink->capacity);
+    }
+
+    memcpy(sink->data + sink->length, data, data_length);
+    sink->length += data_length;
+    sink->calls++;
+
+    return 0;
+}
+
+static void ccrush_stream_invalid_args()
+{
+    ccrush_stream* stream = NULL;
+    struct stream_sink sink = { 0 };
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_init(NULL, CCRUSH_STREAM_MODE_COMPRESS, 6, 0, &stream_sink_write, &sink));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_COMPRESS, 6, 0, NULL, &sink));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_init(&stream, 1337, 6, 0, &stream_sink_write, &sink));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_COMPRESS, 6, CCRUSH_MAX_BUFFER_SIZE_KiB + 1, &stream_sink_write, &sink));
+    TEST_CHECK(stream == NULL);
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_update(NULL, (uint8_t*)text, text_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_flush(NULL));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_finish(NULL));
+
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_COMPRESS, 6, 0, &stream_sink_write, &sink));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_update(stream, NULL, 5));
+    TEST_CHECK(0 == ccrush_stream_update(stream, NULL, 0));
+
+    ccrush_stream_free(stream);
+    ccrush_stream_free(NULL);
+}
+
+static void ccrush_stream_compress_and_decompress_in_pieces_succeeds()
+{
+    const size_t data_length = 1024 * 1024 + 77;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    uint32_t x = 1337;
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        data[i] = (i / 4096) % 3 == 2 ? (uint8_t)(x >> 16) : (uint8_t)text[i % text_length];
+    }
+
+    ccrush_stream* stream = NULL;
+    struct stream_sink compressed = { 0 };
+    struct stream_sink decompressed = { 0 };
+
+    // Tiny output buffer, so that the write callback is hit lots of times.
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_COMPRESS, 6, 1, &stream_sink_write, &compressed));
+
+    for (size_t i = 0, n = 1; i < data_length; i += n, n = (n * 7 + 3) % 50000 + 1)
+    {
+        TEST_CHECK(0 == ccrush_stream_update(stream, data + i, CCRUSH_MIN(n, data_length - i)));
+
+        if (i % 5 == 0)
+        {
+            const size_t compressed_length = compressed.length;
+
+            TEST_CHECK(0 == ccrush_stream_flush(stream));
+
+            // A sync flush always ends on the empty stored block marker.
+            TEST_CHECK(compressed.length > compressed_length);
+            TEST_CHECK(0 == memcmp(compressed.data + compressed.length - 4, "\x00\x00\xFF\xFF", 4));
+        }
+    }
+
+    TEST_CHECK(0 == ccrush_stream_finish(stream));
+    TEST_CHECK(0 == ccrush_stream_finish(stream));
+    TEST_CHECK(compressed.calls > 1);
+    ccrush_stream_free(stream);
+
+    // The result is one plain zlib stream.
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+
+    TEST_CHECK(0 == ccrush_decompress(compressed.data, compressed.length, 0, &out, &out_length));
+    TEST_CHECK(data_length == out_length);
+    TEST_CHECK(0 == memcmp(data, out, data_length));
+    free(out);
+
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_DECOMPRESS, 0, 0, &stream_sink_write, &decompressed));
+
+    for (size_t i = 0, n = 1; i < compressed.length; i += n, n = (n * 3 + 1) % 3000 + 1)
+    {
+        TEST_CHECK(0 == ccrush_stream_update(stream, compressed.data + i, CCRUSH_MIN(n, compressed.length - i)));
+    }
+
+    TEST_CHECK(0 == ccrush_stream_finish(stream));
+    TEST_CHECK(0 != ccrush_stream_update(stream, (uint8_t*)"trailing garbage", 16));
+    ccrush_stream_free(stream);
+
+    TEST_CHECK(data_length == decompressed.length);
+    TEST_CHECK(0 == memcmp(data, decompressed.data, data_length));
+
+    free(data);
+    free(compressed.data);
+    free(decompressed.data);
+}
+
+static void ccrush_stream_decompress_with_size_header_one_byte_at_a_time_succeeds()
+{
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress_with_size_header((uint8_t*)text, text_length, 0, 6, &compressed, &compressed_length));
+
+    ccrush_stream* stream = NULL;
+    struct stream_sink decompressed = { 0 };
+
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_DECOMPRESS, 0, 0, &stream_sink_write, &decompressed));
+
+    for (size_t i = 0; i < compressed_length; ++i)
+    {
+        TEST_CHECK(0 == ccrush_stream_update(stream, compressed + i, 1));
+    }
+
+    TEST_CHECK(0 == ccrush_stream_finish(stream));
+    ccrush_stream_free(stream);
+
+    TEST_CHECK(text_length == decompressed.length);
+    TEST_CHECK(0 == memcmp(text, decompressed.data, text_length));
+
+    free(compressed);
+    free(decompressed.data);
+}
+
+static void ccrush_stream_decompress_truncated_or_wrong_data_fails()
+{
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress((uint8_t*)text, text_length, 0, 6, &compressed, &compressed_length));
+
+    ccrush_stream* stream = NULL;
+    struct stream_sink decompressed = { 0 };
+
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_DECOMPRESS, 0, 0, &stream_sink_write, &decompressed));
+    TEST_CHECK(0 == ccrush_stream_update(stream, compressed, compressed_length - 3));
+    TEST_CHECK(0 != ccrush_stream_finish(stream));
+    ccrush_stream_free(stream);
+
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_DECOMPRESS, 0, 0, &stream_sink_write, &decompressed));
+    TEST_CHECK(0 != ccrush_stream_update(stream, (uint8_t*)text, text_length));
+    TEST_CHECK(0 != ccrush_stream_finish(stream));
+    ccrush_stream_free(stream);
+
+    // Failing write callbacks abort the stream with their return value.
+    decompressed.fail = 1;
+
+    TEST_CHECK(0 == ccrush_stream_init(&stream, CCRUSH_STREAM_MODE_DECOMPRESS, 0, 0, &stream_sink_write, &decompressed));
+    TEST_CHECK(-1 == ccrush_stream_update(stream, compressed, compressed_length));
+    TEST_CHECK(-1 == ccrush_stream_finish(stream));
+    ccrush_stream_free(stream);
+
+    free(compressed);
+    free(decompressed.data);
+}
+
+static uint8_t* read_test_file(const char* file_path, size_t* out_length)
+{
+    FILE* file = fopen(file_path, "rb");
+    TEST_ASSERT(file != NULL);
+
+    fseek(file, 0, SEEK_END);
+    const size_t length = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* data = malloc(length + 1);
+    TEST_ASSERT(data != NULL);
+    TEST_CHECK(fread(data, sizeof(uint8_t), length, file) == length);
+
+    fclose(file);
+
+    *out_length = length;
+    return data;
+}
+
+static void ccrush_index_invalid_args()
+{
+    ccrush_index* index = NULL;
+    uint8_t out[16];
+    size_t written = 0;
+    uint64_t size = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_index_build(NULL, 0, &index));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_index_build(stdin, 0, NULL));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_index_save(NULL, "test.ccri"));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_index_load(NULL, &index));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_index_load("test.ccri", NULL));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_index_get_uncompressed_size(NULL, &size));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_range(NULL, index, 0, out, sizeof(out), &written));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_range(stdin, NULL, 0, out, sizeof(out), &written));
+    TEST_CHECK(index == NULL);
+
+    ccrush_index_free(NULL);
+}
+
+static void ccrush_decompress_range_succeeds()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char index_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(index_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 8192);
+    TEST_CHECK(0 == ccrush_compress_file(input_file_path, output_file_path, 0, 6));
+
+    size_t data_length = 0;
+    uint8_t* data = read_test_file(input_file_path, &data_length);
+
+    FILE* compressed_file = fopen(output_file_path, "rb");
+    TEST_ASSERT(compressed_file != NULL);
+
+    ccrush_index* built_index = NULL;
+    ccrush_index* loaded_index = NULL;
+
+    TEST_CHECK(0 == ccrush_index_build(compressed_file, 256, &built_index));
+    TEST_CHECK(0 == ccrush_index_save(built_index, index_file_path));
+    TEST_CHECK(0 == ccrush_index_load(index_file_path, &loaded_index));
+
+    uint64_t uncompressed_size = 0;
+    TEST_CHECK(0 == ccrush_index_get_uncompressed_size(loaded_index, &uncompressed_size));
+    TEST_CHECK(uncompressed_size == data_length);
+
+    const uint64_t offsets[] = { 0, 1, 4095, 256 * 1024, 256 * 1024 + 1, data_length / 2, data_length - 4096, data_length - 10 };
+
+    uint8_t out[4096 * 2];
+
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(uint64_t); ++i)
+    {
+        for (int j = 0; j < 2; ++j)
+        {
+            size_t written = 0;
+            const size_t expected = (size_t)CCRUSH_MIN((uint64_t)sizeof(out), data_length - offsets[i]);
+
+            TEST_CHECK(0 == ccrush_decompress_range(compressed_file, j ? loaded_index : built_index, offsets[i], out, sizeof(out), &written));
+            TEST_CHECK(written == expected);
+            TEST_CHECK(0 == memcmp(data + offsets[i], out, expected));
+            TEST_MSG("Offset: %llu", (unsigned long long)offsets[i]);
+        }
+    }
+
+    size_t written = 1337;
+    TEST_CHECK(0 == ccrush_decompress_range(compressed_file, loaded_index, data_length, out, sizeof(out), &written));
+    TEST_CHECK(written == 0);
+
+    fclose(compressed_file);
+    ccrush_index_free(built_index);
+    ccrush_index_free(loaded_index);
+
+    // Garbage in place of an index file.
+    FILE* index_file = fopen(index_file_path, "r+b");
+    TEST_ASSERT(index_file != NULL);
+    fputc('X', index_file);
+    fclose(index_file);
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_INDEX == ccrush_index_load(index_file_path, &loaded_index));
+
+    free(data);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(index_file_path);
+}
+
+static void ccrush_container_invalid_args()
+{
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    uint64_t block_count = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_container_file_raw(NULL, stdout, 0, 6, 1, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_container_file_raw(stdin, NULL, 0, 6, 1, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_container_file_raw(stdin, stdin, 0, 6, 1, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_compress_container_file_raw(stdin, stdout, CCRUSH_MAX_BUFFER_SIZE_KiB + 1, 6, 1, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_container_file(NULL, "test.ccrb", 0, 6, 1));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_container_file("test.txt", "test.txt", 0, 6, 1));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_container_file_raw(NULL, stdout, 1, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_container_file_raw(stdin, NULL, 1, 0, 0));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_container_file("test.ccrb", NULL, 1));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_container_get_block_count(NULL, &block_count));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_container_get_block_count(stdin, NULL));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_container_decompress_block(NULL, 0, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_container_decompress_block(stdin, 0, NULL, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_container_decompress_block(stdin, 0, &out, NULL));
+}
+
+static void ccrush_container_compress_and_decompress_succeeds()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    const size_t reps[] = { 0, 1, 8192 };
+    const uint32_t thread_counts[] = { 1, 3, 0 };
+
+    for (size_t i = 0; i < sizeof(reps) / sizeof(size_t); ++i)
+    {
+        write_test_file(input_file_path, reps[i]);
+
+        size_t data_length = 0;
+        uint8_t* data = read_test_file(input_file_path, &data_length);
+
+        for (size_t j = 0; j < sizeof(thread_counts) / sizeof(uint32_t); ++j)
+        {
+            TEST_CHECK(0 == ccrush_compress_container_file(input_file_path, output_file_path, 64, 6, thread_counts[j]));
+            TEST_CHECK(0 == ccrush_decompress_container_file(output_file_path, decompressed_file_path, thread_counts[(j + 1) % 3]));
+            TEST_CHECK(files_are_equal(input_file_path, decompressed_file_path));
+            TEST_MSG("Repetitions: %zu; thread count: %u", reps[i], thread_counts[j]);
+        }
+
+        FILE* container_file = fopen(output_file_path, "rb");
+        TEST_ASSERT(container_file != NULL);
+
+        uint64_t block_count = 0;
+        TEST_CHECK(0 == ccrush_container_get_block_count(container_file, &block_count));
+        TEST_CHECK(block_count == (data_length + 64 * 1024 - 1) / (64 * 1024));
+
+        // Decode the blocks individually, back to front.
+        for (uint64_t b = block_count; b-- > 0;)
+        {
+            uint8_t* block = NULL;
+            size_t block_length = 0;
+
+            TEST_CHECK(0 == ccrush_container_decompress_block(container_file, b, &block, &block_length));
+            TEST_CHECK(block_length == CCRUSH_MIN(64 * 1024, data_length - b * 64 * 1024));
+            TEST_CHECK(0 == memcmp(data + b * 64 * 1024, block, block_length));
+
+            ccrush_free(block);
+        }
+
+        uint8_t* block = NULL;
+        size_t block_length = 0;
+        TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_container_decompress_block(container_file, block_count, &block, &block_length));
+        TEST_CHECK(block == NULL);
+
+        fclose(container_file);
+        free(data);
+    }
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(decompressed_file_path);
+}
+
+static void ccrush_container_decompress_corrupt_or_wrong_data_fails()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 4096);
+
+    // A plain zlib stream is not a block container.
+    TEST_CHECK(0 == ccrush_compress_file(input_file_path, output_file_path, 0, 6));
+    TEST_CHECK(0 != ccrush_decompress_container_file(output_file_path, decompressed_file_path, 2));
+
+    TEST_CHECK(0 == ccrush_compress_container_file(input_file_path, output_file_path, 16, 6, 2));
+
+    size_t container_length = 0;
+    uint8_t* container = read_test_file(output_file_path, &container_length);
+    TEST_ASSERT(container != NULL && container_length > 1024);
+
+    const size_t corrupt_offsets[] = { 0, 4, 8, 8 + 12 + 100, container_length / 2, container_length - 1 };
+
+    for (size_t i = 0; i < sizeof(corrupt_offsets) / sizeof(size_t); ++i)
+    {
+        FILE* output_file = fopen(output_file_path, "wb");
+        TEST_ASSERT(output_file != NULL);
+        fwrite(container, 1, container_length, output_file);
+        fseek(output_file, (long)corrupt_offsets[i], SEEK_SET);
+        fputc(container[corrupt_offsets[i]] ^ 0x5A, output_file);
+        fclose(output_file);
+
+        TEST_CHECK(0 != ccrush_decompress_container_file(output_file_path, decompressed_file_path, 2));
+        TEST_MSG("Corrupt byte offset: %zu", corrupt_offsets[i]);
+    }
+
+    // Truncated container.
+    FILE* output_file = fopen(output_file_path, "wb");
+    TEST_ASSERT(output_file != NULL);
+    fwrite(container, 1, container_length / 2, output_file);
+    fclose(output_file);
+
+    TEST_CHECK(0 != ccrush_decompress_container_file(output_file_path, decompressed_file_path, 2));
+
+    free(container);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(decompressed_file_path);
+}
+
+static void ccrush_compress_file_mapped_and_stdio_paths_produce_the_same_output()
+{
+    char input_file_path[256] = { 0x00 };
+    char mapped_output_file_path[256] = { 0x00 };
+    char stdio_output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(mapped_output_file_path, "%s", tmpnam(NULL));
+    sprintf(stdio_output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    const size_t repetitions[] = { 0, 1, 1024, 8192 };
+
+    for (size_t i = 0; i < sizeof(repetitions) / sizeof(size_t); ++i)
+    {
+        write_test_file(input_file_path, repetitions[i]);
+
+        // The path functions map their input file if they can; the raw ones always go through stdio.
+        TEST_CHECK(0 == ccrush_compress_file(input_file_path, mapped_output_file_path, 16, 3));
+        TEST_CHECK(0 == ccrush_compress_file_raw(fopen(input_file_path, "rb"), fopen(stdio_output_file_path, "wb"), 16, 3, 1, 1));
+        TEST_CHECK(files_are_equal(mapped_output_file_path, stdio_output_file_path));
+
+        TEST_CHECK(0 == ccrush_decompress_file(mapped_output_file_path, decompressed_file_path, 16));
+        TEST_CHECK(files_are_equal(input_file_path, decompressed_file_path));
+        TEST_MSG("Repetitions: %zu", repetitions[i]);
+    }
+
+    // Truncated input must fail on the mapped path just like on the stdio path.
+    size_t compressed_length = 0;
+    uint8_t* compressed = read_test_file(mapped_output_file_path, &compressed_length);
+    TEST_ASSERT(compressed != NULL && compressed_length > 64);
+
+    FILE* truncated_file = fopen(mapped_output_file_path, "wb");
+    TEST_ASSERT(truncated_file != NULL);
+    fwrite(compressed, 1, compressed_length / 2, truncated_file);
+    fclose(truncated_file);
+
+    TEST_CHECK(0 != ccrush_decompress_file(mapped_output_file_path, decompressed_file_path, 16));
+
+    free(compressed);
+
+    remove(input_file_path);
+    remove(mapped_output_file_path);
+    remove(stdio_output_file_path);
+    remove(decompressed_file_path);
+}
+
+static void ccrush_pipelined_io_produces_the_same_output_and_decompression_succeeds()
+{
+    char input_file_path[256] = { 0x00 };
+    char sequential_output_file_path[256] = { 0x00 };
+    char pipelined_output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(sequential_output_file_path, "%s", tmpnam(NULL));
+    sprintf(pipelined_output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    TEST_CHECK(0 == ccrush_get_pipelined_io());
+
+    const size_t repetitions[] = { 0, 1, 1024, 8192 };
+    const uint32_t buffer_sizes_kib[] = { 1, 4, 256 };
+
+    for (size_t i = 0; i < sizeof(repetitions) / sizeof(size_t); ++i)
+    {
+        write_test_file(input_file_path, repetitions[i]);
+
+        for (size_t j = 0; j < sizeof(buffer_sizes_kib) / sizeof(uint32_t); ++j)
+        {
+            ccrush_set_pipelined_io(0);
+            TEST_CHECK(0 == ccrush_compress_file_raw(fopen(input_file_path, "rb"), fopen(sequential_output_file_path, "wb"), buffer_sizes_kib[j], 1, 1, 1));
+
+            ccrush_set_pipelined_io(1);
+            TEST_CHECK(1 == ccrush_get_pipelined_io());
+            TEST_CHECK(0 == ccrush_compress_file_raw(fopen(input_file_path, "rb"), fopen(pipelined_output_file_path, "wb"), buffer_sizes_kib[j], 1, 1, 1));
+            TEST_CHECK(files_are_equal(sequential_output_file_path, pipelined_output_file_path));
+
+            TEST_CHECK(0 == ccrush_decompress_file_raw(fopen(pipelined_output_file_path, "rb"), fopen(decompressed_file_path, "wb"), buffer_sizes_kib[j], 1, 1));
+            TEST_CHECK(files_are_equal(input_file_path, decompressed_file_path));
+            TEST_MSG("Repetitions: %zu; buffer size: %u KiB", repetitions[i], buffer_sizes_kib[j]);
+        }
+    }
+
+    // Truncated and garbage input must fail the same way it does without pipelining.
+    size_t compressed_length = 0;
+    uint8_t* compressed = read_test_file(pipelined_output_file_path, &compressed_length);
+    TEST_ASSERT(compressed != NULL && compressed_length > 64);
+
+    FILE* truncated_file = fopen(pipelined_output_file_path, "wb");
+    TEST_ASSERT(truncated_file != NULL);
+    fwrite(compressed, 1, compressed_length / 2, truncated_file);
+    fclose(truncated_file);
+
+    TEST_CHECK(0 != ccrush_decompress_file_raw(fopen(pipelined_output_file_path, "rb"), fopen(decompressed_file_path, "wb"), 4, 1, 1));
+    TEST_CHECK(0 != ccrush_decompress_file_raw(fopen(input_file_path, "rb"), fopen(decompressed_file_path, "wb"), 4, 1, 1));
+
+    ccrush_set_pipelined_io(0);
+    free(compressed);
+
+    remove(input_file_path);
+    remove(sequential_output_file_path);
+    remove(pipelined_output_file_path);
+    remove(decompressed_file_path);
+}
+
+static void ccrush_file_raw_functions_respect_file_positions()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 4096);
+
+    size_t data_length = 0;
+    uint8_t* data = read_test_file(input_file_path, &data_length);
+    TEST_ASSERT(data != NULL && data_length > 1000);
+
+    static const char prefix[] = "PREFIX";
+    static const char suffix[] = "SUFFIX";
+
+    // Compress everything after the first 1000 bytes of input, behind a prefix that's still sitting in the output FILE's buffer.
+    FILE* input_file = fopen(input_file_path, "rb");
+    FILE* output_file = fopen(output_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+
+    TEST_CHECK(0 == fseek(input_file, 1000, SEEK_SET));
+    TEST_CHECK(sizeof(prefix) == fwrite(prefix, 1, sizeof(prefix), output_file));
+
+    TEST_CHECK(0 == ccrush_compress_file_raw(input_file, output_file, 4, 6, 1, 0));
+
+    // Whatever is written afterwards must end up after the compressed data.
+    TEST_CHECK(sizeof(suffix) == fwrite(suffix, 1, sizeof(suffix), output_file));
+    fclose(output_file);
+
+    size_t compressed_length = 0;
+    uint8_t* compressed = read_test_file(output_file_path, &compressed_length);
+    TEST_ASSERT(compressed != NULL && compressed_length > sizeof(prefix) + sizeof(suffix));
+    TEST_CHECK(0 == memcmp(compressed, prefix, sizeof(prefix)));
+    TEST_CHECK(0 == memcmp(compressed + compressed_length - sizeof(suffix), suffix, sizeof(suffix)));
+
+    input_file = fopen(output_file_path, "rb");
+    output_file = fopen(decompressed_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+
+    // Read the prefix through stdio first, so that (most of) the compressed data is already buffered in the FILE.
+    char read_prefix[sizeof(prefix)];
+    TEST_CHECK(sizeof(prefix) == fread(read_prefix, 1, sizeof(prefix), input_file));
+
+    TEST_CHECK(0 == ccrush_decompress_file_raw(input_file, output_file, 4, 1, 1));
+
+    size_t decompressed_length = 0;
+    uint8_t* decompressed = read_test_file(decompressed_file_path, &decompressed_length);
+    TEST_CHECK(decompressed_length == data_length - 1000);
+    TEST_CHECK(0 == memcmp(decompressed, data + 1000, decompressed_length));
+
+    free(data);
+    free(compressed);
+    free(decompressed);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(decompressed_file_path);
+}
+
+static const char TEST_DICTIONARY[] = "{\"type\":\"event\",\"timestamp\":\"2024-01-01T00:00:00Z\",\"user\":{\"id\":,\"name\":\"\",\"email\":\"@example.com\"},\"tags\":[\"\"],\"payload\":{\"status\":\"ok\",\"message\":\"\"}}";
+
+static const char TEST_DICTIONARY_MESSAGE[] = "{\"type\":\"event\",\"timestamp\":\"2024-03-14T15:09:26Z\",\"user\":{\"id\":1337,\"name\":\"Jane\",\"email\":\"jane@example.com\"},\"tags\":[\"beta\"],\"payload\":{\"status\":\"ok\",\"message\":\"hello\"}}";
+
+static void ccrush_dictionary_functions_invalid_args_fail()
+{
+    const uint8_t* dictionary = (const uint8_t*)TEST_DICTIONARY;
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_with_dictionary((const uint8_t*)TEST_DICTIONARY_MESSAGE, sizeof(TEST_DICTIONARY_MESSAGE), 0, 6, NULL, 16, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_with_dictionary((const uint8_t*)TEST_DICTIONARY_MESSAGE, sizeof(TEST_DICTIONARY_MESSAGE), 0, 6, dictionary, 0, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_with_dictionary((const uint8_t*)TEST_DICTIONARY_MESSAGE, sizeof(TEST_DICTIONARY_MESSAGE), 0, NULL, 16, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_file_with_dictionary("in", "out", 0, 6, dictionary, 0));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_file_with_dictionary("in", "out", 0, NULL, 16));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_set_dictionary(NULL, dictionary, sizeof(TEST_DICTIONARY)));
+    TEST_CHECK(out == NULL);
+}
+
+static void ccrush_compress_with_dictionary_shrinks_small_messages_and_decompression_succeeds()
+{
+    const uint8_t* message = (const uint8_t*)TEST_DICTIONARY_MESSAGE;
+    const uint8_t* dictionary = (const uint8_t*)TEST_DICTIONARY;
+
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+
+    uint8_t* compressed_with_dictionary = NULL;
+    size_t compressed_with_dictionary_length = 0;
+
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress(message, sizeof(TEST_DICTIONARY_MESSAGE), 0, 9, &compressed, &compressed_length));
+    TEST_CHECK(0 == ccrush_compress_with_dictionary(message, sizeof(TEST_DICTIONARY_MESSAGE), 0, 9, dictionary, sizeof(TEST_DICTIONARY), &compressed_with_dictionary, &compressed_with_dictionary_length));
+    TEST_CHECK(compressed_with_dictionary_length < compressed_length);
+
+    TEST_CHECK(0 == ccrush_decompress_with_dictionary(compressed_with_dictionary, compressed_with_dictionary_length, 0, dictionary, sizeof(TEST_DICTIONARY), &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == sizeof(TEST_DICTIONARY_MESSAGE));
+    TEST_CHECK(0 == memcmp(decompressed, message, decompressed_length));
+    free(decompressed);
+    decompressed = NULL;
+
+    // Data that was compressed without a dictionary must still decompress, even when one is passed.
+    TEST_CHECK(0 == ccrush_decompress_with_dictionary(compressed, compressed_length, 0, dictionary, sizeof(TEST_DICTIONARY), &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == sizeof(TEST_DICTIONARY_MESSAGE));
+    free(decompressed);
+    decompressed = NULL;
+
+    TEST_CHECK(CCRUSH_ERROR_DICTIONARY_REQUIRED == ccrush_decompress(compressed_with_dictionary, compressed_with_dictionary_length, 0, &decompressed, &decompressed_length));
+    TEST_CHECK(CCRUSH_ERROR_DICTIONARY_MISMATCH == ccrush_decompress_with_dictionary(compressed_with_dictionary, compressed_with_dictionary_length, 0, message, sizeof(TEST_DICTIONARY_MESSAGE), &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed == NULL);
+
+    free(compressed);
+    free(compressed_with_dictionary);
+}
+
+static void ccrush_file_functions_with_dictionary_succeed()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 256);
+
+    const uint8_t* dictionary = (const uint8_t*)TEST_DICTIONARY;
+
+    TEST_CHECK(0 == ccrush_compress_file_with_dictionary(input_file_path, output_file_path, 0, 6, dictionary, sizeof(TEST_DICTIONARY)));
+    TEST_CHECK(CCRUSH_ERROR_DICTIONARY_REQUIRED == ccrush_decompress_file(output_file_path, decompressed_file_path, 0));
+    TEST_CHECK(0 == ccrush_decompress_file_with_dictionary(output_file_path, decompressed_file_path, 0, dictionary, sizeof(TEST_DICTIONARY)));
+
+    size_t data_length = 0, decompressed_length = 0;
+    uint8_t* data = read_test_file(input_file_path, &data_length);
+    uint8_t* decompressed = read_test_file(decompressed_file_path, &decompressed_length);
+    TEST_CHECK(data != NULL && decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+    free(decompressed);
+
+    FILE* input_file = fopen(input_file_path, "rb");
+    FILE* output_file = fopen(output_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+    TEST_CHECK(0 == ccrush_compress_file_raw_with_dictionary(input_file, output_file, 0, 6, dictionary, sizeof(TEST_DICTIONARY), 1, 1));
+
+    input_file = fopen(output_file_path, "rb");
+    output_file = fopen(decompressed_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+    TEST_CHECK(CCRUSH_ERROR_DICTIONARY_MISMATCH == ccrush_decompress_file_raw_with_dictionary(input_file, output_file, 0, (const uint8_t*)TEST_DICTIONARY_MESSAGE, sizeof(TEST_DICTIONARY_MESSAGE), 1, 1));
+
+    input_file = fopen(output_file_path, "rb");
+    output_file = fopen(decompressed_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+    TEST_CHECK(0 == ccrush_decompress_file_raw_with_dictionary(input_file, output_file, 0, dictionary, sizeof(TEST_DICTIONARY), 1, 1));
+
+    decompressed = read_test_file(decompressed_file_path, &decompressed_length);
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+
+    free(data);
+    free(decompressed);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(decompressed_file_path);
+}
+
+static void ccrush_ctx_set_dictionary_applies_to_all_ctx_functions()
+{
+    ccrush_ctx* ctx = NULL;
+    TEST_ASSERT(0 == ccrush_ctx_new(0, &ctx));
+
+    uint8_t* dictionary = malloc(sizeof(TEST_DICTIONARY));
+    TEST_ASSERT(dictionary != NULL);
+    memcpy(dictionary, TEST_DICTIONARY, sizeof(TEST_DICTIONARY));
+
+    TEST_CHECK(0 == ccrush_ctx_set_dictionary(ctx, dictionary, sizeof(TEST_DICTIONARY)));
+
+    // The context keeps its own copy.
+    memset(dictionary, 0x00, sizeof(TEST_DICTIONARY));
+    free(dictionary);
+
+    const uint8_t* message = (const uint8_t*)TEST_DICTIONARY_MESSAGE;
+
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+    TEST_CHECK(0 == ccrush_ctx_compress(ctx, message, sizeof(TEST_DICTIONARY_MESSAGE), 9, &compressed, &compressed_length));
+
+    uint8_t decompressed[sizeof(TEST_DICTIONARY_MESSAGE)];
+    size_t decompressed_length = 0;
+    TEST_CHECK(0 == ccrush_ctx_decompress_into(ctx, compressed, compressed_length, decompressed, sizeof(decompressed), &decompressed_length));
+    TEST_CHECK(decompressed_length == sizeof(TEST_DICTIONARY_MESSAGE));
+    TEST_CHECK(0 == memcmp(decompressed, message, decompressed_length));
+
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    TEST_CHECK(0 == ccrush_decompress_with_dictionary(compressed, compressed_length, 0, (const uint8_t*)TEST_DICTIONARY, sizeof(TEST_DICTIONARY), &out, &out_length));
+    TEST_CHECK(out_length == sizeof(TEST_DICTIONARY_MESSAGE));
+    free(out);
+    out = NULL;
+
+    // Clearing the dictionary again makes the context behave like a fresh one.
+    TEST_CHECK(0 == ccrush_ctx_set_dictionary(ctx, NULL, 0));
+    TEST_CHECK(CCRUSH_ERROR_DICTIONARY_REQUIRED == ccrush_ctx_decompress(ctx, compressed, compressed_length, &out, &out_length));
+    TEST_CHECK(out == NULL);
+
+    free(compressed);
+    ccrush_ctx_free(ctx);
+}
+
+static void ccrush_train_dictionary_invalid_args_fail()
+{
+    const uint8_t* samples[] = { (const uint8_t*)TEST_DICTIONARY_MESSAGE, NULL };
+    size_t sample_lengths[] = { sizeof(TEST_DICTIONARY_MESSAGE), 16 };
+
+    uint8_t dictionary[1024];
+    size_t dictionary_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(NULL, sample_lengths, 1, dictionary, sizeof(dictionary), &dictionary_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, NULL, 1, dictionary, sizeof(dictionary), &dictionary_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, sample_lengths, 0, dictionary, sizeof(dictionary), &dictionary_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, sample_lengths, 1, NULL, sizeof(dictionary), &dictionary_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, sample_lengths, 1, dictionary, 0, &dictionary_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, sample_lengths, 1, dictionary, sizeof(dictionary), NULL));
+
+    // A NULL sample that claims to have a length.
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, sample_lengths, 2, dictionary, sizeof(dictionary), &dictionary_length));
+
+    // Not even a single d-mer to count.
+    sample_lengths[0] = 3;
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_train_dictionary(samples, sample_lengths, 1, dictionary, sizeof(dictionary), &dictionary_length));
+
+    TEST_CHECK(dictionary_length == 0);
+}
+
+static void ccrush_train_dictionary_produces_a_dictionary_that_shrinks_similar_messages()
+{
+    static const char* names[] = { "alice", "bob", "carol", "dave", "erin", "frank" };
+    static const char* statuses[] = { "ok", "error", "pending", "retry" };
+
+    const size_t sample_count = 500;
+    uint8_t** samples = malloc(sample_count * sizeof(uint8_t*));
+    size_t* sample_lengths = malloc(sample_count * sizeof(size_t));
+    TEST_ASSERT(samples != NULL && sample_lengths != NULL);
+
+    char message[512];
+
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+        const int length = snprintf(message, sizeof(message), "{\"type\":\"event\",\"timestamp\":\"2024-%02d-%02dT%02d:%02d:00Z\",\"user\":{\"id\":%d,\"name\":\"%s\",\"email\":\"%s@example.com\"},\"payload\":{\"status\":\"%s\",\"latency_ms\":%d}}", (int)(i % 12) + 1, (int)(i % 28) + 1, (int)(i % 24), (int)(i * 7 % 60), (int)(i * 7919 % 100000), names[i % 6], names[(i / 6) % 6], statuses[i % 4], (int)(i * 31 % 5000));
+
+        sample_lengths[i] = (size_t)length;
+        samples[i] = malloc(sample_lengths[i]);
+        TEST_ASSERT(samples[i] != NULL);
+        memcpy(samples[i], message, sample_lengths[i]);
+    }
+
+    uint8_t dictionary[CCRUSH_MAX_DICTIONARY_SIZE * 2];
+    size_t dictionary_length = 0;
+
+    TEST_CHECK(0 == ccrush_train_dictionary((const uint8_t* const*)samples, sample_lengths, sample_count, dictionary, sizeof(dictionary), &dictionary_length));
+    TEST_CHECK(dictionary_length > 0 && dictionary_length <= CCRUSH_MAX_DICTIONARY_SIZE);
+
+    // A message that's not part of the training set.
+    const int message_length = snprintf(message, sizeof(message), "{\"type\":\"event\",\"timestamp\":\"2025-06-30T23:59:00Z\",\"user\":{\"id\":4242,\"name\":\"frank\",\"email\":\"erin@example.com\"},\"payload\":{\"status\":\"retry\",\"latency_ms\":777}}");
+
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+
+    uint8_t* compressed_with_dictionary = NULL;
+    size_t compressed_with_dictionary_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress((const uint8_t*)message, (size_t)message_length, 0, 9, &compressed, &compressed_length));
+    TEST_CHECK(0 == ccrush_compress_with_dictionary((const uint8_t*)message, (size_t)message_length, 0, 9, dictionary, dictionary_length, &compressed_with_dictionary, &compressed_with_dictionary_length));
+    TEST_CHECK(compressed_with_dictionary_length * 2 < compressed_length);
+
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_decompress_with_dictionary(compressed_with_dictionary, compressed_with_dictionary_length, 0, dictionary, dictionary_length, &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == (size_t)message_length);
+    TEST_CHECK(0 == memcmp(decompressed, message, decompressed_length));
+
+    // A smaller capacity must be respected.
+    TEST_CHECK(0 == ccrush_train_dictionary((const uint8_t* const*)samples, sample_lengths, sample_count, dictionary, 100, &dictionary_length));
+    TEST_CHECK(dictionary_length > 0 && dictionary_length <= 100);
+
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+        free(samples[i]);
+    }
+
+    free(samples);
+    free(sample_lengths);
+    free(compressed);
+    free(compressed_with_dictionary);
+    free(decompressed);
+}
+
+static void ccrush_batch_functions_invalid_args_fail()
+{
+    const uint8_t* inputs[] = { (const uint8_t*)text, NULL };
+    size_t input_lengths[] = { text_length, 0 };
+
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    size_t out_offsets[3];
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(NULL, input_lengths, 1, 6, 0, &out, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(inputs, NULL, 1, 6, 0, &out, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(inputs, input_lengths, 0, 6, 0, &out, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(inputs, input_lengths, 1, 6, 0, NULL, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(inputs, input_lengths, 1, 6, 0, &out, NULL, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(inputs, input_lengths, 1, 6, 0, &out, &out_length, NULL));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_batch(inputs, input_lengths, 2, 6, 0, &out, &out_length, out_offsets));
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_batch(NULL, input_lengths, 1, 0, 0, &out, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_batch(inputs, input_lengths, 0, 0, 0, &out, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_batch(inputs, input_lengths, 2, 0, 0, &out, &out_length, out_offsets));
+    TEST_CHECK(CCRUSH_ERROR_BUFFERSIZE_TOO_LARGE == ccrush_decompress_batch(inputs, input_lengths, 1, CCRUSH_MAX_BUFFER_SIZE_KiB + 1, 0, &out, &out_length, out_offsets));
+
+    TEST_CHECK(out == NULL);
+}
+
+static void ccrush_compress_batch_and_decompress_batch_succeed()
+{
+    const size_t count = 3000;
+
+    const uint8_t** inputs = malloc(count * sizeof(uint8_t*));
+    size_t* input_lengths = malloc(count * sizeof(size_t));
+    size_t* compressed_offsets = malloc((count + 1) * sizeof(size_t));
+    size_t* decompressed_offsets = malloc((count + 1) * sizeof(size_t));
+    const uint8_t** compressed_records = malloc(count * sizeof(uint8_t*));
+    size_t* compressed_record_lengths = malloc(count * sizeof(size_t));
+
+    TEST_ASSERT(inputs != NULL && input_lengths != NULL && compressed_offsets != NULL && decompressed_offsets != NULL && compressed_records != NULL && compressed_record_lengths != NULL);
+
+    // Records of all sorts of lengths, pointing into the test text (and occasionally into random data).
+    uint8_t random_data[4096];
+
+    for (size_t i = 0; i < sizeof(random_data); ++i)
+    {
+        random_data[i] = (uint8_t)((i * 2654435761u) >> 13);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        input_lengths[i] = 1 + (i * 7919) % (text_length / 2);
+        inputs[i] = i % 10 == 0 ? random_data + (i % 64) : (const uint8_t*)text + (i % (text_length / 2));
+    }
+
+    for (uint32_t thread_count = 1; thread_count <= 4; thread_count += 3)
+    {
+        uint8_t* compressed = NULL;
+        size_t compressed_length = 0;
+
+        TEST_CHECK(0 == ccrush_compress_batch(inputs, input_lengths, count, 6, thread_count, &compressed, &compressed_length, compressed_offsets));
+        TEST_CHECK(compressed_offsets[0] == 0 && compressed_offsets[count] == compressed_length);
+
+        // Every record must be exactly what ccrush_compress() produces for it.
+        for (size_t i = 0; i < count; i += 97)
+        {
+            uint8_t* single = NULL;
+            size_t single_length = 0;
+
+            TEST_CHECK(0 == ccrush_compress(inputs[i], input_lengths[i], 0, 6, &single, &single_length));
+            TEST_CHECK(single_length == compressed_offsets[i + 1] - compressed_offsets[i]);
+            TEST_CHECK(0 == memcmp(single, compressed + compressed_offsets[i], single_length));
+
+            free(single);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            compressed_records[i] = compressed + compressed_offsets[i];
+            compressed_record_lengths[i] = compressed_offsets[i + 1] - compressed_offsets[i];
+        }
+
+        uint8_t* decompressed = NULL;
+        size_t decompressed_length = 0;
+
+        TEST_CHECK(0 == ccrush_decompress_batch(compressed_records, compressed_record_lengths, count, 0, thread_count, &decompressed, &decompressed_length, decompressed_offsets));
+        TEST_CHECK(decompressed_offsets[count] == decompressed_length);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            TEST_CHECK(decompressed_offsets[i + 1] - decompressed_offsets[i] == input_lengths[i]);
+            TEST_CHECK(0 == memcmp(decompressed + decompressed_offsets[i], inputs[i], input_lengths[i]));
+        }
+
+        free(decompressed);
+        decompressed = NULL;
+
+        // A single broken record fails the whole batch (and leaves the output untouched).
+        uint8_t broken[] = { 0x78, 0x9C, 0xFF, 0xFF, 0xFF, 0xFF };
+        compressed_records[count / 2] = broken;
+        compressed_record_lengths[count / 2] = sizeof(broken);
+
+        TEST_CHECK(0 != ccrush_decompress_batch(compressed_records, compressed_record_lengths, count, 0, thread_count, &decompressed, &decompressed_length, decompressed_offsets));
+        TEST_CHECK(decompressed == NULL);
+
+        free(compressed);
+    }
+
+    free(inputs);
+    free(input_lengths);
+    free(compressed_offsets);
+    free(decompressed_offsets);
+    free(compressed_records);
+    free(compressed_record_lengths);
+}
+
+static void ccrush_ctx_stats_record_each_call()
+{
+    ccrush_stats stats;
+    memset(&stats, 0xAB, sizeof(stats));
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_set_stats(NULL, &stats));
+
+    ccrush_ctx* ctx = NULL;
+    TEST_ASSERT(0 == ccrush_ctx_new(0, &ctx));
+    TEST_CHECK(0 == ccrush_ctx_set_stats(ctx, &stats));
+
+    // Highly compressible, so that decompressing it outgrows the initial output buffer.
+    const size_t data_length = 1024 * 1024;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+    memset(data, 'a', data_length);
+
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_ctx_compress(ctx, data, data_length, 6, &compressed, &compressed_length));
+    TEST_CHECK(stats.bytes_in == data_length);
+    TEST_CHECK(stats.bytes_out == compressed_length);
+    TEST_CHECK(stats.codec_calls >= 1);
+    TEST_CHECK(stats.codec_ns > 0);
+    TEST_CHECK(stats.io_ns == 0);
+    TEST_CHECK(stats.buffer_growths == 0);
+    TEST_CHECK(stats.peak_buffer_bytes >= compressed_length);
+
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_ctx_decompress(ctx, compressed, compressed_length, &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(stats.bytes_in == compressed_length);
+    TEST_CHECK(stats.bytes_out == data_length);
+    TEST_CHECK(stats.codec_calls >= 1);
+    TEST_CHECK(stats.buffer_growths > 0);
+    TEST_CHECK(stats.peak_buffer_bytes >= data_length);
+
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 256);
+
+    size_t file_length = 0;
+    uint8_t* file_data = read_test_file(input_file_path, &file_length);
+    TEST_ASSERT(file_data != NULL);
+
+    FILE* input_file = fopen(input_file_path, "rb");
+    FILE* output_file = fopen(output_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+    TEST_CHECK(0 == ccrush_ctx_compress_file_raw(ctx, input_file, output_file, 6, 1, 1));
+    TEST_CHECK(stats.bytes_in == file_length);
+    TEST_CHECK(stats.bytes_out > 0 && stats.bytes_out < file_length);
+    TEST_CHECK(stats.codec_calls >= 1);
+    TEST_CHECK(stats.io_ns > 0);
+
+    // Disabled stats must stay untouched.
+    memset(&stats, 0xAB, sizeof(stats));
+    const ccrush_stats untouched = stats;
+
+    TEST_CHECK(0 == ccrush_ctx_set_stats(ctx, NULL));
+    ccrush_free(decompressed);
+    decompressed = NULL;
+    TEST_CHECK(0 == ccrush_ctx_decompress(ctx, compressed, compressed_length, &decompressed, &decompressed_length));
+    TEST_CHECK(0 == memcmp(&stats, &untouched, sizeof(stats)));
+
+    ccrush_ctx_free(ctx);
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+    free(data);
+    free(file_data);
+
+    remove(input_file_path);
+    remove(output_file_path);
+}
+
+static void ccrush_set_thread_stats_records_plain_calls()
+{
+    ccrush_stats stats;
+    memset(&stats, 0xAB, sizeof(stats));
+
+    ccrush_set_thread_stats(&stats);
+
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_compress((const uint8_t*)text, text_length, 0, 6, &compressed, &compressed_length));
+    TEST_CHECK(stats.bytes_in == text_length);
+    TEST_CHECK(stats.bytes_out == compressed_length);
+    TEST_CHECK(stats.codec_calls >= 1);
+
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+
+    TEST_CHECK(0 == ccrush_decompress(compressed, compressed_length, 0, &decompressed, &decompressed_length));
+    TEST_CHECK(stats.bytes_in == compressed_length);
+    TEST_CHECK(stats.bytes_out == text_length);
+    TEST_CHECK(stats.peak_buffer_bytes >= text_length);
+
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 256);
+
+    TEST_CHECK(0 == ccrush_compress_file(input_file_path, output_file_path, 0, 6));
+    TEST_CHECK(stats.bytes_in > 0 && stats.bytes_out > 0 && stats.bytes_out < stats.bytes_in);
+    TEST_CHECK(stats.codec_calls >= 1);
+
+    ccrush_set_thread_stats(NULL);
+
+    memset(&stats, 0xAB, sizeof(stats));
+    const ccrush_stats untouched = stats;
+
+    ccrush_free(compressed);
+    compressed = NULL;
+    TEST_CHECK(0 == ccrush_compress((const uint8_t*)text, text_length, 0, 6, &compressed, &compressed_length));
+    TEST_CHECK(0 == memcmp(&stats, &untouched, sizeof(stats)));
+
+    ccrush_free(compressed);
+    ccrush_free(decompressed);
+
+    remove(input_file_path);
+    remove(output_file_path);
+}
+
+static void ccrush_params_functions_invalid_args_fail()
+{
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_ex((uint8_t*)text, text_length, 0, NULL, &out, &out_length));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_ex((uint8_t*)text, text_length, 0, NULL, &out, &out_length));
+
+    params.strategy = CCRUSH_STRATEGY_FIXED + 1;
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_ex((uint8_t*)text, text_length, 0, &params, &out, &out_length));
+
+    params.strategy = CCRUSH_STRATEGY_DEFAULT;
+    params.window_bits = 8;
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_ex((uint8_t*)text, text_length, 0, &params, &out, &out_length));
+
+    params.window_bits = 16;
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_compress_file_ex("in", "out", 0, &params));
+
+    params.window_bits = 0;
+    params.mem_level = 10;
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_decompress_file_ex("in", "out", 0, &params));
+
+    params.mem_level = 0;
+    params.header = CCRUSH_HEADER_RAW + 1;
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_set_params(NULL, NULL));
+    TEST_CHECK(out == NULL);
+
+    ccrush_ctx* ctx = NULL;
+    TEST_ASSERT(0 == ccrush_ctx_new(0, &ctx));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_set_params(ctx, &params));
+    TEST_CHECK(0 == ccrush_ctx_set_params(ctx, NULL));
+    ccrush_ctx_free(ctx);
+
+    ccrush_stream* stream = NULL;
+    struct stream_sink sink = { 0 };
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_init_ex(&stream, CCRUSH_STREAM_MODE_COMPRESS, &params, 0, &stream_sink_write, &sink));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_stream_init_ex(&stream, CCRUSH_STREAM_MODE_COMPRESS, NULL, 0, &stream_sink_write, &sink));
+    TEST_CHECK(stream == NULL);
+}
+
+static void ccrush_compress_ex_all_strategies_and_headers_roundtrip()
+{
+    const size_t data_length = 512 * 1024 + 3;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    // Runs (bitmap-like), text and noise.
+    uint32_t x = 1337;
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        data[i] = (i / 4096) % 3 == 0 ? (uint8_t)((i / 100) & 1 ? 0xFF : 0x00) : (i / 4096) % 3 == 1 ? (uint8_t)text[i % text_length] : (uint8_t)(x >> 16);
+    }
+
+    const int headers[] = { CCRUSH_HEADER_ZLIB, CCRUSH_HEADER_GZIP, CCRUSH_HEADER_RAW };
+
+    for (int strategy = CCRUSH_STRATEGY_DEFAULT; strategy <= CCRUSH_STRATEGY_FIXED; ++strategy)
+    {
+        for (size_t h = 0; h < sizeof(headers) / sizeof(headers[0]); ++h)
+        {
+            ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+            params.strategy = strategy;
+            params.header = headers[h];
+
+            // Also the smallest window and memory level, every other time.
+            if ((strategy + h) % 2)
+            {
+                params.window_bits = 9;
+                params.mem_level = 1;
+            }
+
+            uint8_t* compressed = NULL;
+            size_t compressed_length = 0;
+
+            TEST_CHECK(0 == ccrush_compress_ex(data, data_length, 0, &params, &compressed, &compressed_length));
+            TEST_CHECK(compressed_length <= ccrush_compress_bound_ex(data_length, &params));
+
+            if (params.header == CCRUSH_HEADER_GZIP)
+            {
+                TEST_CHECK(compressed[0] == 0x1F && compressed[1] == 0x8B);
+            }
+
+            uint8_t* decompressed = NULL;
+            size_t decompressed_length = 0;
+
+            TEST_CHECK(0 == ccrush_decompress_ex(compressed, compressed_length, 0, &params, &decompressed, &decompressed_length));
+            TEST_CHECK(decompressed_length == data_length);
+            TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+            free(decompressed);
+            decompressed = NULL;
+
+            // Zero-window-bits means "the default window", which is big enough for any stream.
+            params.window_bits = 0;
+
+            uint8_t* into = malloc(data_length);
+            TEST_ASSERT(into != NULL);
+            TEST_CHECK(0 == ccrush_decompress_into_ex(compressed, compressed_length, &params, into, data_length, &decompressed_length));
+            TEST_CHECK(decompressed_length == data_length);
+            TEST_CHECK(0 == memcmp(into, data, data_length));
+            free(into);
+
+            if (params.header != CCRUSH_HEADER_ZLIB)
+            {
+                TEST_CHECK(0 != ccrush_decompress(compressed, compressed_length, 0, &decompressed, &decompressed_length));
+                TEST_CHECK(decompressed == NULL);
+            }
+
+            free(compressed);
+        }
+    }
+
+    free(data);
+}
+
+static void ccrush_compress_into_ex_fits_the_bound_on_random_data()
+{
+    const size_t data_length = 300 * 1024 + 11;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    uint32_t x = 42;
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        data[i] = (uint8_t)(x >> 16);
+    }
+
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.level = 1;
+    params.window_bits = 9;
+    params.mem_level = 1;
+    params.strategy = CCRUSH_STRATEGY_FIXED;
+    params.header = CCRUSH_HEADER_GZIP;
+
+    const size_t bound = ccrush_compress_bound_ex(data_length, &params);
+    TEST_CHECK(bound > ccrush_compress_bound(data_length));
+
+    uint8_t* out = malloc(bound);
+    TEST_ASSERT(out != NULL);
+
+    size_t out_written = 0;
+    TEST_CHECK(0 == ccrush_compress_into_ex(data, data_length, &params, out, bound, &out_written));
+    TEST_CHECK(out_written > data_length);
+    TEST_CHECK(CCRUSH_ERROR_OUTPUT_BUFFER_TOO_SMALL == ccrush_compress_into_ex(data, data_length, &params, out, data_length, &out_written));
+
+    free(out);
+    free(data);
+}
+
+static void ccrush_file_and_stream_functions_ex_roundtrip_gzip()
+{
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char decompressed_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(decompressed_file_path, "%s", tmpnam(NULL));
+
+    write_test_file(input_file_path, 512);
+
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.header = CCRUSH_HEADER_GZIP;
+    params.strategy = CCRUSH_STRATEGY_RLE;
+
+    TEST_CHECK(0 == ccrush_compress_file_ex(input_file_path, output_file_path, 0, &params));
+    TEST_CHECK(0 != ccrush_decompress_file(output_file_path, decompressed_file_path, 0));
+    TEST_CHECK(0 == ccrush_decompress_file_ex(output_file_path, decompressed_file_path, 0, &params));
+
+    size_t data_length = 0, decompressed_length = 0, compressed_length = 0;
+    uint8_t* data = read_test_file(input_file_path, &data_length);
+    uint8_t* decompressed = read_test_file(decompressed_file_path, &decompressed_length);
+    TEST_CHECK(data != NULL && decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+    free(decompressed);
+
+    FILE* input_file = fopen(input_file_path, "rb");
+    FILE* output_file = fopen(output_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+    TEST_CHECK(0 == ccrush_compress_file_raw_ex(input_file, output_file, 0, &params, 1, 1));
+
+    uint8_t* compressed = read_test_file(output_file_path, &compressed_length);
+    TEST_CHECK(compressed != NULL && compressed[0] == 0x1F && compressed[1] == 0x8B);
+
+    input_file = fopen(output_file_path, "rb");
+    output_file = fopen(decompressed_file_path, "wb");
+    TEST_ASSERT(input_file != NULL && output_file != NULL);
+    TEST_CHECK(0 == ccrush_decompress_file_raw_ex(input_file, output_file, 0, &params, 1, 1));
+
+    decompressed = read_test_file(decompressed_file_path, &decompressed_length);
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+    free(decompressed);
+
+    // A gzip stream from ccrush_stream_init_ex() decompresses like any other, and the other way around.
+    ccrush_stream* stream = NULL;
+    struct stream_sink streamed = { 0 };
+
+    TEST_CHECK(0 == ccrush_stream_init_ex(&stream, CCRUSH_STREAM_MODE_DECOMPRESS, &params, 0, &stream_sink_write, &streamed));
+    TEST_CHECK(0 == ccrush_stream_update(stream, compressed, compressed_length));
+    TEST_CHECK(0 == ccrush_stream_finish(stream));
+    ccrush_stream_free(stream);
+
+    TEST_CHECK(streamed.length == data_length);
+    TEST_CHECK(0 == memcmp(streamed.data, data, data_length));
+    streamed.length = 0;
+
+    TEST_CHECK(0 == ccrush_stream_init_ex(&stream, CCRUSH_STREAM_MODE_COMPRESS, &params, 0, &stream_sink_write, &streamed));
+    TEST_CHECK(0 == ccrush_stream_update(stream, data, data_length));
+    TEST_CHECK(0 == ccrush_stream_finish(stream));
+    ccrush_stream_free(stream);
+
+    TEST_CHECK(0 == ccrush_decompress_ex(streamed.data, streamed.length, 0, &params, &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+
+    free(data);
+    free(compressed);
+    free(decompressed);
+    free(streamed.data);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(decompressed_file_path);
+}
+
+static void ccrush_ctx_set_params_applies_to_all_ctx_functions()
+{
+    ccrush_ctx* ctx = NULL;
+    TEST_ASSERT(0 == ccrush_ctx_new(0, &ctx));
+
+    ccrush_params params = CCRUSH_PARAMS_DEFAULT;
+    params.header = CCRUSH_HEADER_RAW;
+    params.window_bits = 12;
+    params.mem_level = 4;
+
+    TEST_CHECK(0 == ccrush_ctx_set_params(ctx, &params));
+
+    // With a preset dictionary, too: raw deflate has no header to ask for it, so both sides need to know.
+    TEST_CHECK(0 == ccrush_ctx_set_dictionary(ctx, (const uint8_t*)TEST_DICTIONARY, sizeof(TEST_DICTIONARY)));
+
+    const uint8_t* message = (const uint8_t*)TEST_DICTIONARY_MESSAGE;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        uint8_t* compressed = NULL;
+        size_t compressed_length = 0;
+        TEST_CHECK(0 == ccrush_ctx_compress(ctx, message, sizeof(TEST_DICTIONARY_MESSAGE), 9, &compressed, &compressed_length));
+
+        uint8_t decompressed[sizeof(TEST_DICTIONARY_MESSAGE)];
+        size_t decompressed_length = 0;
+        TEST_CHECK(0 == ccrush_ctx_decompress_into(ctx, compressed, compressed_length, decompressed, sizeof(decompressed), &decompressed_length));
+        TEST_CHECK(decompressed_length == sizeof(TEST_DICTIONARY_MESSAGE));
+        TEST_CHECK(0 == memcmp(decompressed, message, decompressed_length));
+
+        free(compressed);
+    }
+
+    // Back to the defaults: a plain zlib stream again.
+    TEST_CHECK(0 == ccrush_ctx_set_params(ctx, NULL));
+    TEST_CHECK(0 == ccrush_ctx_set_dictionary(ctx, NULL, 0));
+
+    uint8_t* compressed = NULL;
+    size_t compressed_length = 0;
+    TEST_CHECK(0 == ccrush_ctx_compress(ctx, (uint8_t*)text, text_length, 6, &compressed, &compressed_length));
+
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    TEST_CHECK(0 == ccrush_decompress(compressed, compressed_length, 0, &out, &out_length));
+    TEST_CHECK(out_length == text_length);
+    TEST_CHECK(0 == memcmp(out, text, text_length));
+
+    free(out);
+    free(compressed);
+    ccrush_ctx_free(ctx);
+}
+
+static void ccrush_adaptive_compression_stores_incompressible_blocks_only()
+{
+    // Text, then noise (think of a JPEG inside a tarball), then text again.
+    const size_t part_length = 1024 * 1024;
+    const size_t data_length = part_length * 3;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    uint32_t x = 7;
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        data[i] = i / part_length == 1 ? (uint8_t)(x >> 16) : (uint8_t)text[i % text_length];
+    }
+
+    char input_file_path[256] = { 0x00 };
+    char output_file_path[256] = { 0x00 };
+    char adaptive_output_file_path[256] = { 0x00 };
+
+    sprintf(input_file_path, "%s", tmpnam(NULL));
+    sprintf(output_file_path, "%s", tmpnam(NULL));
+    sprintf(adaptive_output_file_path, "%s", tmpnam(NULL));
+
+    FILE* input_file = fopen(input_file_path, "wb");
+    TEST_ASSERT(input_file != NULL);
+    TEST_CHECK(data_length == fwrite(data, 1, data_length, input_file));
+    fclose(input_file);
+
+    ccrush_ctx* ctx = NULL;
+    TEST_ASSERT(0 == ccrush_ctx_new(64, &ctx));
+
+    ccrush_stats stats;
+    TEST_CHECK(0 == ccrush_ctx_set_stats(ctx, &stats));
+
+    TEST_CHECK(0 == ccrush_ctx_compress_file(ctx, input_file_path, output_file_path, 6));
+    TEST_CHECK(stats.bypassed_bytes == 0);
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_ctx_set_adaptive_compression(NULL, 1));
+    TEST_CHECK(0 == ccrush_ctx_set_adaptive_compression(ctx, 1));
+
+    TEST_CHECK(0 == ccrush_ctx_compress_file(ctx, input_file_path, adaptive_output_file_path, 6));
+
+    // Exactly the noise was stored, since it's aligned to the 64 KiB blocks.
+    TEST_CHECK(stats.bypassed_bytes == part_length);
+    TEST_MSG("Bypassed: %llu", (unsigned long long)stats.bypassed_bytes);
+
+    size_t compressed_length = 0, adaptive_compressed_length = 0;
+    uint8_t* compressed = read_test_file(output_file_path, &compressed_length);
+    uint8_t* adaptive_compressed = read_test_file(adaptive_output_file_path, &adaptive_compressed_length);
+    TEST_ASSERT(compressed != NULL && adaptive_compressed != NULL);
+
+    // Storing the noise costs at most a few bytes per block; the text is compressed just as well as before.
+    TEST_CHECK(adaptive_compressed_length < compressed_length + 1024);
+    TEST_CHECK(adaptive_compressed_length < part_length + part_length / 4);
+
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+    TEST_CHECK(0 == ccrush_decompress(adaptive_compressed, adaptive_compressed_length, 0, &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+    free(decompressed);
+
+    // The same goes for in-memory compression.
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    TEST_CHECK(0 == ccrush_ctx_compress(ctx, data, data_length, 6, &out, &out_length));
+    TEST_CHECK(stats.bypassed_bytes >= part_length && stats.bypassed_bytes < part_length + 256 * 1024);
+    TEST_CHECK(out_length < adaptive_compressed_length + 1024);
+
+    TEST_CHECK(0 == ccrush_decompress(out, out_length, 0, &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+
+    free(out);
+    free(decompressed);
+    free(compressed);
+    free(adaptive_compressed);
+    free(data);
+    ccrush_ctx_free(ctx);
+
+    remove(input_file_path);
+    remove(output_file_path);
+    remove(adaptive_output_file_path);
+}
+
+static void ccrush_set_adaptive_compression_applies_to_plain_calls()
+{
+    const size_t data_length = 512 * 1024;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    uint32_t x = 99;
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        data[i] = (uint8_t)(x >> 16);
+    }
+
+    TEST_CHECK(0 == ccrush_get_adaptive_compression());
+    ccrush_set_adaptive_compression(1337);
+    TEST_CHECK(1 == ccrush_get_adaptive_compression());
+
+    ccrush_stats stats;
+    ccrush_set_thread_stats(&stats);
+
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    TEST_CHECK(0 == ccrush_compress(data, data_length, 0, 9, &out, &out_length));
+    TEST_CHECK(stats.bypassed_bytes == data_length);
+    TEST_CHECK(out_length <= ccrush_compress_bound(data_length));
+
+    uint8_t* decompressed = NULL;
+    size_t decompressed_length = 0;
+    TEST_CHECK(0 == ccrush_decompress(out, out_length, 0, &decompressed, &decompressed_length));
+    TEST_CHECK(decompressed_length == data_length);
+    TEST_CHECK(0 == memcmp(decompressed, data, data_length));
+    free(decompressed);
+    free(out);
+
+    // Compressible data is left alone.
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        data[i] = (uint8_t)text[i % text_length];
+    }
+
+    TEST_CHECK(0 == ccrush_compress(data, data_length, 0, 9, &out, &out_length));
+    TEST_CHECK(stats.bypassed_bytes == 0);
+    TEST_CHECK(out_length < data_length / 100);
+    free(out);
+
+    ccrush_set_thread_stats(NULL);
+    ccrush_set_adaptive_compression(0);
+    TEST_CHECK(0 == ccrush_get_adaptive_compression());
+
+    free(data);
+}
+
+static void ccrush_estimate_ratio_invalid_args_fail_and_small_inputs_are_estimated()
+{
+    size_t estimated_length = 0, margin = 1337;
+
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_estimate_ratio(NULL, text_length, 6, &estimated_length, &margin));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_estimate_ratio((const uint8_t*)text, 0, 6, &estimated_length, &margin));
+    TEST_CHECK(CCRUSH_ERROR_INVALID_ARGS == ccrush_estimate_ratio((const uint8_t*)text, text_length, 6, NULL, &margin));
+
+    uint8_t* out = NULL;
+    size_t out_length = 0;
+    TEST_CHECK(0 == ccrush_compress((const uint8_t*)text, text_length, 0, 6, &out, &out_length));
+
+    TEST_CHECK(0 == ccrush_estimate_ratio((const uint8_t*)text, text_length, 6, &estimated_length, &margin));
+    TEST_CHECK(margin > 0);
+    TEST_CHECK((estimated_length > out_length ? estimated_length - out_length : out_length - estimated_length) <= margin);
+    TEST_MSG("Estimated %zu ± %zu bytes, but it's really %zu bytes.", estimated_length, margin, out_length);
+
+    size_t estimated_length_without_margin = 0;
+    TEST_CHECK(0 == ccrush_estimate_ratio((const uint8_t*)text, text_length, 6, &estimated_length_without_margin, NULL));
+    TEST_CHECK(estimated_length_without_margin == estimated_length);
+
+    free(out);
+}
+
+static void ccrush_estimate_ratio_cost_stays_bounded_across_the_sampling_threshold()
+{
+    const size_t data_length = 1024 * 1024;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    for (size_t i = 0; i < data_length; ++i)
+    {
+        data[i] = (uint8_t)text[i % text_length];
+    }
+
+    // Whatever the input length (small ones get the entropy pass, bigger ones get sampled), no more than a small fraction of it ever goes through deflate.
+    for (size_t length = 1024; length <= data_length; length += length < 1024 * 256 ? 1024 * 4 - 1 : length / 2)
+    {
+        ccrush_stats stats;
+        memset(&stats, 0x00, sizeof(ccrush_stats));
+        ccrush_set_thread_stats(&stats);
+
+        size_t estimated_length = 0, margin = 0;
+        TEST_CHECK(0 == ccrush_estimate_ratio(data, length, 6, &estimated_length, &margin));
+
+        ccrush_set_thread_stats(NULL);
+
+        TEST_CHECK(stats.bytes_in <= length / 32);
+        TEST_CHECK(length < 1024 * 256 || stats.bytes_in > 0);
+        TEST_MSG("Estimating %zu bytes compressed %llu of them.", length, (unsigned long long)stats.bytes_in);
+        TEST_CHECK(margin < length);
+    }
+
+    free(data);
+}
+
+static void ccrush_estimate_ratio_is_within_margin_on_large_inputs()
+{
+    static const char* words[] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "the ", "lazy ", "dog, ", "lorem ", "ipsum ", "dolor ", "sit ", "amet.\n", "{ \"id\": ", "\"name\": " };
+
+    const size_t data_length = 4 * 1024 * 1024;
+    uint8_t* data = malloc(data_length);
+    TEST_ASSERT(data != NULL);
+
+    for (int noise = 0; noise <= 1; ++noise)
+    {
+        uint32_t x = 7;
+        for (size_t i = 0; i < data_length;)
+        {
+            x = x * 1103515245 + 12345;
+
+            if (noise)
+            {
+                data[i++] = (uint8_t)(x >> 16);
+                continue;
+            }
+
+            for (const char* word = words[(x >> 16) % 16]; *word != '\0' && i < data_length; ++word)
+            {
+                data[i++] = (uint8_t)*word;
+            }
+        }
+
+        for (int level = 1; level <= 9; level += 4)
+        {
+            uint8_t* out = NULL;
+            size_t out_length = 0;
+            TEST_CHECK(0 == ccrush_compress(data, data_length, 0, level, &out, &out_length));
+            free(out);
+
+            size_t estimated_length = 0, margin = 0;
+            TEST_CHECK(0 == ccrush_estimate_ratio(data, data_length, level, &estimated_length, &margin));
+
+            const size_t difference = estimated_length > out_length ? estimated_length - out_length : out_length - estimated_length;
+            TEST_CHECK(difference <= margin);
+            TEST_MSG("Level %d: estimated %zu ± %zu bytes, but it's really %zu bytes.", level, estimated_length, margin, out_length);
+
+            TEST_CHECK(margin < data_length / 5);
+            TEST_CHECK(noise ? estimated_length > data_length : estimated_length < data_length / 3);
+        }
+
+        // Out of range levels mean 6, no matter whether the input is sampled or not.
+        size_t estimated_length = 0, margin = 0, default_estimated_length = 0, default_margin = 0;
+        TEST_CHECK(0 == ccrush_estimate_ratio(data, data_length, 11, &estimated_length, &margin));
+        TEST_CHECK(0 == ccrush_estimate_ratio(data, data_length, 6, &default_estimated_length, &default_margin));
+        TEST_CHECK(estimated_length == default_estimated_length);
+        TEST_CHECK(margin == default_margin);
+        TEST_CHECK(0 == ccrush_estimate_ratio(data, 4096, -1, &estimated_length, &margin));
+        TEST_CHECK(0 == ccrush_estimate_ratio(data, 4096, 6, &default_estimated_length, &default_margin));
+        TEST_CHECK(estimated_length == default_estimated_length);
+    }
+
+    free(data);
+}
+
 // --------------------------------------------------------------------------------------------------------------
 
 TEST_LIST = {
@@ -478,6 +2827,57 @@ TEST_LIST = {
     { "ccrush_decompress_wrong_data_fails", ccrush_decompress_wrong_data_fails }, //
     { "ccrush_compress_file_buffersize_too_large", ccrush_compress_file_buffersize_too_large }, //
     { "ccrush_decompress_file_buffersize_too_large", ccrush_decompress_file_buffersize_too_large }, //
+    { "ccrush_compress_into_invalid_args", ccrush_compress_into_invalid_args }, //
+    { "ccrush_compress_into_and_decompress_into_succeed", ccrush_compress_into_and_decompress_into_succeed }, //
+    { "ccrush_compress_into_and_decompress_into_output_buffer_too_small_fails", ccrush_compress_into_and_decompress_into_output_buffer_too_small_fails }, //
+    { "ccrush_compress_with_size_header_and_decompression_succeeds", ccrush_compress_with_size_header_and_decompression_succeeds }, //
+    { "ccrush_decompress_without_size_header_still_works", ccrush_decompress_without_size_header_still_works }, //
+    { "ccrush_decompress_with_forged_size_header_fails", ccrush_decompress_with_forged_size_header_fails }, //
+    { "ccrush_compress_mt_invalid_args", ccrush_compress_mt_invalid_args }, //
+    { "ccrush_compress_mt_result_is_standard_zlib_and_decompression_succeeds", ccrush_compress_mt_result_is_standard_zlib_and_decompression_succeeds }, //
+    { "ccrush_compress_file_mt_invalid_args", ccrush_compress_file_mt_invalid_args }, //
+    { "ccrush_compress_file_mt_result_is_standard_zlib_and_decompression_succeeds", ccrush_compress_file_mt_result_is_standard_zlib_and_decompression_succeeds }, //
+    { "ccrush_ctx_invalid_args", ccrush_ctx_invalid_args }, //
+    { "ccrush_ctx_reused_across_many_calls_succeeds", ccrush_ctx_reused_across_many_calls_succeeds }, //
+    { "ccrush_ctx_compress_file_and_decompression_succeeds", ccrush_ctx_compress_file_and_decompression_succeeds }, //
+    { "ccrush_thread_cache_reused_across_calls_succeeds", ccrush_thread_cache_reused_across_calls_succeeds }, //
+    { "ccrush_set_allocator_invalid_args", ccrush_set_allocator_invalid_args }, //
+    { "ccrush_set_allocator_routes_all_allocations", ccrush_set_allocator_routes_all_allocations }, //
+    { "ccrush_ctx_new_ex_invalid_args", ccrush_ctx_new_ex_invalid_args }, //
+    { "ccrush_ctx_new_ex_uses_one_arena_per_context_across_threads", ccrush_ctx_new_ex_uses_one_arena_per_context_across_threads }, //
+    { "ccrush_scrub_buffers_opt_out_succeeds", ccrush_scrub_buffers_opt_out_succeeds }, //
+    { "ccrush_stream_invalid_args", ccrush_stream_invalid_args }, //
+    { "ccrush_stream_compress_and_decompress_in_pieces_succeeds", ccrush_stream_compress_and_decompress_in_pieces_succeeds }, //
+    { "ccrush_stream_decompress_with_size_header_one_byte_at_a_time_succeeds", ccrush_stream_decompress_with_size_header_one_byte_at_a_time_succeeds }, //
+    { "ccrush_stream_decompress_truncated_or_wrong_data_fails", ccrush_stream_decompress_truncated_or_wrong_data_fails }, //
+    { "ccrush_index_invalid_args", ccrush_index_invalid_args }, //
+    { "ccrush_decompress_range_succeeds", ccrush_decompress_range_succeeds }, //
+    { "ccrush_container_invalid_args", ccrush_container_invalid_args }, //
+    { "ccrush_container_compress_and_decompress_succeeds", ccrush_container_compress_and_decompress_succeeds }, //
+    { "ccrush_container_decompress_corrupt_or_wrong_data_fails", ccrush_container_decompress_corrupt_or_wrong_data_fails }, //
+    { "ccrush_compress_file_mapped_and_stdio_paths_produce_the_same_output", ccrush_compress_file_mapped_and_stdio_paths_produce_the_same_output }, //
+    { "ccrush_pipelined_io_produces_the_same_output_and_decompression_succeeds", ccrush_pipelined_io_produces_the_same_output_and_decompression_succeeds }, //
+    { "ccrush_file_raw_functions_respect_file_positions", ccrush_file_raw_functions_respect_file_positions }, //
+    { "ccrush_dictionary_functions_invalid_args_fail", ccrush_dictionary_functions_invalid_args_fail }, //
+    { "ccrush_compress_with_dictionary_shrinks_small_messages_and_decompression_succeeds", ccrush_compress_with_dictionary_shrinks_small_messages_and_decompression_succeeds }, //
+    { "ccrush_file_functions_with_dictionary_succeed", ccrush_file_functions_with_dictionary_succeed }, //
+    { "ccrush_ctx_set_dictionary_applies_to_all_ctx_functions", ccrush_ctx_set_dictionary_applies_to_all_ctx_functions }, //
+    { "ccrush_train_dictionary_invalid_args_fail", ccrush_train_dictionary_invalid_args_fail }, //
+    { "ccrush_train_dictionary_produces_a_dictionary_that_shrinks_similar_messages", ccrush_train_dictionary_produces_a_dictionary_that_shrinks_similar_messages }, //
+    { "ccrush_batch_functions_invalid_args_fail", ccrush_batch_functions_invalid_args_fail }, //
+    { "ccrush_compress_batch_and_decompress_batch_succeed", ccrush_compress_batch_and_decompress_batch_succeed }, //
+    { "ccrush_ctx_stats_record_each_call", ccrush_ctx_stats_record_each_call }, //
+    { "ccrush_set_thread_stats_records_plain_calls", ccrush_set_thread_stats_records_plain_calls }, //
+    { "ccrush_params_functions_invalid_args_fail", ccrush_params_functions_invalid_args_fail }, //
+    { "ccrush_compress_ex_all_strategies_and_headers_roundtrip", ccrush_compress_ex_all_strategies_and_headers_roundtrip }, //
+    { "ccrush_compress_into_ex_fits_the_bound_on_random_data", ccrush_compress_into_ex_fits_the_bound_on_random_data }, //
+    { "ccrush_file_and_stream_functions_ex_roundtrip_gzip", ccrush_file_and_stream_functions_ex_roundtrip_gzip }, //
+    { "ccrush_ctx_set_params_applies_to_all_ctx_functions", ccrush_ctx_set_params_applies_to_all_ctx_functions }, //
+    { "ccrush_adaptive_compression_stores_incompressible_blocks_only", ccrush_adaptive_compression_stores_incompressible_blocks_only }, //
+    { "ccrush_set_adaptive_compression_applies_to_plain_calls", ccrush_set_adaptive_compression_applies_to_plain_calls }, //
+    { "ccrush_estimate_ratio_invalid_args_fail_and_small_inputs_are_estimated", ccrush_estimate_ratio_invalid_args_fail_and_small_inputs_are_estimated }, //
+    { "ccrush_estimate_ratio_cost_stays_bounded_across_the_sampling_threshold", ccrush_estimate_ratio_cost_stays_bounded_across_the_sampling_threshold }, //
+    { "ccrush_estimate_ratio_is_within_margin_on_large_inputs", ccrush_estimate_ratio_is_within_margin_on_large_inputs }, //
     //
     // ----------------------------------------------------------------------------------------------------------
     //